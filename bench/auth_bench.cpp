@@ -0,0 +1,99 @@
+/*
+ * 本地用户文件（FileUserStore）的基准测试，不需要数据库
+ * 先单线程注册一批用户，再用1/4/8/16个线程并发登录（查找），混入一定比例的注册，
+ * 统计吞吐量和单次操作延迟的p50/p99
+ *   ./auth_bench [用户数] [每线程操作数] [注册的百分比]
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../code/pool/userfile.h"
+
+using namespace std;
+typedef chrono::steady_clock BenchClock;
+
+static const char* BENCH_FILE = "auth_bench.db";
+
+struct Result {
+    double throughput;  // 每秒操作数
+    double p50;         // 微秒
+    double p99;
+};
+
+static string Name(size_t i) { return "user" + to_string(i); }
+
+static Result RunThreads(FileUserStore& store, size_t threadNum, size_t users, size_t ops, int insertPct,
+                         atomic<size_t>& nextUser) {
+    vector<vector<double>> lat(threadNum);
+    atomic<size_t> fails(0);
+    auto start = BenchClock::now();
+    vector<thread> threads;
+    for(size_t t = 0; t < threadNum; t++) {
+        threads.emplace_back([&, t] {
+            uint32_t seed = 2654435761u * (t + 1);
+            lat[t].reserve(ops);
+            for(size_t i = 0; i < ops; i++) {
+                seed = seed * 1103515245 + 12345;
+                auto t0 = BenchClock::now();
+                bool ok;
+                if(static_cast<int>(seed % 100) < insertPct) {
+                    ok = store.Insert(Name(nextUser.fetch_add(1)), "pwd");
+                } else {
+                    string pwd;
+                    ok = store.Lookup(Name((seed >> 8) % users), &pwd) && pwd == "pwd";
+                }
+                lat[t].push_back(chrono::duration<double, micro>(BenchClock::now() - t0).count());
+                if(!ok) { fails++; }
+            }
+        });
+    }
+    for(auto& th: threads) { th.join(); }
+    double sec = chrono::duration<double>(BenchClock::now() - start).count();
+    vector<double> all;
+    for(auto& v: lat) { all.insert(all.end(), v.begin(), v.end()); }
+    sort(all.begin(), all.end());
+    if(fails) { printf("  %zu operations failed\n", fails.load()); }
+    return { all.size() / sec, all[all.size() / 2], all[all.size() * 99 / 100] };
+}
+
+int main(int argc, char* argv[]) {
+    size_t users = argc > 1 ? atol(argv[1]) : 200000;
+    size_t ops = argc > 2 ? atol(argv[2]) : 200000;
+    int insertPct = argc > 3 ? atoi(argv[3]) : 5;
+
+    unlink(BENCH_FILE);
+    {
+        FileUserStore store(BENCH_FILE);
+        if(!store.IsOpen()) {
+            printf("open %s error\n", BENCH_FILE);
+            return 1;
+        }
+        auto start = BenchClock::now();
+        for(size_t i = 0; i < users; i++) {
+            store.Insert(Name(i), "pwd");
+        }
+        double sec = chrono::duration<double>(BenchClock::now() - start).count();
+        printf("users: %zu, ops/thread: %zu, register: %d%%, hardware threads: %u\n",
+               users, ops, insertPct, thread::hardware_concurrency());
+        printf("load: %.0f inserts/s\n", users / sec);
+
+        atomic<size_t> nextUser(users);
+        printf("%-8s %14s %10s %10s\n", "threads", "ops/s", "p50(us)", "p99(us)");
+        for(size_t threads: { 1, 4, 8, 16 }) {
+            Result r = RunThreads(store, threads, users, ops, insertPct, nextUser);
+            printf("%-8zu %14.0f %10.2f %10.2f\n", threads, r.throughput, r.p50, r.p99);
+        }
+    }
+    // 重新打开，确认数据都在
+    FileUserStore store(BENCH_FILE);
+    printf("reopen: %zu users\n", store.Count());
+    unlink(BENCH_FILE);
+    return 0;
+}
@@ -0,0 +1,51 @@
+/*
+ * 日志的基准测试，测调用线程上一次LOG_*的开销
+ * 同一份代码编译两次：log_bench是文本日志，log_bench_bin定义了LOG_BINARY
+ *   ./log_bench [线程数] [每个线程的条数]
+ */
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../code/log/log.h"
+
+using namespace std;
+
+int main(int argc, char* argv[]) {
+    int threadNum = argc > 1 ? atoi(argv[1]) : 4;
+    int lines = argc > 2 ? atoi(argv[2]) : 200000;
+
+    // 测的是调用线程上的开销，环满时丢弃的行也计入
+    Log::Instance()->init(0, "./bench_log", ".log", 8192);
+    string path = "/images/profile-image.jpg";
+
+    vector<double> cost(threadNum);
+    vector<thread> threads;
+    for(int t = 0; t < threadNum; t++) {
+        threads.emplace_back([&, t] {
+            auto start = chrono::steady_clock::now();
+            for(int i = 0; i < lines; i++) {
+                LOG_DEBUG("Client[%d](%s:%d) %s, responses:%d, to %zu", 100 + t, "127.0.0.1", 40000 + i,
+                          path.c_str(), i & 15, (size_t)i * 3);
+            }
+            auto end = chrono::steady_clock::now();
+            cost[t] = chrono::duration<double, nano>(end - start).count() / lines;
+        });
+    }
+    for(auto& th: threads) { th.join(); }
+
+    double avg = 0;
+    for(double c: cost) { avg += c; }
+    avg /= threadNum;
+#ifdef LOG_BINARY
+    const char* mode = "binary";
+#else
+    const char* mode = "text";
+#endif
+    printf("%-8s threads:%d lines:%d  %.1f ns/call, dropped:%lu\n", mode, threadNum, lines, avg,
+           (unsigned long)Log::Instance()->GetDropCount());
+    return 0;
+}
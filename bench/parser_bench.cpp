@@ -0,0 +1,167 @@
+/*
+ * HTTP请求解析的基准测试
+ * 用抓到的请求报文（corpus目录下）对比旧的正则解析和现在的状态机解析
+ *   ./parser_bench [迭代次数] [报文文件...]
+ */
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <regex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stdio.h>
+
+#include "../code/buffer/buffer.h"
+#include "../code/http/httprequest.h"
+
+using namespace std;
+
+/* 旧版本的解析逻辑（regex），只保留解析部分，用来对比 */
+class LegacyRequest {
+public:
+    bool parse(Buffer& buff) {
+        const char CRLF[] = "\r\n";
+        state_ = REQUEST_LINE;
+        header_.clear();
+        while(buff.ReadableBytes() && state_ != FINISH) {
+            const char* lineEnd = search(buff.Peek(), buff.BeginWriteConst(), CRLF, CRLF + 2);
+            std::string line(buff.Peek(), lineEnd);
+            switch(state_) {
+            case REQUEST_LINE:
+                if(!ParseRequestLine_(line)) { return false; }
+                break;
+            case HEADERS:
+                ParseHeader_(line);
+                if(buff.ReadableBytes() <= 2) { state_ = FINISH; }
+                break;
+            case BODY:
+                body_ = line;
+                state_ = FINISH;
+                break;
+            default:
+                break;
+            }
+            if(lineEnd == buff.BeginWrite()) { break; }
+            buff.RetrieveUntil(lineEnd + 2);
+        }
+        return true;
+    }
+
+private:
+    enum PARSE_STATE { REQUEST_LINE, HEADERS, BODY, FINISH };
+
+    bool ParseRequestLine_(const string& line) {
+        regex patten("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$");
+        smatch subMatch;
+        if(regex_match(line, subMatch, patten)) {
+            method_ = subMatch[1];
+            path_ = subMatch[2];
+            version_ = subMatch[3];
+            state_ = HEADERS;
+            return true;
+        }
+        return false;
+    }
+
+    void ParseHeader_(const string& line) {
+        regex patten("^([^:]*): ?(.*)$");
+        smatch subMatch;
+        if(regex_match(line, subMatch, patten)) {
+            header_[subMatch[1]] = subMatch[2];
+        } else {
+            state_ = BODY;
+        }
+    }
+
+    PARSE_STATE state_;
+    string method_, path_, version_, body_;
+    unordered_map<string, string> header_;
+};
+
+static string ReadFile(const string& path) {
+    ifstream in(path, ios::binary);
+    return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+}
+
+template<typename F>
+static double Measure(int iters, F func) {
+    auto start = chrono::steady_clock::now();
+    for(int i = 0; i < iters; i++) {
+        func();
+    }
+    auto end = chrono::steady_clock::now();
+    return chrono::duration<double, nano>(end - start).count() / iters;
+}
+
+int main(int argc, char* argv[]) {
+    int iters = argc > 1 ? atoi(argv[1]) : 100000;
+    vector<string> files;
+    for(int i = 2; i < argc; i++) {
+        files.push_back(argv[i]);
+    }
+    if(files.empty()) {
+        files = { "corpus/curl_get.txt", "corpus/webbench_get.txt", "corpus/chrome_get.txt",
+                  "corpus/firefox_get.txt", "corpus/form_post.txt", "corpus/chunked_post.txt" };
+    }
+
+    Buffer buff;
+    LegacyRequest legacy;
+    HttpRequest request;
+    printf("%-28s %8s %12s %12s %14s %8s\n", "corpus", "bytes", "regex(ns)", "fsm(ns)", "fsm-16B(ns)", "speedup");
+    for(const string& file: files) {
+        string raw = ReadFile(file);
+        if(raw.empty()) {
+            fprintf(stderr, "can't read %s\n", file.c_str());
+            return 1;
+        }
+        // 先各跑一遍确认都能解析
+        buff.Append(raw);
+        if(!legacy.parse(buff)) {
+            fprintf(stderr, "%s: regex parse failed\n", file.c_str());
+            return 1;
+        }
+        buff.RetrieveAll();
+        buff.Append(raw);
+        if(request.parse(buff) != HttpRequest::GET_REQUEST || buff.ReadableBytes() != 0) {
+            fprintf(stderr, "%s: fsm parse failed\n", file.c_str());
+            return 1;
+        }
+        // 16个字节一段喂进去，断点续解析的结果要和一次解析完全一样
+        string method = request.method(), path = request.path(), body = request.body();
+        size_t headers = request.HeaderCount();
+        HttpRequest::HTTP_CODE ret = HttpRequest::NO_REQUEST;
+        buff.RetrieveAll();
+        for(size_t off = 0; off < raw.size(); off += 16) {
+            buff.Append(raw.data() + off, min<size_t>(16, raw.size() - off));
+            if(ret == HttpRequest::NO_REQUEST) { ret = request.parse(buff); }
+        }
+        if(ret != HttpRequest::GET_REQUEST || buff.ReadableBytes() != 0 || request.method() != method
+           || request.path() != path || request.HeaderCount() != headers || request.body() != body) {
+            fprintf(stderr, "%s: split parse differs from one-shot parse\n", file.c_str());
+            return 1;
+        }
+
+        double oldNs = Measure(iters / 10 + 1, [&] {
+            buff.Retrieve(buff.ReadableBytes());
+            buff.Append(raw);
+            legacy.parse(buff);
+        });
+        double newNs = Measure(iters, [&] {
+            buff.Retrieve(buff.ReadableBytes());
+            buff.Append(raw);
+            request.parse(buff);
+        });
+        // 每次只到达16个字节，测试断点续解析的开销
+        double splitNs = Measure(iters, [&] {
+            buff.Retrieve(buff.ReadableBytes());
+            for(size_t off = 0; off < raw.size(); off += 16) {
+                buff.Append(raw.data() + off, min<size_t>(16, raw.size() - off));
+                request.parse(buff);
+            }
+        });
+        printf("%-28s %8zu %12.0f %12.0f %14.0f %7.1fx\n", file.c_str(), raw.size(), oldNs, newNs, splitNs, oldNs / newNs);
+    }
+    return 0;
+}
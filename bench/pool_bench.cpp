@@ -0,0 +1,94 @@
+/*
+ * 线程池的基准测试，对比ThreadPool（一个队列一把锁）和WorkStealingPool
+ * 一个线程模拟事件循环不停地提交任务，每个任务属于某个连接，处理时读写这个连接自己的一块数据
+ * 同时在途的任务数限制在线程数的几倍（事件循环一次epoll_wait拿到的就绪连接是有限的），
+ * 统计吞吐量和排队延迟（提交到开始执行）的p50/p99
+ *   ./pool_bench [每轮任务数] [连接数]
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../code/pool/threadpool.h"
+#include "../code/pool/workstealingpool.h"
+
+using namespace std;
+typedef chrono::steady_clock BenchClock;
+
+struct alignas(64) ConnState {
+    char data[512];     // 模拟连接的读写缓冲区
+};
+
+struct Result {
+    double throughput;  // 每秒任务数
+    double p50;         // 微秒
+    double p99;
+};
+
+static void Work(ConnState& conn, uint32_t seed) {
+    // 大约一两微秒的活：把连接的缓冲区过一遍
+    uint32_t h = seed;
+    for(int round = 0; round < 4; round++) {
+        for(size_t i = 0; i < sizeof(conn.data); i++) {
+            h = h * 31 + conn.data[i];
+            conn.data[i] = static_cast<char>(h);
+        }
+    }
+}
+
+template<typename Submit>
+static Result Run(size_t taskNum, size_t window, vector<ConnState>& conns, Submit submit) {
+    vector<uint32_t> latency(taskNum);
+    atomic<size_t> done(0);
+    mt19937 rng(7);
+    vector<int> picks(taskNum);
+    for(auto& p: picks) { p = rng() % conns.size(); }
+
+    auto start = BenchClock::now();
+    for(size_t i = 0; i < taskNum; i++) {
+        int fd = picks[i];
+        while(i - done.load(memory_order_acquire) >= window) {
+            this_thread::yield();
+        }
+        auto submitAt = BenchClock::now();
+        submit([&, i, fd, submitAt] {
+            latency[i] = chrono::duration_cast<chrono::nanoseconds>(BenchClock::now() - submitAt).count();
+            Work(conns[fd], i);
+            done.fetch_add(1, memory_order_release);
+        }, fd);
+    }
+    while(done.load(memory_order_acquire) < taskNum) {
+        this_thread::yield();
+    }
+    double sec = chrono::duration<double>(BenchClock::now() - start).count();
+    sort(latency.begin(), latency.end());
+    return { taskNum / sec, latency[taskNum / 2] / 1000.0, latency[taskNum * 99 / 100] / 1000.0 };
+}
+
+int main(int argc, char* argv[]) {
+    size_t taskNum = argc > 1 ? atol(argv[1]) : 500000;
+    size_t connNum = argc > 2 ? atol(argv[2]) : 1000;
+    vector<ConnState> conns(connNum);
+
+    printf("tasks: %zu, connections: %zu, hardware threads: %u\n", taskNum, connNum, thread::hardware_concurrency());
+    printf("%-8s %-16s %14s %10s %10s\n", "threads", "pool", "tasks/s", "p50(us)", "p99(us)");
+    for(size_t threads: { 4, 8, 16, 32 }) {
+        Result old, ws;
+        {
+            ThreadPool pool(threads);
+            old = Run(taskNum, threads * 4, conns, [&pool](function<void()>&& task, int) { pool.AddTask(std::move(task)); });
+        }
+        {
+            WorkStealingPool pool(threads);
+            ws = Run(taskNum, threads * 4, conns, [&pool](function<void()>&& task, int fd) { pool.AddTask(std::move(task), fd); });
+        }
+        printf("%-8zu %-16s %14.0f %10.1f %10.1f\n", threads, "ThreadPool", old.throughput, old.p50, old.p99);
+        printf("%-8zu %-16s %14.0f %10.1f %10.1f\n", threads, "WorkStealing", ws.throughput, ws.p50, ws.p99);
+    }
+    return 0;
+}
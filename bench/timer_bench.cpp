@@ -0,0 +1,97 @@
+/*
+ * 定时器的基准测试，对比HeapTimer和TimingWheel
+ * 模拟大量keep-alive连接：先给每个连接加一个定时器，然后随机挑连接延长超时（对应每次读写的ExtentTime_），
+ * 最后让所有定时器一起到期
+ *   ./timer_bench [连接数] [延长次数]
+ */
+#include <chrono>
+#include <memory>
+#include <random>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../code/timer/heaptimer.h"
+#include "../code/timer/timingwheel.h"
+
+using namespace std;
+
+template<typename F>
+static double Measure(size_t ops, F func) {
+    auto start = chrono::steady_clock::now();
+    func();
+    auto end = chrono::steady_clock::now();
+    return chrono::duration<double, nano>(end - start).count() / ops;
+}
+
+struct Conn {
+    int fd;
+    WheelNode node;
+};
+
+int main(int argc, char* argv[]) {
+    size_t connNum = argc > 1 ? atol(argv[1]) : 100000;
+    size_t adjustNum = argc > 2 ? atol(argv[2]) : 1000000;
+    const int TIMEOUT = 60000;
+
+    // 两边用同一串随机的连接下标
+    mt19937 rng(42);
+    vector<int> picks(adjustNum);
+    for(auto& p: picks) { p = rng() % connNum; }
+    vector<int> timeouts(adjustNum);
+    for(auto& t: timeouts) { t = TIMEOUT + rng() % 1000; }
+
+    vector<Conn> conns(connNum);
+    size_t closed = 0;
+    for(size_t i = 0; i < connNum; i++) {
+        conns[i].fd = i;
+        conns[i].node.owner = &conns[i];
+    }
+
+    /* HeapTimer */
+    HeapTimer heap;
+    double heapAdd = Measure(connNum, [&] {
+        for(size_t i = 0; i < connNum; i++) {
+            heap.add(conns[i].fd, TIMEOUT, [&closed] { closed++; });
+        }
+    });
+    double heapAdjust = Measure(adjustNum, [&] {
+        for(size_t i = 0; i < adjustNum; i++) {
+            heap.adjust(picks[i], timeouts[i]);
+        }
+    });
+    // 全部改成已经到期，再测一次性清理
+    for(size_t i = 0; i < connNum; i++) {
+        heap.add(conns[i].fd, 0, [&closed] { closed++; });
+    }
+    double heapExpire = Measure(connNum, [&] { heap.tick(); });
+    size_t heapClosed = closed;
+
+    /* TimingWheel */
+    closed = 0;
+    TimingWheel wheel([&closed](WheelNode*) { closed++; });
+    double wheelAdd = Measure(connNum, [&] {
+        for(size_t i = 0; i < connNum; i++) {
+            wheel.Add(&conns[i].node, TIMEOUT);
+        }
+    });
+    double wheelAdjust = Measure(adjustNum, [&] {
+        for(size_t i = 0; i < adjustNum; i++) {
+            wheel.Adjust(&conns[picks[i]].node, timeouts[i]);
+        }
+    });
+    for(size_t i = 0; i < connNum; i++) {
+        wheel.Add(&conns[i].node, 0);
+    }
+    // 等到下一个tick，保证都到期了
+    uint64_t until = TimingWheel::NowMs() + 2 * TimingWheel::TICK_MS;
+    while(TimingWheel::NowMs() < until) {}
+    double wheelExpire = Measure(connNum, [&] { wheel.Tick(); });
+    size_t wheelClosed = closed;
+
+    printf("connections: %zu, adjusts: %zu\n", connNum, adjustNum);
+    printf("%-12s %12s %12s %12s %10s\n", "", "add(ns)", "adjust(ns)", "expire(ns)", "expired");
+    printf("%-12s %12.1f %12.1f %12.1f %10zu\n", "HeapTimer", heapAdd, heapAdjust, heapExpire, heapClosed);
+    printf("%-12s %12.1f %12.1f %12.1f %10zu\n", "TimingWheel", wheelAdd, wheelAdjust, wheelExpire, wheelClosed);
+    return 0;
+}
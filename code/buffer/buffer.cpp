@@ -1,6 +1,93 @@
 #include "buffer.h"
+#include <stdlib.h>
+#include <algorithm>
 
-Buffer::Buffer(int initBuffSize) : buffer_(initBuffSize), readPos_(0), writePos_(0) {}
+namespace {
+
+/**
+ * 每个线程一个的块池，每一档一条空闲链表，链表的指针直接放在空闲块的开头
+ * 块可以在别的线程归还（线程池模式下连接会换线程），归还到当前线程的池子里；
+ * 每一档留的空闲块有上限，多出来的直接释放；线程退出时全部释放
+*/
+class ChunkPool {
+public:
+    ~ChunkPool() {
+        for(int i = 0; i < Buffer::CHUNK_CLASSES; i++) {
+            while(free_[i]) {
+                Node* next = free_[i]->next;
+                ::free(free_[i]);
+                free_[i] = next;
+            }
+        }
+    }
+
+    static ChunkPool& Local() {
+        static thread_local ChunkPool pool;
+        return pool;
+    }
+
+    // 返回的块大小写在size里，至少是size
+    char* Get(size_t* size) {
+        int cls = ClassOf_(*size);
+        if(cls < 0) {
+            return static_cast<char*>(malloc(*size));
+        }
+        *size = Buffer::MIN_CHUNK << cls;
+        if(free_[cls]) {
+            Node* node = free_[cls];
+            free_[cls] = node->next;
+            count_[cls]--;
+            return reinterpret_cast<char*>(node);
+        }
+        return static_cast<char*>(malloc(*size));
+    }
+
+    void Put(char* chunk, size_t size) {
+        int cls = ClassOf_(size);
+        if(cls < 0 || (count_[cls] + 1) * size > Buffer::POOL_BYTES) {
+            ::free(chunk);
+            return;
+        }
+        Node* node = reinterpret_cast<Node*>(chunk);
+        node->next = free_[cls];
+        free_[cls] = node;
+        count_[cls]++;
+    }
+
+private:
+    struct Node {
+        Node* next;
+    };
+
+    ChunkPool() {
+        for(int i = 0; i < Buffer::CHUNK_CLASSES; i++) {
+            free_[i] = nullptr;
+            count_[i] = 0;
+        }
+    }
+
+    // 能装下size的最小的一档，超过最大一档返回-1
+    static int ClassOf_(size_t size) {
+        size_t chunk = Buffer::MIN_CHUNK;
+        for(int i = 0; i < Buffer::CHUNK_CLASSES; i++, chunk <<= 1) {
+            if(size <= chunk) { return i; }
+        }
+        return -1;
+    }
+
+    Node* free_[Buffer::CHUNK_CLASSES];
+    size_t count_[Buffer::CHUNK_CLASSES];
+};
+
+}
+
+Buffer::Buffer(int initBuffSize) : buf_(nullptr), cap_(0),
+    initSize_(initBuffSize > 0 ? initBuffSize : MIN_CHUNK), readPos_(0), writePos_(0),
+    readHint_(initSize_), readCnt_(0), overflowCnt_(0) {}
+
+Buffer::~Buffer() {
+    if(buf_) { ChunkPool::Local().Put(buf_, cap_); }
+}
 
 // 可以读的数据的大小
 size_t Buffer::ReadableBytes() const {
@@ -8,7 +95,7 @@ size_t Buffer::ReadableBytes() const {
 }
 // 可以写的数据的大小
 size_t Buffer::WritableBytes() const {
-    return buffer_.size() - writePos_;
+    return cap_ - writePos_;
 }
 // 前面可以用的空间
 size_t Buffer::PrependableBytes() const {
@@ -22,6 +109,10 @@ const char* Buffer::Peek() const {
 void Buffer::Retrieve(size_t len) {
     assert(len <= ReadableBytes());
     readPos_ += len;
+    if(readPos_ == writePos_) {
+        // 读完了，下次从头写，省得数据往后越写越远
+        readPos_ = writePos_ = 0;
+    }
 }
 
 void Buffer::RetrieveUntil(const char* end) {
@@ -30,7 +121,6 @@ void Buffer::RetrieveUntil(const char* end) {
 }
 
 void Buffer::RetrieveAll() {
-    bzero(&buffer_[0], buffer_.size());
     readPos_ = 0;
     writePos_ = 0;
 }
@@ -41,6 +131,14 @@ std::string Buffer::RetrieveAllToStr() {
     return str;
 }
 
+void Buffer::Release() {
+    if(!buf_ || ReadableBytes() > 0) { return; }
+    ChunkPool::Local().Put(buf_, cap_);
+    buf_ = nullptr;
+    cap_ = 0;
+    readPos_ = writePos_ = 0;
+}
+
 const char* Buffer::BeginWriteConst() const {
     return BeginPtr_() + writePos_;
 }
@@ -49,9 +147,24 @@ char* Buffer::BeginWrite() {
     return BeginPtr_() + writePos_;
 }
 
+struct iovec Buffer::ReadableIov() const {
+    struct iovec iov;
+    iov.iov_base = const_cast<char*>(Peek());
+    iov.iov_len = ReadableBytes();
+    return iov;
+}
+
+struct iovec Buffer::WritableIov() {
+    struct iovec iov;
+    iov.iov_base = BeginWrite();
+    iov.iov_len = WritableBytes();
+    return iov;
+}
+
 void Buffer::HasWritten(size_t len) {
+    assert(len <= WritableBytes());
     writePos_ += len;
-} 
+}
 
 void Buffer::Append(const std::string& str) {
     Append(str.data(), str.length());
@@ -66,7 +179,7 @@ void Buffer::Append(const void* data, size_t len) {
 void Buffer::Append(const char* str, size_t len) {
     assert(str);
     EnsureWriteable(len);
-    std::copy(str, str + len, BeginWrite());
+    memcpy(BeginWrite(), str, len);
     HasWritten(len);
 }
 
@@ -82,61 +195,88 @@ void Buffer::EnsureWriteable(size_t len) {
 }
 
 ssize_t Buffer::ReadFd(int fd, int* saveErrno) {
-    char buff[65535];   // 临时的数组，保证能够把所有的数据都读出来
-    
+    // 块装不下的部分先读到这里，每个线程一份，不用每次在栈上开64KB
+    static thread_local char scratch[SCRATCH_SIZE];
+
+    // 按上一次读到的多少准备空间，大请求、流水线一般一次就直接读进块里
+    EnsureWriteable(readHint_);
     struct iovec iov[2];
     const size_t writable = WritableBytes();
 
     /* 分散读， 保证数据全部读完 */
-    iov[0].iov_base = BeginPtr_() + writePos_;
-    iov[0].iov_len = writable;
-    iov[1].iov_base = buff;
-    iov[1].iov_len = sizeof(buff);
+    iov[0] = WritableIov();
+    iov[1].iov_base = scratch;
+    iov[1].iov_len = sizeof(scratch);
 
     const ssize_t len = readv(fd, iov, 2);
     if(len < 0) {
         *saveErrno = errno;
+        return len;
     }
-    else if(static_cast<size_t>(len) <= writable) {
+    if(len == 0) { return len; }
+    readCnt_++;
+    if(static_cast<size_t>(len) <= writable) {
         writePos_ += len;
     }
     else {
-        writePos_ = buffer_.size();
-        Append(buff, len - writable);
+        // 用到了第二个iovec，多出来的要再拷贝一次
+        overflowCnt_++;
+        writePos_ = cap_;
+        Append(scratch, len - writable);
+    }
+    // 读满了说明还可能有更多，下次准备大一倍；读到的不到四分之一就减半
+    if(static_cast<size_t>(len) >= writable) {
+        readHint_ = std::max(readHint_ * 2, static_cast<size_t>(len));
+        if(readHint_ > MAX_READ_HINT) { readHint_ = MAX_READ_HINT; }
+    } else if(static_cast<size_t>(len) < readHint_ / 4) {
+        readHint_ = std::max(readHint_ / 2, initSize_);
     }
     return len;
 }
 
 ssize_t Buffer::WriteFd(int fd, int* saveErrno) {
-    size_t readSize = ReadableBytes();
-    ssize_t len = write(fd, Peek(), readSize);
+    struct iovec iov = ReadableIov();
+    ssize_t len = writev(fd, &iov, 1);
     if(len < 0) {
         *saveErrno = errno;
         return len;
-    } 
-    readPos_ += len;
+    }
+    Retrieve(len);
     return len;
 }
 
+void Buffer::ResetReadStats() {
+    readHint_ = initSize_;
+    readCnt_ = 0;
+    overflowCnt_ = 0;
+}
+
 char* Buffer::BeginPtr_() {
-    return &*buffer_.begin();
+    return buf_;
 }
 
 const char* Buffer::BeginPtr_() const {
-    return &*buffer_.begin();
+    return buf_;
 }
 
 void Buffer::MakeSpace_(size_t len) {
-    //后面可写的空间加上前面已经解析完的空间如果不够就扩容
-    if(WritableBytes() + PrependableBytes() < len) {
-        buffer_.resize(writePos_ + len + 1);
-    } 
-    //如果够的话就把数据拷贝往前移把前面空的空间用上，这样后面就有空间可以用了
+    size_t readable = ReadableBytes();
+    //后面可写的空间加上前面已经解析完的空间够用，就把数据拷贝往前移把前面空的空间用上
+    if(buf_ && WritableBytes() + PrependableBytes() >= len) {
+        memmove(BeginPtr_(), Peek(), readable);
+    }
+    // 不够就换一块更大的，只拷贝没读的数据，旧块还给块池
     else {
-        size_t readable = ReadableBytes();
-        std::copy(BeginPtr_() + readPos_, BeginPtr_() + writePos_, BeginPtr_());
-        readPos_ = 0;
-        writePos_ = readPos_ + readable;
-        assert(readable == ReadableBytes());
+        size_t size = std::max(readable + len, std::max(initSize_, cap_ * 2));
+        char* chunk = ChunkPool::Local().Get(&size);
+        if(readable > 0) {
+            memcpy(chunk, Peek(), readable);
+        }
+        if(buf_) { ChunkPool::Local().Put(buf_, cap_); }
+        buf_ = chunk;
+        cap_ = size;
     }
+    readPos_ = 0;
+    writePos_ = readable;
+    assert(readable == ReadableBytes());
 }
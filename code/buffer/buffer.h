@@ -4,17 +4,27 @@
 #include <iostream>
 #include <unistd.h>  // write
 #include <sys/uio.h> //readv
-#include <vector> //readv
-#include <atomic>
 #include <assert.h>
+
+/**
+ * 读写缓冲区，同一时刻只有一个线程在用，读写位置是普通的整数
+ * 数据放在一块连续的内存里（解析请求、拼响应头都要求连续），块从当前线程的块池里取，
+ * 大小是固定的几档（1KB起，每档翻倍），超过最大一档的直接分配
+ * 不够用时换一块大一档的，只拷贝还没读的数据；清空时只挪读写位置，不清零
+ * 没有数据的时候调用Release把块还给块池，空闲的连接不占缓冲区
+*/
 class Buffer {
 public:
-    Buffer(int initBuffSize = 1024);    // 容器初始化大小为1024
-    ~Buffer() = default;
+    Buffer(int initBuffSize = 1024);    // 第一次写入时取多大的块
+    ~Buffer();
+
+    Buffer(const Buffer&) = delete;
+    Buffer& operator=(const Buffer&) = delete;
 
     size_t WritableBytes() const;       // 可写的字节数
     size_t ReadableBytes() const ;      // 可读的字节数
     size_t PrependableBytes() const;    // 可以扩展的字节数
+    size_t Capacity() const { return cap_; }
 
     const char* Peek() const;
     void EnsureWriteable(size_t len);
@@ -26,25 +36,48 @@ public:
     void RetrieveAll() ;
     std::string RetrieveAllToStr();
 
+    void Release();     // 没有可读的数据时把块还给块池
+
     const char* BeginWriteConst() const;
     char* BeginWrite();
 
+    // 给readv/writev用的视图：可读的部分和可写的部分
+    struct iovec ReadableIov() const;
+    struct iovec WritableIov();
+
     void Append(const std::string& str);
+    void Append(const char* str) { Append(str, strlen(str)); }  // 字符串字面量不用构造临时的string
     void Append(const char* str, size_t len);
     void Append(const void* data, size_t len);
     void Append(const Buffer& buff);
 
+    // 直接读进块里，块的大小按这个缓冲区上一次读到的多少来定；块装不下的先读进线程的暂存区再追加
     ssize_t ReadFd(int fd, int* Errno);
     ssize_t WriteFd(int fd, int* Errno);
 
+    size_t ReadCount() const { return readCnt_; }           // ReadFd读到数据的次数
+    size_t OverflowCount() const { return overflowCnt_; }   // 其中用到暂存区（第二个iovec）的次数
+    void ResetReadStats();  // 换了连接，统计和读的大小都从头开始
+
+    static const size_t MIN_CHUNK = 1024;       // 最小的一档
+    static const int CHUNK_CLASSES = 8;         // 1KB到128KB，更大的不进块池
+    static const size_t POOL_BYTES = 1 << 20;   // 每个线程每一档最多留这么多字节的空闲块
+    static const size_t MAX_READ_HINT = 64 * 1024;  // 一次读最多先准备多大的块
+    static const size_t SCRATCH_SIZE = 64 * 1024;   // 每个线程的读暂存区
+
 private:
     char* BeginPtr_();      // 开始的指针
     const char* BeginPtr_() const;  // 重载的beginptr
-    void MakeSpace_(size_t len);    // 创建新的空间（默认创建的大小为1024，不够用就去创建新的空间）
+    void MakeSpace_(size_t len);    // 空间不够时把数据挪到前面，还不够就换一块更大的
 
-    std::vector<char> buffer_;      // 具体装数据的vector
-    std::atomic<std::size_t> readPos_;  // 读的位置（目前读到的位置）
-    std::atomic<std::size_t> writePos_; // 写的位置
+    char* buf_;         // 当前的块，没有数据时可能是nullptr
+    size_t cap_;        // 块的大小
+    size_t initSize_;
+    size_t readPos_;    // 读的位置（目前读到的位置）
+    size_t writePos_;   // 写的位置
+    size_t readHint_;   // 下一次读预计能读到多少，读满了翻倍，读得少了减半
+    size_t readCnt_;
+    size_t overflowCnt_;
 };
 
 #endif //BUFFER_H
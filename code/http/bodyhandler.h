@@ -0,0 +1,47 @@
+#ifndef BODY_HANDLER_H
+#define BODY_HANDLER_H
+
+#include <stddef.h>
+
+class HttpRequest;
+
+/* 一个请求的请求体的接收方，数据到一段交一段，不在内存里攒整个请求体 */
+class BodySink {
+public:
+    virtual ~BodySink() = default;
+
+    virtual bool Write(const char* data, size_t len) = 0;   // 返回false表示不要了，请求按400处理
+
+    virtual bool Finish() = 0;  // 请求体收完了（chunked的trailer也解析完了），返回false同样按400处理
+};
+
+/**
+ * 决定大的请求体交给谁，设置给HttpRequest::bodyHandler
+ * 没有设置，或者NewSink返回nullptr时，请求体照常放进body_（不超过HttpRequest::maxBodySize）
+*/
+class BodyHandler {
+public:
+    virtual ~BodyHandler() = default;
+
+    // 请求体超过HttpRequest::MAX_BUFFERED_BODY时调用，这时请求头都解析完了
+    virtual BodySink* NewSink(const HttpRequest& request) = 0;
+};
+
+/* 收到的请求体直接丢掉，只留长度 */
+class DiscardSink: public BodySink {
+public:
+    bool Write(const char* data, size_t len) override { (void)data; (void)len; return true; }
+
+    bool Finish() override { return true; }
+};
+
+/**
+ * 服务器用的：只有登录/注册的表单要看请求体，它们都很小，不会超过MAX_BUFFERED_BODY；
+ * 更大的请求体没有人用，边收边丢，每个连接不用攒到maxBodySize
+*/
+class DiscardBodyHandler: public BodyHandler {
+public:
+    BodySink* NewSink(const HttpRequest& request) override { (void)request; return new DiscardSink; }
+};
+
+#endif //BODY_HANDLER_H
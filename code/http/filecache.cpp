@@ -0,0 +1,232 @@
+#include "filecache.h"
+#include "httpresponse.h"
+
+using namespace std;
+
+FileCache::FileCache() {
+    isOpen_ = false;
+    shardCapacity_ = 0;
+    maxFileSize_ = 0;
+    revalidateSec_ = 1;
+}
+
+FileCache* FileCache::Instance() {
+    static FileCache cache;
+    return &cache;
+}
+
+void FileCache::Init(size_t capacity, size_t maxFileSize, int revalidateSec, int shardNum) {
+    assert(shardNum > 0 && revalidateSec >= 0);
+    shards_.clear();
+    for(int i = 0; i < shardNum; i++) {
+        shards_.emplace_back(new Shard());
+    }
+    shardCapacity_ = capacity / shardNum;
+    // 单个文件不能超过一个分片的预算
+    maxFileSize_ = min(maxFileSize, shardCapacity_);
+    revalidateSec_ = revalidateSec;
+    isOpen_ = capacity > 0;
+}
+
+FileCache::Shard& FileCache::GetShard_(const string& key) {
+    return *shards_[hash<string>()(key) % shards_.size()];
+}
+
+CachedFilePtr FileCache::Get(const string& path, int encoding) {
+    if(!isOpen_) { return nullptr; }
+    assert(encoding >= 0 && encoding < HttpResponse::ENCODING_NUM);
+    // 压缩版本单独占一个条目，和原文件各自淘汰、各自检查是否过期
+    const string key = encoding ? string(HttpResponse::ENCODING_NAME[encoding]) + ":" + path : path;
+    Shard& shard = GetShard_(key);
+    CachedFilePtr file;
+    {
+        lock_guard<mutex> locker(shard.mtx);
+        auto it = shard.index.find(key);
+        if(it != shard.index.end()) {
+            file = *it->second;
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        }
+    }
+    if(file) {
+        if(!IsStale_(file)) {
+            shard.hits++;
+            return file;
+        }
+        LOG_DEBUG("FileCache %s changed", key.c_str());
+        lock_guard<mutex> locker(shard.mtx);
+        Erase_(shard, file);
+    }
+    shard.misses++;
+
+    /* 同一个路径只让一个线程去加载 */
+    shared_ptr<Flight> flight;
+    bool leader = false;
+    {
+        lock_guard<mutex> locker(shard.mtx);
+        auto it = shard.flights.find(key);
+        if(it != shard.flights.end()) {
+            flight = it->second;
+        } else {
+            flight = make_shared<Flight>();
+            shard.flights[key] = flight;
+            leader = true;
+        }
+    }
+    if(!leader) {
+        unique_lock<mutex> locker(flight->mtx);
+        flight->cond.wait(locker, [&flight]{ return flight->done; });
+        return flight->result;
+    }
+
+    file = Load_(key, path, encoding);
+    shard.loads++;
+    {
+        lock_guard<mutex> locker(shard.mtx);
+        if(file) { Insert_(shard, file); }
+        shard.flights.erase(key);
+    }
+    {
+        lock_guard<mutex> locker(flight->mtx);
+        flight->result = file;
+        flight->done = true;
+    }
+    flight->cond.notify_all();
+    return file;
+}
+
+bool FileCache::IsStale_(const CachedFilePtr& file) {
+    time_t now = time(nullptr);
+    time_t checked = file->checkedAt.load(memory_order_relaxed);
+    if(now - checked < revalidateSec_) {
+        return false;
+    }
+    // 同一个条目同一秒内只让一个线程去stat
+    if(!file->checkedAt.compare_exchange_strong(checked, now)) {
+        return false;
+    }
+    struct stat st;
+    if(stat(file->path.data(), &st) < 0) {
+        return true;
+    }
+    if(st.st_mtim.tv_sec != file->st.st_mtim.tv_sec || st.st_mtim.tv_nsec != file->st.st_mtim.tv_nsec
+        || st.st_size != file->st.st_size || st.st_ino != file->st.st_ino || st.st_mode != file->st.st_mode) {
+        return true;
+    }
+    // 压缩文件后来才生成或者被删掉了，原文件的条目也要重新加载
+    return file->encoding == HttpResponse::IDENTITY && HttpResponse::FindVariants(file->path, st) != file->variants;
+}
+
+CachedFilePtr FileCache::Load_(const string& key, const string& origPath, int encoding) {
+    const string path = origPath + HttpResponse::ENCODING_SUFFIX[encoding];
+    struct stat st;
+    // 只缓存其他用户可读的普通文件，404、403和目录交给HttpResponse原来的逻辑处理
+    if(stat(path.data(), &st) < 0 || !S_ISREG(st.st_mode) || !(st.st_mode & S_IROTH)) {
+        return nullptr;
+    }
+    shared_ptr<CachedFile> file = make_shared<CachedFile>();
+    file->key = key;
+    file->path = path;
+    file->st = st;
+    file->encoding = encoding;
+    file->type = HttpResponse::FileType(origPath);
+    // 原文件的条目记下有哪些压缩版本，原文件改了重新加载时会重新检查
+    if(encoding == HttpResponse::IDENTITY) {
+        file->variants = HttpResponse::FindVariants(path, st);
+    }
+    file->etag = HttpResponse::ETag(st);
+    file->lastModified = HttpResponse::HttpDate(st.st_mtime);
+    file->validators = HttpResponse::Validators(file->etag, file->lastModified);
+    bool vary = encoding != HttpResponse::IDENTITY || file->variants != 0;
+    file->header[0] = HttpResponse::HeaderBlock(file->type, st.st_size, false, encoding, vary);
+    file->header[1] = HttpResponse::HeaderBlock(file->type, st.st_size, true, encoding, vary);
+    file->checkedAt = time(nullptr);
+    if(static_cast<size_t>(st.st_size) <= maxFileSize_) {
+        int fd = open(path.data(), O_RDONLY | O_CLOEXEC);
+        if(fd < 0) { return nullptr; }
+        size_t size = st.st_size;
+        size_t off = 0;
+        file->data.resize(size);
+        while(off < size) {
+            ssize_t len = pread(fd, &file->data[off], size - off, off);
+            if(len < 0 && errno == EINTR) { continue; }
+            if(len <= 0) { break; }
+            off += len;
+        }
+        close(fd);
+        // 读的过程中文件被截断了，这次不缓存
+        if(off != size) { return nullptr; }
+        file->hasData = true;
+    }
+    LOG_DEBUG("FileCache load %s, size:%d, data:%d, variants:%d", path.c_str(), (int)st.st_size,
+              (int)file->hasData, file->variants);
+    return file;
+}
+
+void FileCache::Insert_(Shard& shard, const CachedFilePtr& file) {
+    auto it = shard.index.find(file->key);
+    if(it != shard.index.end()) {
+        Erase_(shard, *it->second);
+    }
+    if(file->Charge() > shardCapacity_) { return; }
+    shard.lru.push_front(file);
+    shard.index[file->key] = shard.lru.begin();
+    shard.bytes += file->Charge();
+    // 超出预算就从尾部淘汰最久没用的
+    while(shard.bytes > shardCapacity_ && !shard.lru.empty()) {
+        Erase_(shard, shard.lru.back());
+    }
+}
+
+void FileCache::Erase_(Shard& shard, const CachedFilePtr& file) {
+    auto it = shard.index.find(file->key);
+    // 已经被别的线程换成了新条目就不要删
+    if(it == shard.index.end() || *it->second != file) { return; }
+    shard.bytes -= file->Charge();
+    shard.lru.erase(it->second);
+    shard.index.erase(it);
+}
+
+void FileCache::Clear() {
+    for(auto& shard: shards_) {
+        lock_guard<mutex> locker(shard->mtx);
+        shard->lru.clear();
+        shard->index.clear();
+        shard->bytes = 0;
+    }
+}
+
+uint64_t FileCache::GetHitCount() const {
+    uint64_t cnt = 0;
+    for(auto& shard: shards_) { cnt += shard->hits; }
+    return cnt;
+}
+
+uint64_t FileCache::GetMissCount() const {
+    uint64_t cnt = 0;
+    for(auto& shard: shards_) { cnt += shard->misses; }
+    return cnt;
+}
+
+uint64_t FileCache::GetLoadCount() const {
+    uint64_t cnt = 0;
+    for(auto& shard: shards_) { cnt += shard->loads; }
+    return cnt;
+}
+
+size_t FileCache::GetBytes() {
+    size_t bytes = 0;
+    for(auto& shard: shards_) {
+        lock_guard<mutex> locker(shard->mtx);
+        bytes += shard->bytes;
+    }
+    return bytes;
+}
+
+size_t FileCache::GetEntryCount() {
+    size_t cnt = 0;
+    for(auto& shard: shards_) {
+        lock_guard<mutex> locker(shard->mtx);
+        cnt += shard->lru.size();
+    }
+    return cnt;
+}
@@ -0,0 +1,106 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <string>
+#include <list>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <unordered_map>
+#include <fcntl.h>       // open
+#include <unistd.h>      // pread, close
+#include <sys/stat.h>    // stat
+#include <time.h>
+#include <assert.h>
+
+#include "../log/log.h"
+
+/* 缓存的一个静态文件：文件内容和预先算好的元数据 */
+struct CachedFile {
+    std::string key;        // 缓存的键，压缩版本是"格式:原文件路径"
+    std::string path;       // 完整路径，压缩版本是压缩文件的路径
+    int encoding = 0;       // HttpResponse::Encoding
+    int variants = 0;       // 原文件的条目：有哪些可用的压缩版本，按位或(1 << Encoding)
+    struct stat st;         // 文件信息（大小、权限、mtime）
+    std::string type;       // Content-type
+    std::string etag;       // 强ETag，带引号
+    std::string lastModified;   // Last-Modified的日期
+    std::string validators; // 200/206响应里的ETag、Last-Modified、Cache-Control三行
+    std::string header[2];  // 预先拼好的响应头，下标为是否keep-alive
+    std::string data;       // 文件内容，hasData为false时为空
+    bool hasData = false;   // 文件太大时只缓存元数据，正文仍走mmap/sendfile
+    mutable std::atomic<time_t> checkedAt{0};   // 上一次stat检查的时间（秒）
+
+    size_t Charge() const {
+        return sizeof(CachedFile) + key.size() + path.size() + type.size() +
+            etag.size() + lastModified.size() + validators.size() + header[0].size() + header[1].size() + data.size();
+    }
+};
+
+typedef std::shared_ptr<const CachedFile> CachedFilePtr;
+
+/**
+ * 静态文件缓存，单例
+ * 按路径分片，每个分片一个LRU，总大小受字节预算限制
+ * 同一路径并发未命中时只有一个线程去读文件，其他线程等它的结果（single-flight）
+ * 命中时每个条目最多每revalidateSec秒stat一次，mtime/大小/inode变了就失效重新加载，其余命中不需要任何文件系统调用
+*/
+class FileCache {
+public:
+    static FileCache* Instance();
+
+    // capacity为总字节预算，maxFileSize以上的文件只缓存元数据
+    void Init(size_t capacity, size_t maxFileSize, int revalidateSec = 1, int shardNum = 16);
+
+    bool IsOpen() const { return isOpen_; }
+
+    // 不是可读的普通文件时返回nullptr；encoding不是0时取path旁边对应的压缩文件，类型还是原文件的
+    CachedFilePtr Get(const std::string& path, int encoding = 0);
+
+    void Clear();
+
+    uint64_t GetHitCount() const;
+    uint64_t GetMissCount() const;
+    uint64_t GetLoadCount() const;     // 真正去读文件的次数（并发未命中被合并之后）
+    size_t GetBytes();
+    size_t GetEntryCount();
+
+private:
+    FileCache();
+    ~FileCache() = default;
+
+    /* 并发加载同一个路径时，后来的线程等在这里 */
+    struct Flight {
+        std::mutex mtx;
+        std::condition_variable cond;
+        bool done = false;
+        CachedFilePtr result;
+    };
+
+    struct Shard {
+        std::mutex mtx;
+        std::list<CachedFilePtr> lru;   // 头部是最近使用的
+        std::unordered_map<std::string, std::list<CachedFilePtr>::iterator> index;
+        std::unordered_map<std::string, std::shared_ptr<Flight>> flights;
+        size_t bytes = 0;
+        std::atomic<uint64_t> hits{0};
+        std::atomic<uint64_t> misses{0};
+        std::atomic<uint64_t> loads{0};
+    };
+
+    Shard& GetShard_(const std::string& key);
+    bool IsStale_(const CachedFilePtr& file);
+    CachedFilePtr Load_(const std::string& key, const std::string& path, int encoding);
+    void Insert_(Shard& shard, const CachedFilePtr& file);
+    void Erase_(Shard& shard, const CachedFilePtr& file);
+
+    bool isOpen_;
+    size_t shardCapacity_;  // 每个分片的字节预算
+    size_t maxFileSize_;
+    int revalidateSec_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+#endif //FILE_CACHE_H
@@ -4,11 +4,24 @@ using namespace std;
 const char* HttpConn::srcDir;
 std::atomic<int> HttpConn::userCount;
 bool HttpConn::isET;
+const char* HttpConn::metricsPath = "/metrics";
+UserStore* HttpConn::userStore;
+
+static const string METRICS_TYPE = "text/plain; version=0.0.4";
 
 HttpConn::HttpConn() { 
     fd_ = -1;
     addr_ = { 0 };
     isClose_ = true;
+    iovCnt_ = iovIdx_ = 0;
+    iovLeft_ = 0;
+    fileFd_ = -1;
+    fileOffset_ = 0;
+    fileLeft_ = 0;
+    keepAlive_ = false;
+    batchStart_ = 0;
+    respCnt_ = 0;
+    timerNode_.owner = this;
 };
 
 HttpConn::~HttpConn() { 
@@ -22,21 +35,44 @@ void HttpConn::init(int fd, const sockaddr_in& addr) {
     fd_ = fd;
     writeBuff_.RetrieveAll();
     readBuff_.RetrieveAll();
+    readBuff_.ResetReadStats();
+    request_.Init();
+    iovCnt_ = iovIdx_ = 0;
+    iovLeft_ = 0;
+    fileFd_ = -1;
+    fileOffset_ = 0;
+    fileLeft_ = 0;
+    keepAlive_ = false;
+    needLinger_ = lingering_ = false;
+    lingerLeft_ = 0;
+    batchStart_ = 0;
     isClose_ = false;
+    Metrics::Inc(Metrics::CONN_ACCEPTED);
     LOG_INFO("Client[%d](%s:%d) in, userCount:%d", fd_, GetIP(), GetPort(), (int)userCount);
 }
 
 void HttpConn::Close() {
+    // 还在等数据库的验证直接放弃，调用方已经把它的socket从poller里删掉了
+    verify_.reset();
     // 响应的文件做内存释放
-    response_.UnmapFile();
+    ReleaseResponses_();
     if(isClose_ == false){
         // 设置关闭
         isClose_ = true;
         // 连接的用户数减1 
         userCount--;
-        // 关闭这个文件描述符
-        close(fd_);
+        Metrics::Inc(Metrics::CONN_CLOSED);
+        // HttpConn会留着给下一个连接用，缓冲区先还回去
+        readBuff_.RetrieveAll();
+        readBuff_.Release();
+        writeBuff_.RetrieveAll();
+        writeBuff_.Release();
         LOG_INFO("Client[%d](%s:%d) quit, UserCount:%d", fd_, GetIP(), GetPort(), (int)userCount);
+        LOG_DEBUG("Client[%d] reads:%zu overflow:%zu", fd_, readBuff_.ReadCount(), readBuff_.OverflowCount());
+        // 最后才关闭文件描述符：关了之后fd马上可能被新连接复用，这个对象就归新连接了（线程池模式下init在主线程里）
+        int fd = fd_;
+        fd_ = -1;
+        close(fd);
     }
 }
 
@@ -44,86 +80,290 @@ int HttpConn::GetFd() const {
     return fd_;
 };
 
-struct sockaddr_in HttpConn::GetAddr() const {
+const sockaddr_in& HttpConn::PeerAddr_() const {
+    if(addr_.sin_family == 0 && fd_ > 0) {
+        socklen_t len = sizeof(addr_);
+        getpeername(fd_, (struct sockaddr *)&addr_, &len);
+    }
     return addr_;
 }
 
+struct sockaddr_in HttpConn::GetAddr() const {
+    return PeerAddr_();
+}
+
 const char* HttpConn::GetIP() const {
-    return inet_ntoa(addr_.sin_addr);
+    return inet_ntoa(PeerAddr_().sin_addr);
 }
 
 int HttpConn::GetPort() const {
-    return addr_.sin_port;
+    return PeerAddr_().sin_port;
 }
 
-ssize_t HttpConn::read(int* saveErrno) {
+ssize_t HttpConn::read(int* saveErrno, size_t limit) {
     ssize_t len = -1;
+    size_t reads = readBuff_.ReadCount();
+    size_t overflows = readBuff_.OverflowCount();
     do {
         len = readBuff_.ReadFd(fd_, saveErrno);
         if (len <= 0) {
             break;
         }
-    } while (isET);
+        Metrics::Inc(Metrics::BYTES_READ, len);
+    } while (isET && readBuff_.ReadableBytes() < limit);
+    Metrics::Inc(Metrics::SOCKET_READS, readBuff_.ReadCount() - reads);
+    if(readBuff_.OverflowCount() > overflows) {
+        Metrics::Inc(Metrics::READ_OVERFLOWS, readBuff_.OverflowCount() - overflows);
+    }
+    // 什么都没读到（对端关闭或者假唤醒），不占着缓冲区
+    readBuff_.Release();
     return len;
 }
 
+bool HttpConn::StartLinger() {
+    if(!needLinger_ || lingering_) {
+        return false;
+    }
+    // 对端收到FIN就知道响应完了；关写端失败（对端已经重置）就直接关闭
+    if(shutdown(fd_, SHUT_WR) < 0) {
+        return false;
+    }
+    lingering_ = true;
+    lingerLeft_ = MAX_LINGER_BYTES;
+    LOG_DEBUG("Client[%d] lingering close", fd_);
+    return true;
+}
+
+bool HttpConn::Linger(int* saveErrno) {
+    assert(lingering_);
+    char buf[4096];
+    while(true) {
+        ssize_t len = ::read(fd_, buf, sizeof(buf));
+        if(len < 0) {
+            if(errno == EINTR) { continue; }
+            *saveErrno = errno;
+            return errno == EAGAIN;
+        }
+        if(len == 0 || !Linger(static_cast<size_t>(len))) {
+            return false;
+        }
+    }
+}
+
+bool HttpConn::Linger(size_t len) {
+    assert(lingering_);
+    if(len >= lingerLeft_) {
+        return false;
+    }
+    lingerLeft_ -= len;
+    return true;
+}
+
+void HttpConn::AppendRead(const char* data, size_t len) {
+    assert(data && len > 0);
+    readBuff_.Append(data, len);
+    Metrics::Inc(Metrics::BYTES_READ, len);
+    Metrics::Inc(Metrics::SOCKET_READS);
+}
+
 ssize_t HttpConn::write(int* saveErrno) {
     ssize_t len = -1;
     do {
-        // writev()，分散写
-        len = writev(fd_, iov_, iovCnt_);
+        if(iovLeft_ > 0) {
+            len = WriteIov_();
+        }
+        else if(fileLeft_ > 0) {
+            // 零拷贝发送正文，fileOffset_由内核往后移，部分发送后下次接着发
+            len = sendfile(fd_, fileFd_, &fileOffset_, fileLeft_);
+            if(len > 0) { fileLeft_ -= len; }
+        }
+        else { break; } /* 传输结束 */
         if(len <= 0) {
             *saveErrno = errno;
             break;
         }
-        if(iov_[0].iov_len + iov_[1].iov_len  == 0) { break; } /* 传输结束 */
-        else if(static_cast<size_t>(len) > iov_[0].iov_len) {
-            iov_[1].iov_base = (uint8_t*) iov_[1].iov_base + (len - iov_[0].iov_len);
-            iov_[1].iov_len -= (len - iov_[0].iov_len);
-            if(iov_[0].iov_len) {
-                writeBuff_.RetrieveAll();
-                iov_[0].iov_len = 0;
-            }
-        }
-        else {
-            iov_[0].iov_base = (uint8_t*)iov_[0].iov_base + len; 
-            iov_[0].iov_len -= len; 
-            writeBuff_.Retrieve(len);
-        }
+        Metrics::Inc(Metrics::BYTES_SENT, len);
     } while(isET || ToWriteBytes() > 10240);// 如果是ET模式就不断地写，一次把数据全部写出去
+    if(ToWriteBytes() == 0 && batchStart_) {
+        // 这一批的响应都发完了，每个请求按同一个延迟记录
+        Metrics::Observe(Metrics::REQUEST_LATENCY, Metrics::NowUs() - batchStart_, respCnt_);
+        batchStart_ = 0;
+    }
     return len;
 }
 
+ssize_t HttpConn::WriteIov_() {
+    ssize_t len = -1;
+    if(fileLeft_ > 0) {
+        // 后面还要sendfile正文，MSG_MORE让内核先攒着响应头，和正文拼成满的报文再发
+        struct msghdr msg = {};
+        msg.msg_iov = iov_ + iovIdx_;
+        msg.msg_iovlen = iovCnt_ - iovIdx_;
+        len = sendmsg(fd_, &msg, MSG_MORE);
+    } else {
+        // writev()，分散写
+        len = writev(fd_, iov_ + iovIdx_, iovCnt_ - iovIdx_);
+    }
+    if(len <= 0) {
+        return len;
+    }
+    // 跳过已经发完的iov，发了一部分的那个调整起始位置
+    iovLeft_ -= len;
+    size_t sent = len;
+    while(iovIdx_ < iovCnt_ && sent >= iov_[iovIdx_].iov_len) {
+        sent -= iov_[iovIdx_].iov_len;
+        iov_[iovIdx_].iov_len = 0;
+        iovIdx_++;
+    }
+    if(sent > 0) {
+        iov_[iovIdx_].iov_base = (uint8_t*)iov_[iovIdx_].iov_base + sent;
+        iov_[iovIdx_].iov_len -= sent;
+    }
+    if(iovLeft_ == 0) {
+        // 响应头都发完了，缓冲区还给块池
+        writeBuff_.Retrieve(writeBuff_.ReadableBytes());
+        writeBuff_.Release();
+    }
+    return len;
+}
+
+void HttpConn::AddIov_(const char* base, size_t len) {
+    if(len == 0) { return; }
+    // 和上一段在内存里连着（比如两个响应头之间没有正文）就合并成一个
+    if(iovCnt_ > 0 && (const char*)iov_[iovCnt_ - 1].iov_base + iov_[iovCnt_ - 1].iov_len == base) {
+        iov_[iovCnt_ - 1].iov_len += len;
+    } else {
+        assert(iovCnt_ < static_cast<int>(sizeof(iov_) / sizeof(iov_[0])));
+        iov_[iovCnt_].iov_base = const_cast<char*>(base);
+        iov_[iovCnt_].iov_len = len;
+        iovCnt_++;
+    }
+    iovLeft_ += len;
+}
+
+void HttpConn::ReleaseResponses_() {
+    for(int i = 0; i < respCnt_; i++) {
+        responses_[i]->UnmapFile();
+    }
+    respCnt_ = 0;
+}
+
 bool HttpConn::process() {
-    // request初始化
-    request_.Init();
+    if(verify_) {
+        // 还在等数据库就什么都不做；验证完了就接着处理挂起的这一批
+        return SqlPending() ? false : ProcessBatch_();
+    }
     // 判断有没有数据可读，没有就返回false不用处理
     if(readBuff_.ReadableBytes() <= 0) {
         return false;
     }
-    // 解析数据
-    else if(request_.parse(readBuff_)) {
-        LOG_DEBUG("%s", request_.path().c_str());
-        // 如果解析成功了就初始化一下响应，将数据都初始化进去，状态码200表示成功了
-        response_.Init(srcDir, request_.path(), request_.IsKeepAlive(), 200);
-    } else {
-        response_.Init(srcDir, request_.path(), false, 400);
-    }
-    // 生成响应信息
-    response_.MakeResponse(writeBuff_);
-    // 响应头在buffer里，响应正文在内存里，在两个不同的地方，要分散写
+    // 上一批响应已经发完了，释放它们的文件
+    ReleaseResponses_();
+    writeBuff_.Retrieve(writeBuff_.ReadableBytes());
+    iovCnt_ = iovIdx_ = 0;
+    iovLeft_ = 0;
+    fileFd_ = -1;
+    fileOffset_ = 0;
+    fileLeft_ = 0;
+    batchStart_ = Metrics::NowUs();
+    return ProcessBatch_();
+}
 
-    /* 响应头 */
-    iov_[0].iov_base = const_cast<char*>(writeBuff_.Peek());
-    iov_[0].iov_len = writeBuff_.ReadableBytes();
-    iovCnt_ = 1;
+bool HttpConn::ResumeSql(uint32_t events) {
+    assert(SqlPending());
+    return verify_->Continue(events);
+}
 
-    /* 响应正文 */
-    if(response_.FileLen() > 0  && response_.File()) {
-        iov_[1].iov_base = response_.File();
-        iov_[1].iov_len = response_.FileLen();
-        iovCnt_ = 2;
+bool HttpConn::ProcessBatch_() {
+    /* 把缓冲区里完整的请求都解析出来，响应头按顺序追加到writeBuff_里 */
+    while(respCnt_ < MAX_PIPELINE) {
+        HttpRequest::HTTP_CODE ret = HttpRequest::GET_REQUEST;
+        int code = 200;
+        if(verify_) {
+            // 挂起的请求验证完了，接着生成它的响应；后端忙时回503，不当成密码错误
+            request_.FinishVerify(verify_->Result());
+            if(verify_->Unavailable()) { code = 503; }
+            verify_.reset();
+        } else {
+            if(readBuff_.ReadableBytes() == 0) { break; }
+            // 解析数据
+            ret = request_.parse(readBuff_);
+            if(ret == HttpRequest::NO_REQUEST) {
+                // 请求还没收完整，继续读
+                break;
+            }
+            if(ret == HttpRequest::GET_REQUEST && request_.NeedVerify()) {
+                verify_.reset(userStore->NewVerify(request_.GetPost("username"), request_.GetPost("password"), request_.IsLogin()));
+                if(!verify_->Start()) {
+                    LOG_DEBUG("Client[%d] wait sql fd:%d", fd_, verify_->Fd());
+                    return false;
+                }
+                continue;
+            }
+        }
+        if(respCnt_ == static_cast<int>(responses_.size())) {
+            responses_.emplace_back(new HttpResponse());
+        }
+        HttpResponse& response = *responses_[respCnt_];
+        if(ret == HttpRequest::GET_REQUEST) {
+            LOG_DEBUG("%s", request_.path().c_str());
+            // 如果解析成功了就初始化一下响应，将数据都初始化进去，状态码200表示成功了
+            response.Init(srcDir, request_.path(), request_.IsKeepAlive(), code);
+            response.SetAcceptEncoding(HttpResponse::ParseAcceptEncoding(request_.GetHeader("Accept-Encoding")));
+            if(request_.method() == "GET") {
+                response.SetRange(request_.GetHeader("Range"), request_.GetHeader("If-Range"));
+                response.SetConditional(request_.GetHeader("If-None-Match"), request_.GetHeader("If-Modified-Since"));
+            }
+            if(metricsPath && request_.path() == metricsPath) {
+                response.SetBody(Metrics::Instance()->Render(), METRICS_TYPE);
+            }
+        } else {
+            response.Init(srcDir, request_.path(), false, ret == HttpRequest::TOO_LARGE_REQUEST ? 413 : 400);
+            needLinger_ = true;
+        }
+        // 生成响应信息
+        size_t before = writeBuff_.ReadableBytes();
+        response.MakeResponse(writeBuff_);
+        headerLen_[respCnt_++] = writeBuff_.ReadableBytes() - before;
+        Metrics::Status(response.Code());
+        keepAlive_ = response.IsKeepAlive();
+        // 不保持连接的话后面的请求不用处理了；sendfile发送的正文不能和后面的响应一起writev，等这一批发完再处理
+        // 多个区间的206占的iov多，也放在一批的最后
+        if(!keepAlive_ || (response.FileLen() > 0 && response.FileFd() >= 0) || response.IsMultipart()) {
+            break;
+        }
+    }
+    // 请求都解析完了，读缓冲区还给块池，空闲的连接不占内存
+    readBuff_.Release();
+    if(respCnt_ == 0) {
+        batchStart_ = 0;
+        return false;
+    }
+
+    // 响应头在buffer里，响应正文在内存里，在不同的地方，要分散写
+    // writeBuff_不会再扩容了，这时候再取地址
+    const char* header = writeBuff_.Peek();
+    for(int i = 0; i < respCnt_; i++) {
+        HttpResponse& response = *responses_[i];
+        /* 响应头 */
+        AddIov_(header, headerLen_[i]);
+        header += headerLen_[i];
+        /* 响应正文 */
+        if(response.FileLen() > 0 && response.FileFd() >= 0) {
+            // 大文件、区间请求的正文不进iov，响应头发完后用sendfile从偏移处发送
+            fileFd_ = response.FileFd();
+            fileOffset_ = response.FileOffset();
+            fileLeft_ = response.FileLen();
+        }
+        else {
+            // 在内存里的正文（多个区间时和段头交错）直接进iov
+            struct iovec body[HttpResponse::MAX_BODY_IOV];
+            int cnt = response.BodyIov(body);
+            for(int j = 0; j < cnt; j++) {
+                AddIov_(static_cast<const char*>(body[j].iov_base), body[j].iov_len);
+            }
+        }
     }
-    LOG_DEBUG("filesize:%d, %d  to %d", response_.FileLen() , iovCnt_, ToWriteBytes());
+    LOG_DEBUG("responses:%d, iov:%d, to %d", respCnt_, iovCnt_, ToWriteBytes());
     return true;
 }
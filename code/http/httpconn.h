@@ -3,13 +3,21 @@
 
 #include <sys/types.h>
 #include <sys/uio.h>     // readv/writev
+#include <sys/socket.h>  // sendmsg
+#include <sys/sendfile.h>   // sendfile
 #include <arpa/inet.h>   // sockaddr_in
 #include <stdlib.h>      // atoi()
 #include <errno.h>      
+#include <stdint.h>     // SIZE_MAX
+#include <vector>
+#include <memory>
 
 #include "../log/log.h"
 #include "../pool/sqlconnRAII.h"
+#include "../pool/userstore.h"
 #include "../buffer/buffer.h"
+#include "../timer/timingwheel.h"
+#include "../metrics/metrics.h"
 #include "httprequest.h"
 #include "httpresponse.h"
 
@@ -21,7 +29,12 @@ public:
 
     void init(int sockFd, const sockaddr_in& addr);
 
-    ssize_t read(int* saveErrno);
+    // ET模式下读到EAGAIN为止；读缓冲区攒到limit就先停，调用方要暂停监听EPOLLIN，恢复时重新注册才会再通知
+    ssize_t read(int* saveErrno, size_t limit = SIZE_MAX);
+
+    void AppendRead(const char* data, size_t len);   // 完成模式下内核已经收好的数据（io_uring的multishot recv）
+
+    size_t ReadBytes() const { return readBuff_.ReadableBytes(); }  // 读缓冲区里还没处理的字节数
 
     ssize_t write(int* saveErrno);
 
@@ -29,41 +42,95 @@ public:
 
     int GetFd() const;
 
+    bool IsClose() const { return isClose_; }   // 关闭之后GetFd()是-1
+
     int GetPort() const;
 
     const char* GetIP() const;
     
     sockaddr_in GetAddr() const;
     
+    /* 返回true表示有响应要写；返回false且SqlPending()时，这一批挂起在等数据库，
+       要把SqlFd()按SqlEvents()注册到poller里，就绪后调用ResumeSql */
     bool process();
 
+    /* 数据库socket就绪，返回true表示验证完了：把SqlFd()从poller里删掉，再调用process接着处理挂起的这一批
+       返回false表示还要按SqlEvents()接着等 */
+    bool ResumeSql(uint32_t events);
+
+    bool SqlPending() const { return verify_ && !verify_->Done(); }
+
+    int SqlFd() const { return verify_->Fd(); }
+
+    uint32_t SqlEvents() const { return verify_->WaitEvents(); }
+
     int ToWriteBytes() { 
-        return iov_[0].iov_len + iov_[1].iov_len; 
+        return iovLeft_ + fileLeft_; 
     }
 
     bool IsKeepAlive() const {
-        return request_.IsKeepAlive();
+        return keepAlive_;  // 这一批最后一个响应是否保持连接
     }
 
+    /* 延迟关闭：400/413没读完请求就回了响应，对端可能还在发请求体，这时直接close，
+       接收缓冲区里没读的数据会让内核发RST，客户端可能还没读到响应就被重置了。
+       响应发完后调用StartLinger，返回true时关掉写端，之后读事件交给Linger把数据读掉扔了，
+       Linger返回false（对端关闭、出错、读够了MAX_LINGER_BYTES）时再关闭；返回false时直接关闭 */
+    bool StartLinger();
+
+    bool Linger(int* saveErrno);    // 返回true表示还要接着等
+
+    bool Linger(size_t len);        // 完成模式下内核已经收好的len字节
+
+    bool IsLingering() const { return lingering_; }
+
+    WheelNode* TimerNode() { return &timerNode_; }  // 超时定时器的节点，嵌在连接里
+
     static bool isET;
     static const char* srcDir;  // 资源的目录
     static std::atomic<int> userCount;  // 当前总共的客户端连接数
+    static const char* metricsPath;     // 返回运行指标的路径，nullptr表示不开放
+    static UserStore* userStore;        // 登录/注册查的用户存储
     
+    static const int MAX_PIPELINE = 16;     // 一次最多处理的流水线请求个数
+    static const size_t MAX_LINGER_BYTES = 1 << 20;    // 延迟关闭时最多读掉这么多，超过就直接关
+
 private:
+    bool ProcessBatch_();
+    ssize_t WriteIov_();
+    void AddIov_(const char* base, size_t len);
+    void ReleaseResponses_();
+    const sockaddr_in& PeerAddr_() const;
    
     int fd_;
-    struct  sockaddr_in addr_;
+    mutable struct  sockaddr_in addr_;    // multishot accept不带对端地址，用到时再getpeername
 
-    bool isClose_;
+    std::atomic<bool> isClose_;     // 线程池模式下工作线程关闭，主线程的定时器检查
+    WheelNode timerNode_;
     
+    /* 一批响应的响应头和正文按顺序放在iov_里，一次writev发出去 */
     int iovCnt_;
-    struct iovec iov_[2];
+    int iovIdx_;        // 第一个还没发完的iov
+    size_t iovLeft_;    // iov里还没发送的字节数
+    struct iovec iov_[2 * MAX_PIPELINE + HttpResponse::MAX_BODY_IOV];  // 多个区间的206在一批的最后
+
+    int fileFd_;        // sendfile发送的正文，只能是一批里的最后一个响应
+    off_t fileOffset_;  // sendfile发送正文时的偏移，内核每次发送后往后移
+    size_t fileLeft_;   // sendfile还没发送的正文字节数
+    bool keepAlive_;
+    bool needLinger_;       // 这一批有没读完请求就回的错误响应
+    bool lingering_;        // 已经关了写端，在读掉对端剩下的数据
+    size_t lingerLeft_;     // 延迟关闭还能读掉的字节数
+    uint64_t batchStart_;   // 这一批请求解析的时间（微秒），响应全部发完时记录延迟
     
     Buffer readBuff_; // 读（请求）缓冲区，保存请求数据的内容
     Buffer writeBuff_; // 写（响应）缓冲区，保存响应的数据的内容
 
     HttpRequest request_;
-    HttpResponse response_;
+    std::vector<std::unique_ptr<HttpResponse>> responses_;  // 流水线请求的响应，按需创建，之后一直复用
+    int respCnt_;       // 这一批用到的响应个数
+    size_t headerLen_[MAX_PIPELINE];    // 每个响应的响应头在writeBuff_里的长度
+    std::unique_ptr<UserVerify> verify_;     // 正在验证用户的请求，挂起时这一批停在它这里
 };
 
 
@@ -8,66 +8,155 @@ const unordered_set<string> HttpRequest::DEFAULT_HTML{
 const unordered_map<string, int> HttpRequest::DEFAULT_HTML_TAG {
             {"/register.html", 0}, {"/login.html", 1},  };
 
+size_t HttpRequest::maxBodySize = 1 << 20;
+BodyHandler* HttpRequest::bodyHandler = nullptr;
+
 void HttpRequest::Init() {
     method_ = path_ = version_ = body_ = "";
     state_ = REQUEST_LINE;      // 状态刚开始设为解析请求首行
-    header_.clear();
+    scanned_ = 0;
+    contentLen_ = 0;
+    bodyLeft_ = 0;
+    bodyLen_ = 0;
+    chunked_ = false;
+    sink_.reset();
+    headerCnt_ = 0;
     post_.clear();
+    needVerify_ = false;
+    isLogin_ = false;
 }
 
-bool HttpRequest::IsKeepAlive() const {
-    if(header_.count("Connection") == 1) {
-        return header_.find("Connection")->second == "keep-alive" && version_ == "1.1";
+// 逗号分隔的头部值里有没有这一项（不区分大小写，忽略两边的空格）
+static bool HasToken(const string& value, const char* token) {
+    size_t len = strlen(token);
+    size_t pos = 0;
+    while(pos < value.size()) {
+        size_t end = value.find(',', pos);
+        if(end == string::npos) { end = value.size(); }
+        size_t b = pos, e = end;
+        while(b < e && (value[b] == ' ' || value[b] == '\t')) { b++; }
+        while(e > b && (value[e - 1] == ' ' || value[e - 1] == '\t')) { e--; }
+        if(e - b == len && strncasecmp(value.data() + b, token, len) == 0) { return true; }
+        pos = end + 1;
     }
     return false;
 }
 
-bool HttpRequest::parse(Buffer& buff) {
-    // \r\n是回车换行，http请求报文里面根据回车换行来确定数据什么时候变成什么数据的
-    // 每次解析一行，根据\r\n判断到哪是一行
-    const char CRLF[] = "\r\n";
-    // 判断可读字节数
-    if(buff.ReadableBytes() <= 0) {
-        return false;
+// HTTP/1.1默认保持连接，除非带了Connection: close；HTTP/1.0要显式带Connection: keep-alive
+bool HttpRequest::IsKeepAlive() const {
+    const string& conn = GetHeader("Connection");
+    if(version_ == "1.1") {
+        return !HasToken(conn, "close");
+    }
+    return version_ == "1.0" && HasToken(conn, "keep-alive");
+}
+
+HttpRequest::HTTP_CODE HttpRequest::parse(Buffer& buff) {
+    // 上一个请求已经解析完了，开始解析新的请求
+    if(state_ == FINISH) {
+        Init();
     }
     // 是一个有限状态机，默认状态是REQUEST_LINE,一开始解析请求首行，结束状态为FINISH
-    while(buff.ReadableBytes() && state_ != FINISH) {
-        // 获取一行数据，根据\r\n为结束标志
-        // 查search()函数
-        // lineEnd是以\r\n结束的位置，或者可以说是索引
-        const char* lineEnd = search(buff.Peek(), buff.BeginWriteConst(), CRLF, CRLF + 2);
-        // 从开始到一行结束中间的字符封装到字符串line上
-        std::string line(buff.Peek(), lineEnd);
-        switch(state_)  // 判断状态
-        {
-        case REQUEST_LINE:
-            // 解析请求行，解析完之后状态会变为解析请求头
-            if(!ParseRequestLine_(line)) {
-                return false;
+    // 每次解析一行，直接在buff里找'\n'，不拷贝成string
+    while(state_ != FINISH) {
+        const char* begin = buff.Peek();
+        size_t readable = buff.ReadableBytes();
+        if(state_ == BODY || state_ == CHUNK_DATA) {
+            // 请求体到了多少就消费多少，读缓冲区不用装下整个请求体
+            if(readable == 0) {
+                return NO_REQUEST;
             }
-            // 解析成功了就继续解析路径资源
-            ParsePath_();
-            break;    
-        case HEADERS:
-            ParseHeader_(line); // 解析请求头
-            // 可读的字节数<=2的话就只能说明状态已经变为结束了 
-            if(buff.ReadableBytes() <= 2) {
+            size_t len = min(readable, bodyLeft_);
+            HTTP_CODE ret = AppendBody_(begin, len);
+            if(ret != NO_REQUEST) {
                 state_ = FINISH;
+                headerCnt_ = 0;
+                return ret;
             }
-            break;
-        case BODY:
-            ParseBody_(line);   // 解析请求体
-            break;
-        default:
-            break;
+            buff.Retrieve(len);
+            bodyLeft_ -= len;
+            if(bodyLeft_ == 0) {
+                if(state_ == CHUNK_DATA) {
+                    state_ = CHUNK_DATA_END;
+                } else if(!FinishBody_()) {
+                    headerCnt_ = 0;
+                    return BAD_REQUEST;
+                }
+            }
+            continue;
+        }
+        const char* lineEnd = static_cast<const char*>(memchr(begin + scanned_, '\n', readable - scanned_));
+        if(!lineEnd) {
+            // 这一行还没收完，记下找过的位置
+            scanned_ = readable;
+            if(readable > MAX_LINE) {
+                LOG_ERROR("Line too long");
+                state_ = FINISH;
+                headerCnt_ = 0;
+                return BAD_REQUEST;
+            }
+            return NO_REQUEST;
+        }
+        scanned_ = 0;
+        const char* next = lineEnd + 1;
+        // 行尾的\r\n，也兼容只有\n的
+        if(lineEnd > begin && *(lineEnd - 1) == '\r') { lineEnd--; }
+
+        bool ok = static_cast<size_t>(lineEnd - begin) <= MAX_LINE;
+        HTTP_CODE err = BAD_REQUEST;
+        if(ok) {
+            switch(state_)  // 判断状态
+            {
+            case REQUEST_LINE:
+                // 请求首行之前的空行忽略掉
+                if(begin == lineEnd) { break; }
+                // 解析请求行，解析完之后状态会变为解析请求头
+                ok = ParseRequestLine_(begin, lineEnd);
+                // 解析成功了就继续解析路径资源
+                if(ok) { ParsePath_(); }
+                break;
+            case HEADERS:
+                if(begin == lineEnd) {
+                    // 空行，请求头结束了，有请求体就去解析请求体
+                    err = StartBody_();
+                    ok = err == NO_REQUEST;
+                } else {
+                    ok = ParseHeader_(begin, lineEnd);
+                }
+                break;
+            case CHUNK_SIZE:
+                ok = ParseChunkSize_(begin, lineEnd);
+                // bodyLen_不会超过maxBodySize，这样比不会溢出
+                if(ok && bodyLeft_ > maxBodySize - bodyLen_) {
+                    LOG_ERROR("Body too large");
+                    ok = false;
+                    err = TOO_LARGE_REQUEST;
+                }
+                break;
+            case CHUNK_DATA_END:
+                // 块数据后面必须紧跟着\r\n
+                ok = begin == lineEnd;
+                state_ = CHUNK_SIZE;
+                break;
+            case CHUNK_TRAILER:
+                // trailer里的字段和请求头放在一起（个数一起受MAX_HEADERS限制），空行表示请求体结束
+                ok = begin == lineEnd ? FinishBody_() : ParseHeader_(begin, lineEnd);
+                break;
+            default:
+                break;
+            }
+        }
+        if(!ok) {
+            // 出错的请求不再保持连接
+            state_ = FINISH;
+            headerCnt_ = 0;
+            return err;
         }
-        // lineEnd等于写指针的位置的时候，说明解析结束了，就跳出while循环
-        if(lineEnd == buff.BeginWrite()) { break; }
         // 解析了一行数据之后把读指针往后移
-        buff.RetrieveUntil(lineEnd + 2);
+        buff.RetrieveUntil(next);
     }
     LOG_DEBUG("[%s], [%s], [%s]", method_.c_str(), path_.c_str(), version_.c_str());
-    return true;
+    return GET_REQUEST;
 }
 
 void HttpRequest::ParsePath_() {
@@ -84,39 +173,149 @@ void HttpRequest::ParsePath_() {
     }
 }
 
-bool HttpRequest::ParseRequestLine_(const string& line) {
+bool HttpRequest::ParseRequestLine_(const char* begin, const char* end) {
     // GET / HTTP/1.1
-    regex patten("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$"); // 正则
-    smatch subMatch;
-    if(regex_match(line, subMatch, patten)) {   // 解析成功
-        method_ = subMatch[1];
-        path_ = subMatch[2];
-        version_ = subMatch[3];
-        state_ = HEADERS;   // 解析完就改变状态去解析请求头
-        return true;
+    const char* sp1 = static_cast<const char*>(memchr(begin, ' ', end - begin));
+    if(sp1 && sp1 != begin) {
+        const char* sp2 = static_cast<const char*>(memchr(sp1 + 1, ' ', end - sp1 - 1));
+        // 版本号部分必须是HTTP/开头，并且不能再有空格
+        if(sp2 && sp2 != sp1 + 1 && end - sp2 > 6 && memcmp(sp2 + 1, "HTTP/", 5) == 0
+            && !memchr(sp2 + 6, ' ', end - sp2 - 6)) {
+            method_.assign(begin, sp1);
+            path_.assign(sp1 + 1, sp2);
+            version_.assign(sp2 + 6, end);
+            state_ = HEADERS;   // 解析完就改变状态去解析请求头
+            return true;
+        }
     }
     LOG_ERROR("RequestLine Error");
     return false;
 }
 
-void HttpRequest::ParseHeader_(const string& line) {
+bool HttpRequest::ParseHeader_(const char* begin, const char* end) {
     // Connection: keep-alive
-    regex patten("^([^:]*): ?(.*)$");   // 正则，前面是键后面是值
-    smatch subMatch;
-    if(regex_match(line, subMatch, patten)) {
-        header_[subMatch[1]] = subMatch[2];
+    const char* colon = static_cast<const char*>(memchr(begin, ':', end - begin));
+    if(!colon || colon == begin || headerCnt_ >= MAX_HEADERS) {
+        LOG_ERROR("Header Error");
+        return false;
     }
-    else {
-        // 当解析到回车换行的时候不匹配，就改变状态该解析请求体了 
-        state_ = BODY;
+    // 键里不能有空白
+    for(const char* p = begin; p < colon; p++) {
+        if(*p == ' ' || *p == '\t') {
+            LOG_ERROR("Header Error");
+            return false;
+        }
+    }
+    // 去掉值前后的空白
+    const char* val = colon + 1;
+    while(val < end && (*val == ' ' || *val == '\t')) { val++; }
+    while(end > val && (*(end - 1) == ' ' || *(end - 1) == '\t')) { end--; }
+
+    if(headerCnt_ == header_.size()) {
+        header_.emplace_back();
     }
+    Header& header = header_[headerCnt_++];
+    header.key.assign(begin, colon);
+    header.value.assign(val, end);
+
+    return true;
 }
 
-void HttpRequest::ParseBody_(const string& line) {
-    body_ = line;
-    ParsePost_();
+HttpRequest::HTTP_CODE HttpRequest::StartBody_() {
+    const string& te = GetHeader("Transfer-Encoding");
+    const string& cl = GetHeader("Content-Length");
+    if(!te.empty()) {
+        // chunked必须是最后一个编码，否则没法知道请求体在哪结束；和Content-Length同时出现也不接受（请求走私）
+        size_t len = te.size();
+        if(len < 7 || strcasecmp(te.c_str() + len - 7, "chunked") != 0 ||
+           (len > 7 && te[len - 8] != ' ' && te[len - 8] != ',') || !cl.empty()) {
+            LOG_ERROR("Transfer-Encoding Error");
+            return BAD_REQUEST;
+        }
+        chunked_ = true;
+        state_ = CHUNK_SIZE;
+        return NO_REQUEST;
+    }
+    if(!cl.empty()) {
+        size_t len = 0;
+        for(char ch: cl) {
+            if(ch < '0' || ch > '9') {
+                LOG_ERROR("Content-Length Error");
+                return BAD_REQUEST;
+            }
+            // 超过上限就不用再往下算了，也避免溢出
+            len = len * 10 + (ch - '0');
+            if(len > maxBodySize) {
+                LOG_ERROR("Body too large");
+                return TOO_LARGE_REQUEST;
+            }
+        }
+        contentLen_ = len;
+    }
+    if(contentLen_ == 0) {
+        state_ = FINISH;
+        ParsePost_();
+        return NO_REQUEST;
+    }
+    // 长度事先知道，大的直接交给bodyHandler，小的一次分配好
+    if(contentLen_ > MAX_BUFFERED_BODY && bodyHandler) {
+        sink_.reset(bodyHandler->NewSink(*this));
+    }
+    if(!sink_) { body_.reserve(contentLen_); }
+    bodyLeft_ = contentLen_;
+    state_ = BODY;
+    return NO_REQUEST;
+}
+
+// 块大小是十六进制，后面可能跟着;扩展，忽略扩展；大到溢出的按SIZE_MAX算，由调用方回413
+bool HttpRequest::ParseChunkSize_(const char* begin, const char* end) {
+    size_t size = 0;
+    const char* p = begin;
+    for(; p < end && isxdigit(static_cast<unsigned char>(*p)); p++) {
+        if(size > (SIZE_MAX >> 4)) {
+            size = SIZE_MAX;
+            continue;
+        }
+        size = size * 16 + (isdigit(static_cast<unsigned char>(*p)) ? *p - '0' : (*p | 0x20) - 'a' + 10);
+    }
+    while(p < end && (*p == ' ' || *p == '\t')) { p++; }
+    if(p == begin || (p < end && *p != ';')) {
+        LOG_ERROR("Chunk size Error");
+        return false;
+    }
+    bodyLeft_ = size;
+    state_ = size > 0 ? CHUNK_DATA : CHUNK_TRAILER;
+    return true;
+}
+
+HttpRequest::HTTP_CODE HttpRequest::AppendBody_(const char* data, size_t len) {
+    // chunked事先不知道总长度，攒的超过MAX_BUFFERED_BODY了再问bodyHandler，已经攒下的先交给它
+    if(!sink_ && chunked_ && bodyHandler && body_.size() + len > MAX_BUFFERED_BODY) {
+        sink_.reset(bodyHandler->NewSink(*this));
+        if(sink_ && !body_.empty()) {
+            if(!sink_->Write(body_.data(), body_.size())) { return BAD_REQUEST; }
+            body_.clear();
+        }
+    }
+    bodyLen_ += len;
+    if(sink_) {
+        return sink_->Write(data, len) ? NO_REQUEST : BAD_REQUEST;
+    }
+    body_.append(data, len);
+    return NO_REQUEST;
+}
+
+bool HttpRequest::FinishBody_() {
     state_ = FINISH;
-    LOG_DEBUG("Body:%s, len:%d", line.c_str(), line.size());
+    if(sink_) {
+        bool ok = sink_->Finish();
+        sink_.reset();
+        return ok;
+    }
+    ParsePost_();
+    // 表单里有密码，只记长度
+    LOG_DEBUG("Body len:%zu", body_.size());
+    return true;
 }
 
 int HttpRequest::ConverHex(char ch) {
@@ -126,19 +325,14 @@ int HttpRequest::ConverHex(char ch) {
 }
 
 void HttpRequest::ParsePost_() {
-    if(method_ == "POST" && header_["Content-Type"] == "application/x-www-form-urlencoded") {
+    if(method_ == "POST" && GetHeader("Content-Type") == "application/x-www-form-urlencoded") {
         ParseFromUrlencoded_();
         if(DEFAULT_HTML_TAG.count(path_)) {
             int tag = DEFAULT_HTML_TAG.find(path_)->second;
             LOG_DEBUG("Tag:%d", tag);
             if(tag == 0 || tag == 1) {
-                bool isLogin = (tag == 1);
-                if(UserVerify(post_["username"], post_["password"], isLogin)) {
-                    path_ = "/welcome.html";
-                } 
-                else {
-                    path_ = "/error.html";
-                }
+                needVerify_ = true;
+                isLogin_ = (tag == 1);
             }
         }
     }   
@@ -173,7 +367,7 @@ void HttpRequest::ParseFromUrlencoded_() {
             value = body_.substr(j, i - j);
             j = i + 1;
             post_[key] = value;
-            LOG_DEBUG("%s = %s", key.c_str(), value.c_str());
+            LOG_DEBUG("post key: %s", key.c_str());
             break;
         default:
             break;
@@ -186,65 +380,10 @@ void HttpRequest::ParseFromUrlencoded_() {
     }
 }
 
-bool HttpRequest::UserVerify(const string &name, const string &pwd, bool isLogin) {
-    if(name == "" || pwd == "") { return false; }
-    LOG_INFO("Verify name:%s pwd:%s", name.c_str(), pwd.c_str());
-    MYSQL* sql;
-    SqlConnRAII(&sql,  SqlConnPool::Instance());
-    assert(sql);
-    
-    bool flag = false;
-    unsigned int j = 0;
-    char order[256] = { 0 };
-    MYSQL_FIELD *fields = nullptr;
-    MYSQL_RES *res = nullptr;
-    
-    if(!isLogin) { flag = true; }
-    /* 查询用户及密码 */
-    snprintf(order, 256, "SELECT username, password FROM user WHERE username='%s' LIMIT 1", name.c_str());
-    LOG_DEBUG("%s", order);
-
-    if(mysql_query(sql, order)) { 
-        mysql_free_result(res);
-        return false; 
-    }
-    res = mysql_store_result(sql);
-    j = mysql_num_fields(res);
-    fields = mysql_fetch_fields(res);
-
-    while(MYSQL_ROW row = mysql_fetch_row(res)) {
-        LOG_DEBUG("MYSQL ROW: %s %s", row[0], row[1]);
-        string password(row[1]);
-        /* 注册行为 且 用户名未被使用*/
-        if(isLogin) {
-            if(pwd == password) { flag = true; }
-            else {
-                flag = false;
-                LOG_DEBUG("pwd error!");
-            }
-        } 
-        else { 
-            flag = false; 
-            LOG_DEBUG("user used!");
-        }
-    }
-    mysql_free_result(res);
-
-    /* 注册行为 且 用户名未被使用*/
-    if(!isLogin && flag == true) {
-        LOG_DEBUG("regirster!");
-        bzero(order, 256);
-        snprintf(order, 256,"INSERT INTO user(username, password) VALUES('%s','%s')", name.c_str(), pwd.c_str());
-        LOG_DEBUG( "%s", order);
-        if(mysql_query(sql, order)) { 
-            LOG_DEBUG( "Insert error!");
-            flag = false; 
-        }
-        flag = true;
-    }
-    SqlConnPool::Instance()->FreeConn(sql);
-    LOG_DEBUG( "UserVerify success!!");
-    return flag;
+void HttpRequest::FinishVerify(bool ok) {
+    assert(needVerify_);
+    needVerify_ = false;
+    path_ = ok ? "/welcome.html" : "/error.html";
 }
 
 std::string HttpRequest::path() const{
@@ -262,6 +401,16 @@ std::string HttpRequest::version() const {
     return version_;
 }
 
+const std::string& HttpRequest::GetHeader(const char* key) const {
+    static const std::string empty;
+    for(size_t i = 0; i < headerCnt_; i++) {
+        if(strcasecmp(header_[i].key.c_str(), key) == 0) {
+            return header_[i].value;
+        }
+    }
+    return empty;
+}
+
 std::string HttpRequest::GetPost(const std::string& key) const {
     assert(key != "");
     if(post_.count(key) == 1) {
@@ -4,21 +4,31 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <string>
-#include <regex>
+#include <vector>
+#include <memory>
+#include <algorithm>
 #include <errno.h>     
+#include <stdint.h>    // SIZE_MAX
+#include <ctype.h>     // isxdigit
+#include <strings.h>   // strcasecmp
 #include <mysql/mysql.h>  //mysql
 
 #include "../buffer/buffer.h"
 #include "../log/log.h"
 #include "../pool/sqlconnpool.h"
 #include "../pool/sqlconnRAII.h"
+#include "bodyhandler.h"
 
 class HttpRequest {
 public:
     enum PARSE_STATE {
         REQUEST_LINE,   // 正在解析请求首行
         HEADERS,        // 请求头
-        BODY,           // 请求体
+        BODY,           // 请求体（Content-Length）
+        CHUNK_SIZE,     // chunked：块大小那一行
+        CHUNK_DATA,     // 块的数据
+        CHUNK_DATA_END, // 块数据后面的\r\n
+        CHUNK_TRAILER,  // 最后一块之后的trailer，空行结束
         FINISH,        // 解析完成
     };
 
@@ -31,13 +41,17 @@ public:
         FILE_REQUEST,       // 请求一个文件
         INTERNAL_ERROR,     // 内部错误
         CLOSED_CONNECTION,  // 连接关闭
+        TOO_LARGE_REQUEST,  // 请求体超过maxBodySize
     };
     
     HttpRequest() { Init(); }
     ~HttpRequest() = default;
 
     void Init();
-    bool parse(Buffer& buff);
+    /* 增量解析，请求不完整时返回NO_REQUEST，剩下的数据留在buff里，下次读到更多数据后接着解析
+       请求体按Content-Length或者chunked分帧，到多少消费多少，不用等整个请求体都在buff里
+       解析完一个请求返回GET_REQUEST，出错返回BAD_REQUEST，请求体太大返回TOO_LARGE_REQUEST */
+    HTTP_CODE parse(Buffer& buff);
 
     std::string path() const;   // 获取path
     std::string& path();
@@ -45,8 +59,21 @@ public:
     std::string version() const;    // 获取version
     std::string GetPost(const std::string& key) const;  
     std::string GetPost(const char* key) const;
+    const std::string& GetHeader(const char* key) const;   // 请求头的键不区分大小写，没有时返回空串
+    size_t HeaderCount() const { return headerCnt_; }      // 请求头（连同chunked的trailer）的个数
 
     bool IsKeepAlive() const;   // 是否保持Alive
+    const std::string& body() const { return body_; }  // 交给BodySink的请求体不在这里
+    size_t BodyLen() const { return bodyLen_; }         // 收到的请求体的长度（chunked解码后的）
+
+    static size_t maxBodySize;          // 请求体的最大长度，WebServer设置
+    static BodyHandler* bodyHandler;    // 大的请求体交给谁，nullptr表示都放进body_
+    static const size_t MAX_BUFFERED_BODY = 64 * 1024;  // 超过这么大的请求体才问bodyHandler要不要
+
+    /* 登录/注册请求解析完后不在这里查数据库，由HttpConn用SqlVerify去验证，结果交回FinishVerify */
+    bool NeedVerify() const { return needVerify_; }
+    bool IsLogin() const { return isLogin_; }
+    void FinishVerify(bool ok);     // 根据验证结果决定返回的页面
 
     /* 
     todo 
@@ -55,24 +82,42 @@ public:
     */
 
 private:
-    bool ParseRequestLine_(const std::string& line);    // 解析请求首行
-    void ParseHeader_(const std::string& line);     // 解析请求头
-    void ParseBody_(const std::string& line);       // 解析请求体
+    bool ParseRequestLine_(const char* begin, const char* end);    // 解析请求首行
+    bool ParseHeader_(const char* begin, const char* end);     // 解析请求头
+    HTTP_CODE StartBody_();     // 请求头结束，按Transfer-Encoding/Content-Length决定请求体怎么分帧
+    bool ParseChunkSize_(const char* begin, const char* end);
+    HTTP_CODE AppendBody_(const char* data, size_t len);  // 收到一段请求体，放进body_或者交给sink_
+    bool FinishBody_();
 
     void ParsePath_();      // 解析请求路径
     void ParsePost_();      // 解析post请求 
     void ParseFromUrlencoded_();    // 解析表单数据
-    // 验证用户登录
-    static bool UserVerify(const std::string& name, const std::string& pwd, bool isLogin);
+
+    struct Header {
+        std::string key;
+        std::string value;
+    };
 
     PARSE_STATE state_;     // 解析的状态
+    size_t scanned_;        // 当前行已经找过'\n'的字节数，数据分几次到达时不用从头再找
+    size_t contentLen_;     // Content-Length
+    size_t bodyLeft_;       // 当前这段（整个请求体或者一个块）还差多少字节
+    size_t bodyLen_;        // 已经收到的请求体长度
+    bool chunked_;          // Transfer-Encoding: chunked
+    std::unique_ptr<BodySink> sink_;    // 请求体交给它时不放进body_
     std::string method_, path_, version_, body_;    // 请求方法，请求路径，协议版本，请求体（都是HTTP报文的格式）
-    std::unordered_map<std::string, std::string> header_;   // 请求头
+    std::vector<Header> header_;    // 请求头，Init时只清计数，string的空间留给下一个请求复用
+    size_t headerCnt_;
     std::unordered_map<std::string, std::string> post_;     // post请求表单数据
+    bool needVerify_;       // 是否要验证用户
+    bool isLogin_;          // 登录还是注册
 
     static const std::unordered_set<std::string> DEFAULT_HTML;  // 默认的网页
     static const std::unordered_map<std::string, int> DEFAULT_HTML_TAG;
     static int ConverHex(char ch);      // 转换成十六进制
+
+    static const size_t MAX_LINE = 8192;        // 请求首行和每个请求头的最大长度
+    static const size_t MAX_HEADERS = 100;      // 请求头的最大个数
 };
 
 
@@ -20,29 +20,87 @@ const unordered_map<string, string> HttpResponse::SUFFIX_TYPE = {
     { ".avi",   "video/x-msvideo" },
     { ".gz",    "application/x-gzip" },
     { ".tar",   "application/x-tar" },
-    { ".css",   "text/css "},
-    { ".js",    "text/javascript "},
+    { ".css",   "text/css"},
+    { ".js",    "text/javascript"},
+    { ".json",  "application/json" },
+    { ".svg",   "image/svg+xml" },
+    { ".ico",   "image/x-icon" },
+    { ".ttf",   "font/ttf" },
+    { ".otf",   "font/otf" },
+    { ".eot",   "application/vnd.ms-fontobject" },
+    { ".woff",  "font/woff" },
+    { ".woff2", "font/woff2" },
+    { ".mp4",   "video/mp4" },
 };
 
+// 文本类的都值得压缩；png、jpg、视频、woff/woff2这些本身就是压缩过的
+const unordered_set<string> HttpResponse::COMPRESSIBLE_TYPE = {
+    "application/xhtml+xml",
+    "application/rtf",
+    "application/json",
+    "image/svg+xml",
+    "image/x-icon",
+    "font/ttf",
+    "font/otf",
+    "application/vnd.ms-fontobject",
+};
+
+const char* const HttpResponse::ENCODING_NAME[ENCODING_NUM] = { "identity", "gzip", "br" };
+const char* const HttpResponse::ENCODING_SUFFIX[ENCODING_NUM] = { "", ".gz", ".br" };
+
 const unordered_map<int, string> HttpResponse::CODE_STATUS = {
     { 200, "OK" },
+    { 206, "Partial Content" },
+    { 304, "Not Modified" },
     { 400, "Bad Request" },
     { 403, "Forbidden" },
     { 404, "Not Found" },
+    { 413, "Payload Too Large" },
+    { 416, "Range Not Satisfiable" },
+    { 500, "Internal Server Error" },
+    { 503, "Service Unavailable" },
+};
+
+// 拼好的响应首行
+const unordered_map<int, string> HttpResponse::CODE_LINE = {
+    { 200, "HTTP/1.1 200 OK\r\n" },
+    { 206, "HTTP/1.1 206 Partial Content\r\n" },
+    { 304, "HTTP/1.1 304 Not Modified\r\n" },
+    { 400, "HTTP/1.1 400 Bad Request\r\n" },
+    { 403, "HTTP/1.1 403 Forbidden\r\n" },
+    { 404, "HTTP/1.1 404 Not Found\r\n" },
+    { 413, "HTTP/1.1 413 Payload Too Large\r\n" },
+    { 416, "HTTP/1.1 416 Range Not Satisfiable\r\n" },
+    { 500, "HTTP/1.1 500 Internal Server Error\r\n" },
+    { 503, "HTTP/1.1 503 Service Unavailable\r\n" },
 };
 
+const string HttpResponse::TEXT_PLAIN = "text/plain";
+const string HttpResponse::TEXT_HTML = "text/html";
+
 const unordered_map<int, string> HttpResponse::CODE_PATH = {
     { 400, "/400.html" },
     { 403, "/403.html" },
     { 404, "/404.html" },
+    { 413, "/413.html" },
+    { 503, "/503.html" },
 };
 
+long HttpResponse::sendfileThreshold = -1;
+int HttpResponse::cacheMaxAge = 0;
+
 HttpResponse::HttpResponse() {
     code_ = -1;
     path_ = srcDir_ = "";
     isKeepAlive_ = false;
     mmFile_ = nullptr; 
+    fileFd_ = -1;
     mmFileStat_ = { 0 };
+    hasBody_ = false;
+    accept_ = 0;
+    encoding_ = IDENTITY;
+    vary_ = false;
+    bodyOffset_ = bodyLen_ = 0;
 };
 
 HttpResponse::~HttpResponse() {
@@ -52,7 +110,7 @@ HttpResponse::~HttpResponse() {
 void HttpResponse::Init(const string& srcDir, string& path, bool isKeepAlive, int code){
     assert(srcDir != "");
     // 内存映射
-    if(mmFile_) { UnmapFile(); }
+    if(mmFile_ || fileFd_ >= 0 || cached_) { UnmapFile(); }
 
     code_ = code;
     isKeepAlive_ = isKeepAlive;
@@ -60,14 +118,55 @@ void HttpResponse::Init(const string& srcDir, string& path, bool isKeepAlive, in
     srcDir_ = srcDir;
     mmFile_ = nullptr; 
     mmFileStat_ = { 0 };
+    hasBody_ = false;
+    body_.clear();
+    accept_ = 0;
+    encoding_ = IDENTITY;
+    vary_ = false;
+    range_.clear();
+    ifRange_.clear();
+    ifNoneMatch_.clear();
+    ifModifiedSince_.clear();
+    ranges_.clear();
+    bodyOffset_ = bodyLen_ = 0;
+}
+
+void HttpResponse::SetRange(const string& range, const string& ifRange) {
+    range_ = range;
+    ifRange_ = ifRange;
+}
+
+void HttpResponse::SetConditional(const string& ifNoneMatch, const string& ifModifiedSince) {
+    ifNoneMatch_ = ifNoneMatch;
+    ifModifiedSince_ = ifModifiedSince;
+}
+
+void HttpResponse::SetBody(string body, const string& type) {
+    hasBody_ = true;
+    body_ = move(body);
+    bodyType_ = type;
 }
 
 void HttpResponse::MakeResponse(Buffer& buff) {
+    // 生成的正文很小，和响应头一起放进buff，不支持Range
+    if(hasBody_) {
+        if(code_ == -1) { code_ = 200; }
+        AddStateLine_(buff);
+        AddHeader_(buff);
+        buff.Append("Content-length: ");
+        AppendNum_(buff, body_.size());
+        buff.Append("\r\n\r\n");
+        buff.Append(body_);
+        return;
+    }
     /* 判断请求的资源文件 */
     // index.html
     // /home/wjy3919/WebServer/resources/index.html
-    if(stat((srcDir_ + path_).data(), &mmFileStat_) < 0 || S_ISDIR(mmFileStat_.st_mode)) {
-        // 如果<0就是调用失败了，或者访问的是一个目录资源，就设为404
+    if(code_ >= 400) {
+        // 请求本身有问题（400、413）或者数据库忙（503），直接回错误页，不用看请求的路径
+    }
+    else if(!StatFile_() || !S_ISREG(mmFileStat_.st_mode)) {
+        // 如果<0就是调用失败了，或者访问的是一个目录、设备之类不是普通文件的资源，就设为404
         code_ = 404;
     }
     else if(!(mmFileStat_.st_mode & S_IROTH)) {
@@ -79,43 +178,410 @@ void HttpResponse::MakeResponse(Buffer& buff) {
         code_ = 200; 
     }
     ErrorHtml_();
+    // 条件请求：客户端手里的版本还是最新的，只回响应头，不碰正文
+    if(code_ == 200 && NotModified_()) {
+        code_ = 304;
+        AddStateLine_(buff);
+        AddNotModified_(buff);
+        return;
+    }
+    // 区间请求：区间都在文件外面是416，否则206只发请求的那几段
+    if(code_ == 200 && !range_.empty()) {
+        RANGE_RESULT ret = ParseRange_();
+        if(ret == RANGE_UNSATISFIABLE) {
+            code_ = 416;
+        } else if(ret == RANGE_OK && OpenContent_()) {
+            code_ = 206;
+        } else {
+            ranges_.clear();
+        }
+    }
+    // 200的正文在写首行之前打开：stat之后文件被删掉或者打不开时改回错误页，不能发200和验证器
+    if(code_ == 200 && !OpenContent_()) {
+        int err = errno;
+        LOG_WARN("open %s error: %d", filePath_.c_str(), err);
+        code_ = err == ENOENT ? 404 : (err == EACCES ? 403 : 500);
+        // 错误页不是压缩文件，也不是缓存里的这个文件
+        UnmapFile();
+        encoding_ = IDENTITY;
+        ErrorHtml_();
+    }
     // 添加响应首行
     AddStateLine_(buff);
+    if(code_ == 416) {
+        // 正文是ErrorContent生成的错误页，不是压缩文件
+        encoding_ = IDENTITY;
+        AddHeader_(buff);
+        buff.Append("Content-Range: bytes */");
+        AppendNum_(buff, mmFileStat_.st_size);
+        buff.Append("\r\n");
+        ErrorContent(buff, "Requested Range Not Satisfiable");
+        return;
+    }
+    if(code_ == 206) {
+        AddHeader_(buff);
+        AddRangeContent_(buff);
+        return;
+    }
+    // 缓存条目里有预先拼好的响应头，正文准备好之后一次拷贝完成；错误页不带验证器，免得被缓存
+    if(cached_ && (code_ == 200 || OpenContent_())) {
+        buff.Append(cached_->header[isKeepAlive_]);
+        if(code_ == 200) {
+            buff.Append(cached_->validators);
+        }
+        AppendDate_(buff);
+        buff.Append("\r\n", 2);
+        bodyLen_ = mmFileStat_.st_size;
+        return;
+    }
     AddHeader_(buff);
     AddContent_(buff);
 }
 
-char* HttpResponse::File() {
+// Range: bytes=0-499, 1000-, -200  语法不对、区间太多、If-Range对不上时忽略Range，发整个文件
+HttpResponse::RANGE_RESULT HttpResponse::ParseRange_() {
+    ranges_.clear();
+    if(range_.compare(0, 6, "bytes=") != 0) {
+        return RANGE_NONE;
+    }
+    // If-Range是上次拿到的ETag（强比较）或者Last-Modified，文件改过了就发整个文件
+    if(!ifRange_.empty() && ifRange_ != (ifRange_[0] == '"' ? ETag_() : LastModified_())) {
+        return RANGE_NONE;
+    }
+    const size_t size = mmFileStat_.st_size;
+    const char* p = range_.c_str() + 6;
+    int count = 0;
+    while(true) {
+        while(*p == ' ' || *p == '\t') { p++; }
+        char* end;
+        size_t first, last;
+        if(*p == '-') {
+            // -n表示最后n个字节
+            if(!isdigit(*++p)) { return RANGE_NONE; }
+            unsigned long long n = strtoull(p, &end, 10);
+            p = end;
+            first = n == 0 ? size : (n >= size ? 0 : size - n);
+            last = size - 1;
+        } else {
+            if(!isdigit(*p)) { return RANGE_NONE; }
+            first = strtoull(p, &end, 10);
+            p = end;
+            if(*p++ != '-') { return RANGE_NONE; }
+            last = SIZE_MAX;
+            if(isdigit(*p)) {
+                last = strtoull(p, &end, 10);
+                p = end;
+                if(last < first) { return RANGE_NONE; }
+            }
+        }
+        if(++count > MAX_RANGES) {
+            return RANGE_NONE;
+        }
+        // 起点在文件外面的区间不满足，跳过；终点超出的截到文件末尾
+        if(first < size) {
+            ranges_.push_back({ first, min(last, size - 1) - first + 1 });
+        }
+        while(*p == ' ' || *p == '\t') { p++; }
+        if(*p == '\0') { break; }
+        if(*p++ != ',') { return RANGE_NONE; }
+    }
+    if(ranges_.empty()) {
+        return RANGE_UNSATISFIABLE;
+    }
+    // 按起始位置排序，重叠或者相邻的合并，不会把同一段数据发好几遍
+    sort(ranges_.begin(), ranges_.end(), [](const ByteRange& a, const ByteRange& b) {
+        return a.start < b.start;
+    });
+    size_t n = 0;
+    for(size_t i = 1; i < ranges_.size(); i++) {
+        ByteRange& cur = ranges_[n];
+        if(ranges_[i].start <= cur.start + cur.len) {
+            cur.len = max(cur.len, ranges_[i].start + ranges_[i].len - cur.start);
+        } else {
+            ranges_[++n] = ranges_[i];
+        }
+    }
+    ranges_.resize(n + 1);
+    if(ranges_.size() > 1) {
+        // 分隔行不能在文件内容里出现，带上时间和每个线程的序号
+        static thread_local unsigned int seq = 0;
+        char boundary[40];
+        snprintf(boundary, sizeof(boundary), "tws%08lx%08x", static_cast<unsigned long>(time(nullptr)), ++seq);
+        boundary_ = boundary;
+    }
+    return RANGE_OK;
+}
+
+// If-None-Match优先，有它时不看If-Modified-Since（RFC 7232 6）
+bool HttpResponse::NotModified_() {
+    if(!ifNoneMatch_.empty()) {
+        return MatchETag_(ifNoneMatch_, ETag_());
+    }
+    if(!ifModifiedSince_.empty()) {
+        struct tm tm = {};
+        const char* end = strptime(ifModifiedSince_.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+        // 格式不对的忽略；文件时间不晚于客户端缓存的时间就是没改过
+        return end && *end == '\0' && mmFileStat_.st_mtime <= timegm(&tm);
+    }
+    return false;
+}
+
+// If-None-Match: "a", W/"b", *  弱比较，去掉W/前缀再比
+bool HttpResponse::MatchETag_(const string& list, const string& etag) {
+    size_t end = 0;
+    for(size_t pos = 0; pos < list.size(); pos = end + 1) {
+        end = list.find(',', pos);
+        if(end == string::npos) { end = list.size(); }
+        size_t b = list.find_first_not_of(" \t", pos);
+        if(b >= end) { continue; }
+        size_t e = list.find_last_not_of(" \t", end - 1);
+        if(list.compare(b, 2, "W/") == 0) { b += 2; }
+        if(list.compare(b, e - b + 1, "*") == 0 || list.compare(b, e - b + 1, etag) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const string& HttpResponse::ETag_() {
+    if(cached_) {
+        return cached_->etag;
+    }
+    if(etag_.empty()) {
+        etag_ = ETag(mmFileStat_);
+    }
+    return etag_;
+}
+
+const string& HttpResponse::LastModified_() {
+    if(cached_) {
+        return cached_->lastModified;
+    }
+    if(lastModified_.empty()) {
+        lastModified_ = HttpDate(mmFileStat_.st_mtime);
+    }
+    return lastModified_;
+}
+
+// 304只带验证器、Vary和Date，没有正文，也没有Content-length
+void HttpResponse::AddNotModified_(Buffer& buff) {
+    AddConnection_(buff);
+    AddValidators_(buff);
+    if(vary_) {
+        buff.Append("Vary: Accept-Encoding\r\n");
+    }
+    AppendDate_(buff);
+    buff.Append("\r\n");
+}
+
+void HttpResponse::AddValidators_(Buffer& buff) {
+    if(cached_) {
+        buff.Append(cached_->validators);
+    } else {
+        buff.Append(Validators(ETag_(), LastModified_()));
+    }
+}
+
+// 206的Content-Range和Content-length；多个区间时拼好每段的段头，正文由BodyIov按顺序交出去
+void HttpResponse::AddRangeContent_(Buffer& buff) {
+    const size_t size = mmFileStat_.st_size;
+    if(ranges_.size() == 1) {
+        bodyOffset_ = ranges_[0].start;
+        bodyLen_ = ranges_[0].len;
+        buff.Append("Content-Range: bytes ");
+        AppendNum_(buff, bodyOffset_);
+        buff.Append("-");
+        AppendNum_(buff, bodyOffset_ + bodyLen_ - 1);
+        buff.Append("/");
+        AppendNum_(buff, size);
+        buff.Append("\r\n");
+    } else {
+        const string& type = GetFileType_();
+        partHeaders_.resize(ranges_.size() + 1);
+        bodyLen_ = 0;
+        for(size_t i = 0; i < ranges_.size(); i++) {
+            const ByteRange& r = ranges_[i];
+            string& part = partHeaders_[i];
+            part = "\r\n--" + boundary_ + "\r\nContent-type: " + type + "\r\nContent-Range: bytes " +
+                   to_string(r.start) + "-" + to_string(r.start + r.len - 1) + "/" + to_string(size) + "\r\n\r\n";
+            bodyLen_ += part.size() + r.len;
+        }
+        partHeaders_.back() = "\r\n--" + boundary_ + "--\r\n";
+        bodyLen_ += partHeaders_.back().size();
+    }
+    buff.Append("Content-length: ");
+    AppendNum_(buff, bodyLen_);
+    buff.Append("\r\n\r\n");
+}
+
+// 文件内容在内存里的起始位置（缓存或者内存映射），走sendfile时是nullptr
+const char* HttpResponse::FileBase_() const {
+    if(cached_ && cached_->hasData) {
+        return cached_->data.data();
+    }
     return mmFile_;
 }
 
+char* HttpResponse::File() {
+    const char* base = FileBase_();
+    return base ? const_cast<char*>(base) + bodyOffset_ : nullptr;
+}
+
 size_t HttpResponse::FileLen() const {
-    return mmFileStat_.st_size;
+    return bodyLen_;
+}
+
+int HttpResponse::BodyIov(struct iovec* iov) const {
+    const char* base = FileBase_();
+    if(!base || bodyLen_ == 0) {
+        return 0;
+    }
+    if(ranges_.size() <= 1) {
+        iov[0].iov_base = const_cast<char*>(base) + bodyOffset_;
+        iov[0].iov_len = bodyLen_;
+        return 1;
+    }
+    int cnt = 0;
+    for(size_t i = 0; i < ranges_.size(); i++) {
+        iov[cnt].iov_base = const_cast<char*>(partHeaders_[i].data());
+        iov[cnt++].iov_len = partHeaders_[i].size();
+        iov[cnt].iov_base = const_cast<char*>(base) + ranges_[i].start;
+        iov[cnt++].iov_len = ranges_[i].len;
+    }
+    iov[cnt].iov_base = const_cast<char*>(partHeaders_.back().data());
+    iov[cnt++].iov_len = partHeaders_.back().size();
+    return cnt;
+}
+
+// 获取资源文件的信息，命中文件缓存时直接用缓存的元数据，不需要stat
+// 有客户端接受的压缩版本时换成压缩文件（区间请求除外），之后的mmFileStat_、filePath_都是压缩文件的
+bool HttpResponse::StatFile_() {
+    string path = srcDir_ + path_;
+    filePath_ = path;
+    encoding_ = IDENTITY;
+    vary_ = false;
+    etag_.clear();
+    lastModified_.clear();
+    cached_ = FileCache::Instance()->Get(path);
+    if(cached_) {
+        vary_ = cached_->variants != 0;
+        int encoding = PickEncoding_(cached_->variants);
+        if(encoding != IDENTITY) {
+            // 压缩文件刚被删掉时拿不到，还是发原文件
+            CachedFilePtr variant = FileCache::Instance()->Get(path, encoding);
+            if(variant) {
+                cached_ = variant;
+                encoding_ = encoding;
+                filePath_ = variant->path;
+            }
+        }
+        mmFileStat_ = cached_->st;
+        return true;
+    }
+    if(stat(path.data(), &mmFileStat_) < 0) {
+        return false;
+    }
+    struct stat variantSt[ENCODING_NUM];
+    int variants = FindVariants(path, mmFileStat_, variantSt);
+    vary_ = variants != 0;
+    int encoding = PickEncoding_(variants);
+    if(encoding != IDENTITY) {
+        mmFileStat_ = variantSt[encoding];
+        filePath_ = path + ENCODING_SUFFIX[encoding];
+        encoding_ = encoding;
+    }
+    return true;
+}
+
+// 客户端接受的里面选最小的：br比gzip小
+// 区间请求只按原文件算：206的区间、416的Content-Range都是原文件的偏移和大小，不能混进压缩文件的
+int HttpResponse::PickEncoding_(int variants) const {
+    if(!range_.empty()) { return IDENTITY; }
+    int usable = variants & accept_;
+    if(usable & (1 << BR)) { return BR; }
+    if(usable & (1 << GZIP)) { return GZIP; }
+    return IDENTITY;
+}
+
+int HttpResponse::FindVariants(const string& path, const struct stat& st, struct stat* variantSt) {
+    if(!S_ISREG(st.st_mode) || !Compressible(FileType(path))) {
+        return 0;
+    }
+    int variants = 0;
+    for(int i = IDENTITY + 1; i < ENCODING_NUM; i++) {
+        struct stat vst;
+        // 比原文件旧的压缩文件是原文件改之前生成的，不能用
+        if(stat((path + ENCODING_SUFFIX[i]).data(), &vst) < 0 || !S_ISREG(vst.st_mode) ||
+           !(vst.st_mode & S_IROTH) || vst.st_mtim.tv_sec < st.st_mtim.tv_sec ||
+           (vst.st_mtim.tv_sec == st.st_mtim.tv_sec && vst.st_mtim.tv_nsec < st.st_mtim.tv_nsec)) {
+            continue;
+        }
+        variants |= 1 << i;
+        if(variantSt) { variantSt[i] = vst; }
+    }
+    return variants;
+}
+
+bool HttpResponse::Compressible(const string& type) {
+    return type.compare(0, 5, "text/") == 0 || COMPRESSIBLE_TYPE.count(type) == 1;
+}
+
+// Accept-Encoding: gzip, deflate, br;q=1.0, *;q=0.1  q=0的表示不接受
+int HttpResponse::ParseAcceptEncoding(const string& header) {
+    int accept = 0;
+    int refusedMask = 0;
+    bool wildcard = false;
+    size_t end = 0;
+    for(size_t pos = 0; pos < header.size(); pos = end + 1) {
+        end = header.find(',', pos);
+        if(end == string::npos) { end = header.size(); }
+        size_t semi = header.find(';', pos);
+        size_t nameEnd = semi < end ? semi : end;
+        size_t b = header.find_first_not_of(" \t", pos);
+        size_t e = header.find_last_not_of(" \t", nameEnd - 1);
+        bool refused = false;
+        if(semi < end) {
+            size_t q = header.find("q=", semi);
+            refused = q < end && strtod(header.c_str() + q + 2, nullptr) <= 0;
+        }
+        if(b < nameEnd && e != string::npos && e >= b) {
+            string name = header.substr(b, e - b + 1);
+            int mask = 0;
+            if(strcasecmp(name.c_str(), "gzip") == 0 || strcasecmp(name.c_str(), "x-gzip") == 0) {
+                mask = 1 << GZIP;
+            } else if(strcasecmp(name.c_str(), "br") == 0) {
+                mask = 1 << BR;
+            } else if(name == "*") {
+                wildcard = !refused;
+                continue;
+            }
+            if(refused) { refusedMask |= mask; }
+            else { accept |= mask; }
+        }
+    }
+    // *表示没单独列出来的都接受，单独写了q=0的除外
+    if(wildcard) { accept |= ((1 << GZIP) | (1 << BR)) & ~refusedMask; }
+    return accept;
 }
 
 void HttpResponse::ErrorHtml_() {
     if(CODE_PATH.count(code_) == 1) {
         path_ = CODE_PATH.find(code_)->second;
-        stat((srcDir_ + path_).data(), &mmFileStat_);
+        StatFile_();
     }
 }
 
 // 添加响应首行
 void HttpResponse::AddStateLine_(Buffer& buff) {
-    string status;
-    if(CODE_STATUS.count(code_) == 1) {
-        // 找状态描述
-        status = CODE_STATUS.find(code_)->second;
-    }
-    else {
+    auto it = CODE_LINE.find(code_);
+    if(it == CODE_LINE.end()) {
         code_ = 400;
-        status = CODE_STATUS.find(400)->second;
+        it = CODE_LINE.find(400);
     }
-    buff.Append("HTTP/1.1 " + to_string(code_) + " " + status + "\r\n");
+    buff.Append(it->second);
 }
 
-// 添加响应头
-void HttpResponse::AddHeader_(Buffer& buff) {
+void HttpResponse::AddConnection_(Buffer& buff) {
     buff.Append("Connection: ");
     if(isKeepAlive_) {
         buff.Append("keep-alive\r\n");
@@ -123,54 +589,202 @@ void HttpResponse::AddHeader_(Buffer& buff) {
     } else{
         buff.Append("close\r\n");
     }
-    // Content-type表示当前文件的类型
-    buff.Append("Content-type: " + GetFileType_() + "\r\n");
 }
 
-// 响应体
+// 添加响应头
+void HttpResponse::AddHeader_(Buffer& buff) {
+    AddConnection_(buff);
+    // Content-type表示当前文件的类型，多个区间时是multipart，每段的类型写在段头里
+    buff.Append("Content-type: ");
+    if(ranges_.size() > 1) {
+        buff.Append("multipart/byteranges; boundary=");
+        buff.Append(boundary_);
+    } else {
+        buff.Append(GetFileType_());
+    }
+    buff.Append("\r\n");
+    if(!hasBody_) {
+        buff.Append("Accept-Ranges: bytes\r\n");
+    }
+    if(!hasBody_ && (code_ == 200 || code_ == 206)) {
+        AddValidators_(buff);
+    }
+    if(encoding_ != IDENTITY) {
+        buff.Append("Content-Encoding: ");
+        buff.Append(ENCODING_NAME[encoding_]);
+        buff.Append("\r\n");
+    }
+    if(vary_) {
+        buff.Append("Vary: Accept-Encoding\r\n");
+    }
+    AppendDate_(buff);
+}
+
+// 响应体，200的正文已经打开了，错误页在这里打开
 void HttpResponse::AddContent_(Buffer& buff) {
-    int srcFd = open((srcDir_ + path_).data(), O_RDONLY);
+    if(code_ != 200 && !OpenContent_()) {
+        ErrorContent(buff, "File NotFound!");
+        return;
+    }
+    bodyLen_ = mmFileStat_.st_size;
+    buff.Append("Content-length: ");
+    AppendNum_(buff, bodyLen_);
+    buff.Append("\r\n\r\n");
+}
+
+// 准备正文：缓存里的内容、sendfile用的fd或者内存映射，失败返回false，errno是open/mmap的错误
+// 单个区间总是用sendfile从偏移处发，只读要的那一段；多个区间要和段头交错着writev，需要在内存里
+bool HttpResponse::OpenContent_() {
+    const bool multipart = ranges_.size() > 1;
+    // 空文件没有正文，不用打开；长度为0的mmap会失败
+    if(mmFileStat_.st_size == 0) {
+        return true;
+    }
+    // 缓存里有文件内容，而且不够sendfile的阈值，直接从内存发送
+    if(cached_ && cached_->hasData &&
+        (multipart || sendfileThreshold < 0 || mmFileStat_.st_size < sendfileThreshold)) {
+        return true;
+    }
+    int srcFd = open(filePath_.data(), O_RDONLY);
     // <0就是没打开文件
     if(srcFd < 0) { 
-        ErrorContent(buff, "File NotFound!");
-        return; 
+        return false; 
+    }
+
+    LOG_DEBUG("file path %s", filePath_.data());
+    /* 大文件不做映射，保留fd由HttpConn用sendfile直接从page cache发送，
+        省掉mmap/munmap、建页表和多线程下的TLB shootdown */
+    if(!multipart && (ranges_.size() == 1 || (sendfileThreshold >= 0 && mmFileStat_.st_size >= sendfileThreshold))) {
+        fileFd_ = srcFd;
+        return true;
     }
 
     /* 将文件映射到内存提高文件的访问速度 
         MAP_PRIVATE 建立一个写入时拷贝的私有映射*/
-    LOG_DEBUG("file path %s", (srcDir_ + path_).data());
     // mmap为映射函数
     int* mmRet = (int*)mmap(0, mmFileStat_.st_size, PROT_READ, MAP_PRIVATE, srcFd, 0);
-    if(*mmRet == -1) {
-        ErrorContent(buff, "File NotFound!");
-        return; 
-    }
-    mmFile_ = (char*)mmRet;
+    int err = errno;
     close(srcFd);
+    if(mmRet == MAP_FAILED) {
+        errno = err;
+        return false; 
+    }
     // 此时文件的数据就映射到内存里了
-    buff.Append("Content-length: " + to_string(mmFileStat_.st_size) + "\r\n\r\n");
+    mmFile_ = (char*)mmRet;
+    return true;
+}
+
+// 缓存条目用的响应头（首行和Date之外的部分），每个文件、每种keep-alive只拼一次
+string HttpResponse::HeaderBlock(const string& type, size_t len, bool isKeepAlive, int encoding, bool vary) {
+    string header = "Connection: ";
+    if(isKeepAlive) {
+        header += "keep-alive\r\n";
+        header += "keep-alive: max=6, timeout=120\r\n";
+    } else {
+        header += "close\r\n";
+    }
+    header += "Content-type: " + type + "\r\n";
+    header += "Accept-Ranges: bytes\r\n";
+    if(encoding != IDENTITY) {
+        header += string("Content-Encoding: ") + ENCODING_NAME[encoding] + "\r\n";
+    }
+    if(vary) {
+        header += "Vary: Accept-Encoding\r\n";
+    }
+    header += "Content-length: " + to_string(len) + "\r\n";
+    return header;
+}
+
+// 数字直接写进buff，不构造临时的string
+void HttpResponse::AppendNum_(Buffer& buff, size_t num) {
+    char tmp[24];
+    char* p = tmp + sizeof(tmp);
+    do {
+        *--p = '0' + num % 10;
+        num /= 10;
+    } while(num);
+    buff.Append(p, tmp + sizeof(tmp) - p);
 }
 
-// 解除内存映射
+string HttpResponse::ETag(const struct stat& st) {
+    char buf[64];
+    int len = snprintf(buf, sizeof(buf), "\"%lx-%llx-%llx\"", static_cast<unsigned long>(st.st_ino),
+                       static_cast<unsigned long long>(st.st_mtim.tv_sec) * 1000000000ULL + st.st_mtim.tv_nsec,
+                       static_cast<unsigned long long>(st.st_size));
+    return string(buf, len);
+}
+
+string HttpResponse::Validators(const string& etag, const string& lastModified) {
+    string lines = "ETag: " + etag + "\r\n";
+    lines += "Last-Modified: " + lastModified + "\r\n";
+    if(cacheMaxAge > 0) {
+        lines += "Cache-Control: max-age=" + to_string(cacheMaxAge) + "\r\n";
+    } else {
+        lines += "Cache-Control: no-cache\r\n";
+    }
+    return lines;
+}
+
+string HttpResponse::HttpDate(time_t t) {
+    char buf[32];
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    return string(buf, strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm));
+}
+
+// Date头每秒只格式化一次，每个线程一份，不需要加锁
+void HttpResponse::AppendDate_(Buffer& buff) {
+    static thread_local time_t last = 0;
+    static thread_local char line[64];
+    static thread_local size_t len = 0;
+    time_t now = time(nullptr);
+    if(now != last) {
+        struct tm t;
+        gmtime_r(&now, &t);
+        len = strftime(line, sizeof(line), "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &t);
+        last = now;
+    }
+    buff.Append(line, len);
+}
+
+// 解除内存映射，走sendfile时关闭保留的文件描述符
 void HttpResponse::UnmapFile() {
     if(mmFile_) {
         munmap(mmFile_, mmFileStat_.st_size);
         mmFile_ = nullptr;
     }
+    if(fileFd_ >= 0) {
+        close(fileFd_);
+        fileFd_ = -1;
+    }
+    cached_.reset();
+}
+
+const string& HttpResponse::GetFileType_() {
+    if(hasBody_) {
+        return bodyType_;
+    }
+    if(code_ == 416) {
+        return TEXT_HTML;
+    }
+    if(cached_) {
+        return cached_->type;
+    }
+    return FileType(path_);
 }
 
-string HttpResponse::GetFileType_() {
+const string& HttpResponse::FileType(const string& path) {
     /* 判断文件类型 */
-    string::size_type idx = path_.find_last_of('.');
+    string::size_type idx = path.find_last_of('.');
     if(idx == string::npos) {
-        return "text/plain";
+        return TEXT_PLAIN;
     }
     // 获取后缀，再去找
-    string suffix = path_.substr(idx);
-    if(SUFFIX_TYPE.count(suffix) == 1) {
-        return SUFFIX_TYPE.find(suffix)->second;
+    auto it = SUFFIX_TYPE.find(path.substr(idx));
+    if(it != SUFFIX_TYPE.end()) {
+        return it->second;
     }
-    return "text/plain";
+    return TEXT_PLAIN;
 }
 
 void HttpResponse::ErrorContent(Buffer& buff, string message) 
@@ -2,13 +2,24 @@
 #define HTTP_RESPONSE_H
 
 #include <unordered_map>
+#include <algorithm>
+#include <unordered_set>
+#include <vector>
+#include <strings.h>     // strcasecmp
+#include <stdlib.h>      // strtod, strtoull
+#include <stdint.h>      // SIZE_MAX
+#include <ctype.h>       // isdigit
 #include <fcntl.h>       // open
 #include <unistd.h>      // close
+#include <errno.h>
 #include <sys/stat.h>    // stat
 #include <sys/mman.h>    // mmap, munmap
+#include <time.h>        // gmtime_r, strftime
+#include <sys/uio.h>     // iovec
 
 #include "../buffer/buffer.h"
 #include "../log/log.h"
+#include "filecache.h"
 
 class HttpResponse {
 public:
@@ -19,29 +30,118 @@ public:
     void MakeResponse(Buffer& buff);
     void UnmapFile();
     char* File();
-    size_t FileLen() const;
+    int FileFd() const { return fileFd_; }
+    size_t FileLen() const;     // 正文的长度（206时是要发的几段加起来）
+    size_t FileOffset() const { return bodyOffset_; }   // 正文在文件里的起始偏移，单个区间的206不是0
+    int BodyIov(struct iovec* iov) const;   // 内存里的正文按顺序填进iov（最多MAX_BODY_IOV段），返回段数
+    bool IsMultipart() const { return ranges_.size() > 1; }
     void ErrorContent(Buffer& buff, std::string message);
     int Code() const { return code_; }
+    void SetBody(std::string body, const std::string& type);   // 正文由程序生成（比如/metrics），不对应文件
+    bool IsKeepAlive() const { return isKeepAlive_; }
+    void SetAcceptEncoding(int accept) { accept_ = accept; }  // 客户端接受的压缩格式，ParseAcceptEncoding的结果
+    void SetRange(const std::string& range, const std::string& ifRange);  // Range、If-Range请求头，只有GET设置
+    // If-None-Match、If-Modified-Since请求头，只有GET设置，资源没变时回304
+    void SetConditional(const std::string& ifNoneMatch, const std::string& ifModifiedSince);
+
+    static long sendfileThreshold;  // 文件大小>=该值时保留fd用sendfile发送正文，<0表示全部mmap
+    static int cacheMaxAge;         // 静态文件Cache-Control的max-age（秒），<=0时是no-cache，每次都要验证
+
+    static const int MAX_RANGES = 16;   // 一个请求最多几个区间，再多就忽略Range发整个文件
+    static const int MAX_BODY_IOV = 2 * MAX_RANGES + 1; // multipart：每段的段头和内容，最后是结束的分隔行
+
+    /* 预压缩的格式，压缩文件和原文件放在一起，文件名加上对应的后缀（tools/precompress生成） */
+    enum Encoding {
+        IDENTITY = 0,
+        GZIP,
+        BR,
+        ENCODING_NUM
+    };
+    static const char* const ENCODING_NAME[ENCODING_NUM];   // Content-Encoding的值
+    static const char* const ENCODING_SUFFIX[ENCODING_NUM]; // 压缩文件的后缀
+
+    static int ParseAcceptEncoding(const std::string& header);  // 接受的格式，按位或(1 << Encoding)
+    static bool Compressible(const std::string& type);          // 这种类型的文件值不值得压缩
+    // 原文件旁边存在、而且不比原文件旧的压缩文件，按位或(1 << Encoding)；variantSt不为空时填上各自的stat
+    static int FindVariants(const std::string& path, const struct stat& st, struct stat* variantSt = nullptr);
+
+    static const std::string& FileType(const std::string& path);    // 根据后缀判断文件类型
+    static std::string HeaderBlock(const std::string& type, size_t len, bool isKeepAlive,
+                                   int encoding = IDENTITY, bool vary = false);
+    static std::string HttpDate(time_t t);  // RFC 7231的日期格式
+    static std::string ETag(const struct stat& st);     // 强ETag："inode-mtime-大小"，不用读文件内容
+    static std::string Validators(const std::string& etag, const std::string& lastModified);  // ETag、Last-Modified、Cache-Control三行
 
 private:
     void AddStateLine_(Buffer &buff);
+    void AddConnection_(Buffer &buff);
+    void AddValidators_(Buffer &buff);
+    void AddNotModified_(Buffer &buff);
     void AddHeader_(Buffer &buff);
     void AddContent_(Buffer &buff);
+    void AddRangeContent_(Buffer &buff);
+
+    enum RANGE_RESULT {
+        RANGE_NONE,         // 没有Range或者不用管它，发整个文件
+        RANGE_OK,           // ranges_里是要发的区间
+        RANGE_UNSATISFIABLE,    // 区间都在文件外面，416
+    };
+    RANGE_RESULT ParseRange_();
+    bool NotModified_();
+    const std::string& ETag_();
+    const std::string& LastModified_();
+    static bool MatchETag_(const std::string& list, const std::string& etag);
+    const char* FileBase_() const;
 
+    bool StatFile_();
+    bool OpenContent_();
     void ErrorHtml_();
-    std::string GetFileType_();
+    const std::string& GetFileType_();
+    int PickEncoding_(int variants) const;
+
+    static void AppendNum_(Buffer& buff, size_t num);
+    static void AppendDate_(Buffer& buff);
 
     int code_;  // 响应状态码
     bool isKeepAlive_;  // 是否保持连接
 
     std::string path_;  // 资源的路径
     std::string srcDir_;    // 资源的目录
+    std::string filePath_;  // 实际发送的文件，选了压缩版本时是压缩文件
+    int accept_;            // 客户端接受的压缩格式
+    int encoding_;          // 发送的正文的压缩格式
+    bool vary_;             // 这个资源有压缩版本，响应随Accept-Encoding变化
+
+    struct ByteRange {
+        size_t start;
+        size_t len;
+    };
+    std::string range_;     // Range请求头，空表示要整个文件
+    std::string ifRange_;   // If-Range请求头
+    std::string ifNoneMatch_;
+    std::string ifModifiedSince_;
+    std::string etag_;          // 没命中文件缓存时按mmFileStat_算出来的，用到时才算
+    std::string lastModified_;
+    std::vector<ByteRange> ranges_;     // 206要发的区间，按起始位置排好、重叠的合并了
+    std::vector<std::string> partHeaders_;  // multipart每段前面的分隔行和段头，最后一个是结束的分隔行
+    std::string boundary_;
+    size_t bodyOffset_;     // 正文在文件里的偏移
+    size_t bodyLen_;        // 正文的长度
 
     char* mmFile_;  // 文件内存映射的指针
+    int fileFd_;    // 走sendfile时保留的文件描述符，-1表示没有
     struct stat mmFileStat_;    // 文件的状态信息
+    CachedFilePtr cached_;      // 命中文件缓存时的条目，持有它保证发送期间内容有效
+    bool hasBody_;          // 是否用SetBody设置的正文
+    std::string body_;
+    std::string bodyType_;
 
     static const std::unordered_map<std::string, std::string> SUFFIX_TYPE;  // 后缀 - 类型
     static const std::unordered_map<int, std::string> CODE_STATUS;  // 状态码 - 描述
+    static const std::unordered_map<int, std::string> CODE_LINE;    // 状态码 - 响应首行
+    static const std::unordered_set<std::string> COMPRESSIBLE_TYPE;   // text/*以外值得压缩的类型
+    static const std::string TEXT_PLAIN;
+    static const std::string TEXT_HTML;
     static const std::unordered_map<int, std::string> CODE_PATH;    // 状态码 - 路径
 };
 
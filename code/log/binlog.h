@@ -0,0 +1,169 @@
+#ifndef BINLOG_H
+#define BINLOG_H
+
+#include <string>
+#include <type_traits>
+#include <algorithm>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>      // __rdtsc
+#endif
+
+/**
+ * 二进制日志（编译时定义LOG_BINARY）
+ * 每个LOG_*调用点的格式串、文件、行号放在一个静态的LogSite里，第一次执行时登记拿到编号；
+ * 之后每次调用只把编号、TSC时间戳和原始参数写进日志，格式化留给离线的logdecode去做
+ *
+ * 文件由连续的记录组成，每条记录：类型(1字节) 整条记录的长度(2字节) 内容，整数都是本机字节序
+ *   'H' 文件头：magic(8) tsc(8) 墙上时间ns(8) 每秒tsc数(8)，每个文件开头一条
+ *   'S' 调用点：编号(4) 级别(1) 行号(4) 文件名长度(2) 文件名 格式串长度(2) 格式串
+ *   'T' 时间同步：tsc(8) 墙上时间ns(8)，每批写盘时一条，解码时用来把tsc换算成时间
+ *   'L' 一条日志：调用点编号(4) tsc(8) 参数个数(1) 参数...
+ * 参数：类型(1字节) 值，'i'/'u'是8字节整数，'d'是double，'p'是指针，'s'是长度(2字节)加字符串内容
+*/
+
+/* 一个LOG_*调用点，全是字面量，编译期就放在只读数据里 */
+struct LogSite {
+    const char* format;
+    const char* file;
+    int line;
+    int level;
+};
+
+namespace binlog {
+
+const char MAGIC[8] = { 'T', 'W', 'B', 'L', 'O', 'G', '1', '\n' };
+const size_t MAX_STR = 512;     // 单个字符串参数最多保存的字节数
+
+enum RecordType : uint8_t {
+    REC_HEADER = 'H',
+    REC_SITE = 'S',
+    REC_SYNC = 'T',
+    REC_LOG = 'L',
+};
+
+enum ArgType : uint8_t {
+    ARG_INT = 'i',
+    ARG_UINT = 'u',
+    ARG_DOUBLE = 'd',
+    ARG_PTR = 'p',
+    ARG_STR = 's',
+};
+
+inline uint64_t ReadTsc() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+inline uint64_t WallNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* 往定长的缓冲区里写一条记录，空间不够时ok()为false */
+class RecordWriter {
+public:
+    RecordWriter(char* buf, size_t cap): begin_(buf), cur_(buf), end_(buf + cap), ok_(true) {}
+
+    void Begin(RecordType type) {
+        Put<uint8_t>(type);
+        Put<uint16_t>(0);
+    }
+
+    // 回填记录长度，返回整条记录的字节数
+    size_t End() {
+        uint16_t len = static_cast<uint16_t>(cur_ - begin_);
+        if(ok_) { memcpy(begin_ + 1, &len, sizeof(len)); }
+        return ok_ ? len : 0;
+    }
+
+    template<typename T>
+    void Put(T val) {
+        if(static_cast<size_t>(end_ - cur_) < sizeof(T)) {
+            ok_ = false;
+            return;
+        }
+        memcpy(cur_, &val, sizeof(T));
+        cur_ += sizeof(T);
+    }
+
+    void PutStr(const char* str, size_t len) {
+        if(!str) {
+            str = "(null)";
+            len = 6;
+        }
+        len = std::min(len, MAX_STR);
+        Put<uint16_t>(static_cast<uint16_t>(len));
+        if(static_cast<size_t>(end_ - cur_) < len) {
+            ok_ = false;
+            return;
+        }
+        memcpy(cur_, str, len);
+        cur_ += len;
+    }
+
+    bool ok() const { return ok_; }
+
+private:
+    char* begin_;
+    char* cur_;
+    char* end_;
+    bool ok_;
+};
+
+/* 按参数的静态类型编码，格式串里的长度修饰符不影响保存的值，解码时统一按64位处理 */
+template<typename T>
+typename std::enable_if<(std::is_integral<T>::value && std::is_signed<T>::value) || std::is_enum<T>::value>::type
+EncodeArg(RecordWriter& w, T val) {
+    w.Put<uint8_t>(ARG_INT);
+    w.Put<int64_t>(static_cast<int64_t>(val));
+}
+
+template<typename T>
+typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value>::type
+EncodeArg(RecordWriter& w, T val) {
+    w.Put<uint8_t>(ARG_UINT);
+    w.Put<uint64_t>(static_cast<uint64_t>(val));
+}
+
+template<typename T>
+typename std::enable_if<std::is_floating_point<T>::value>::type
+EncodeArg(RecordWriter& w, T val) {
+    w.Put<uint8_t>(ARG_DOUBLE);
+    w.Put<double>(static_cast<double>(val));
+}
+
+inline void EncodeArg(RecordWriter& w, const char* str) {
+    w.Put<uint8_t>(ARG_STR);
+    w.PutStr(str, str ? strlen(str) : 0);
+}
+
+inline void EncodeArg(RecordWriter& w, const std::string& str) {
+    w.Put<uint8_t>(ARG_STR);
+    w.PutStr(str.data(), str.size());
+}
+
+template<typename T>
+void EncodeArg(RecordWriter& w, const T* ptr) {
+    w.Put<uint8_t>(ARG_PTR);
+    w.Put<uint64_t>(reinterpret_cast<uintptr_t>(ptr));
+}
+
+template<typename... Args>
+void EncodeArgs(RecordWriter& w, const Args&... args) {
+    w.Put<uint8_t>(static_cast<uint8_t>(sizeof...(args)));
+    int expand[] = { 0, (EncodeArg(w, args), 0)... };
+    (void)expand;
+}
+
+} // namespace binlog
+
+#endif //BINLOG_H
@@ -1,180 +1,373 @@
 #include "log.h"
+#include <limits.h>     // IOV_MAX
+#include <algorithm>
 
 using namespace std;
 
+namespace {
+/* 当前线程的环，线程退出时标记关闭，由后台线程写完剩下的内容后回收 */
+struct LocalRing {
+    shared_ptr<LogRing> ring;
+    ~LocalRing() {
+        if(ring) { ring->Close(); }
+    }
+};
+
+thread_local LocalRing localRing;
+}
+
 Log::Log() {
     lineCount_ = 0;
+    fileIdx_ = 0;
+    dayEnd_ = 0;
+    isOpen_ = false;
+    level_ = 1;
     isAsync_ = false;
+#ifdef LOG_BINARY
+    binary_ = true;
+#else
+    binary_ = false;
+#endif
+    fileBytes_ = 0;
+    sitesWritten_ = 0;
+    ticksPerSec_ = 0;
+    fd_ = -1;
+    ringSize_ = 0;
+    dropped_ = 0;
+    dropTotal_ = 0;
+    isClose_ = false;
     writeThread_ = nullptr;
-    deque_ = nullptr;
-    toDay_ = 0;
-    fp_ = nullptr;
 }
 
 Log::~Log() {
+    isOpen_ = false;
     if(writeThread_ && writeThread_->joinable()) {
-        while(!deque_->empty()) {
-            deque_->flush();
-        };
-        deque_->Close();
+        {
+            lock_guard<mutex> locker(mtx_);
+            isClose_ = true;
+        }
+        cond_.notify_one();
+        // 后台线程退出前会把所有环里剩下的内容写完
         writeThread_->join();
     }
-    if(fp_) {
-        lock_guard<mutex> locker(mtx_);
-        flush();
-        fclose(fp_);
+    if(fd_ >= 0) {
+        close(fd_);
     }
 }
 
-int Log::GetLevel() {
-    lock_guard<mutex> locker(mtx_);
-    return level_;
-}
-
-void Log::SetLevel(int level) {
-    lock_guard<mutex> locker(mtx_);
-    level_ = level;
-}
-
 void Log::init(int level = 1, const char* path, const char* suffix,
     int maxQueueSize) {
-    isOpen_ = true;
     level_ = level;
+    path_ = path;
+    suffix_ = suffix;
     if(maxQueueSize > 0) {
         isAsync_ = true;
-        if(!deque_) {
-            unique_ptr<BlockDeque<std::string>> newDeque(new BlockDeque<std::string>);
-            deque_ = move(newDeque);
-            
-            std::unique_ptr<std::thread> NewThread(new thread(FlushLogThread));
-            writeThread_ = move(NewThread);
+        if(!writeThread_) {
+            // 环的大小只在第一次init时确定，取2的幂
+            size_t bytes = static_cast<size_t>(maxQueueSize) * LINE_BYTES;
+            ringSize_ = 4096;
+            while(ringSize_ < bytes) { ringSize_ <<= 1; }
+            writeThread_.reset(new thread(FlushLogThread));
         }
     } else {
         isAsync_ = false;
     }
-
-    lineCount_ = 0;
-
-    time_t timer = time(nullptr);
-    struct tm *sysTime = localtime(&timer);
-    struct tm t = *sysTime;
-    path_ = path;
-    suffix_ = suffix;
-    char fileName[LOG_NAME_LEN] = {0};
-    snprintf(fileName, LOG_NAME_LEN - 1, "%s/%04d_%02d_%02d%s", 
-            path_, t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, suffix_);
-    toDay_ = t.tm_mday;
+    if(binary_ && ticksPerSec_ == 0) {
+        // 量一下tsc的频率，写进每个文件的文件头，解码时换算时间用
+        uint64_t tsc0 = binlog::ReadTsc();
+        uint64_t ns0 = binlog::WallNs();
+        usleep(10000);
+        uint64_t tsc1 = binlog::ReadTsc();
+        uint64_t ns1 = binlog::WallNs();
+        ticksPerSec_ = (tsc1 - tsc0) * 1000000000.0 / (ns1 - ns0);
+    }
 
     {
         lock_guard<mutex> locker(mtx_);
-        buff_.RetrieveAll();
-        if(fp_) { 
-            flush();
-            fclose(fp_); 
+        if(fd_ >= 0) {
+            close(fd_);
+            fd_ = -1;
         }
+        dayEnd_ = 0;
+        Rotate_();
+    }
+    isOpen_ = true;
+}
+
+void Log::Rotate_() {
+    time_t timer = time(nullptr);
+    if(fd_ >= 0 && timer < dayEnd_ && lineCount_ < MAX_LINES && fileBytes_ < MAX_BIN_BYTES) {
+        return;
+    }
+    struct tm t;
+    localtime_r(&timer, &t);
+    char newFile[LOG_NAME_LEN];
+    char tail[36] = {0};
+    snprintf(tail, 36, "%04d_%02d_%02d", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday);
+
+    /* 日志日期 日志行数 */
+    if(timer >= dayEnd_) {
+        snprintf(newFile, LOG_NAME_LEN - 72, "%s/%s%s", path_, tail, suffix_);
+        fileIdx_ = 0;
+        struct tm end = t;
+        end.tm_hour = 24;
+        end.tm_min = 0;
+        end.tm_sec = 0;
+        dayEnd_ = mktime(&end);
+    } else {
+        fileIdx_++;
+        snprintf(newFile, LOG_NAME_LEN - 72, "%s/%s-%d%s", path_, tail, fileIdx_, suffix_);
+    }
+    lineCount_ = 0;
+    fileBytes_ = 0;
+    sitesWritten_ = 0;
+    if(binary_) {
+        strncat(newFile, ".bin", LOG_NAME_LEN - strlen(newFile) - 1);
+    }
 
-        fp_ = fopen(fileName, "a");
-        if(fp_ == nullptr) {
-            mkdir(path_, 0777);
-            fp_ = fopen(fileName, "a");
-        } 
-        assert(fp_ != nullptr);
+    if(fd_ >= 0) { close(fd_); }
+    fd_ = open(newFile, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+    if(fd_ < 0) {
+        mkdir(path_, 0777);
+        fd_ = open(newFile, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
     }
+    assert(fd_ >= 0);
 }
 
-void Log::write(int level, const char *format, ...) {
+int Log::FormatHead_(int level, char* buf) {
+    static const char* TITLE[] = { "[debug]: ", "[info] : ", "[warn] : ", "[error]: " };
+    // 同一秒内的日期部分只格式化一次
+    thread_local time_t cachedSec = -1;
+    thread_local char cachedDate[32];
+    thread_local int cachedLen = 0;
+
     struct timeval now = {0, 0};
     gettimeofday(&now, nullptr);
-    time_t tSec = now.tv_sec;
-    struct tm *sysTime = localtime(&tSec);
-    struct tm t = *sysTime;
+    if(now.tv_sec != cachedSec) {
+        struct tm t;
+        localtime_r(&now.tv_sec, &t);
+        cachedLen = snprintf(cachedDate, sizeof(cachedDate), "%d-%02d-%02d %02d:%02d:%02d.",
+                    t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec);
+        cachedSec = now.tv_sec;
+    }
+    memcpy(buf, cachedDate, cachedLen);
+    int n = cachedLen;
+    long usec = now.tv_usec;
+    for(int i = 5; i >= 0; i--) {
+        buf[n + i] = '0' + usec % 10;
+        usec /= 10;
+    }
+    n += 6;
+    buf[n++] = ' ';
+    memcpy(buf + n, TITLE[(level >= 0 && level <= 3) ? level : 1], 9);
+    return n + 9;
+}
+
+void Log::write(int level, const char *format, ...) {
+    char line[LINE_SIZE];
+    int n = FormatHead_(level, line);
+
     va_list vaList;
+    va_start(vaList, format);
+    int m = vsnprintf(line + n, LINE_SIZE - n - 1, format, vaList);
+    va_end(vaList);
+    if(m > 0) {
+        n += min(m, LINE_SIZE - n - 2);
+    }
+    line[n++] = '\n';
+    Append_(line, n);
+}
 
-    /* 日志日期 日志行数 */
-    if (toDay_ != t.tm_mday || (lineCount_ && (lineCount_  %  MAX_LINES == 0)))
-    {
-        unique_lock<mutex> locker(mtx_);
-        locker.unlock();
-        
-        char newFile[LOG_NAME_LEN];
-        char tail[36] = {0};
-        snprintf(tail, 36, "%04d_%02d_%02d", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday);
-
-        if (toDay_ != t.tm_mday)
-        {
-            snprintf(newFile, LOG_NAME_LEN - 72, "%s/%s%s", path_, tail, suffix_);
-            toDay_ = t.tm_mday;
-            lineCount_ = 0;
-        }
-        else {
-            snprintf(newFile, LOG_NAME_LEN - 72, "%s/%s-%d%s", path_, tail, (lineCount_  / MAX_LINES), suffix_);
+void Log::Append_(const char* data, size_t len) {
+    if(!isAsync_) {
+        lock_guard<mutex> locker(mtx_);
+        Rotate_();
+        struct iovec iov[2];
+        int cnt = 0;
+        if(binary_) {
+            Preamble_(false);
+            iov[cnt++] = { const_cast<char*>(preamble_.data()), preamble_.size() };
         }
-        
-        locker.lock();
-        flush();
-        fclose(fp_);
-        fp_ = fopen(newFile, "a");
-        assert(fp_ != nullptr);
+        iov[cnt++] = { const_cast<char*>(data), len };
+        WriteAll_(iov, cnt);
+        lineCount_ += !binary_;
+        fileBytes_ += preamble_.size() + len;
+        return;
     }
 
+    LogRing* ring = LocalRing_();
+    size_t used;
+    if(!ring->Push(data, len, used)) {
+        // 环满了说明磁盘跟不上，丢掉这一行，不等待
+        dropped_.fetch_add(1, memory_order_relaxed);
+        dropTotal_.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+    // 刚用过一半时叫醒后台线程，不用等到定时器
+    size_t half = ring->Capacity() / 2;
+    if(used >= half && used - len < half) {
+        cond_.notify_one();
+    }
+}
+
+LogRing* Log::LocalRing_() {
+    if(!localRing.ring) {
+        localRing.ring = make_shared<LogRing>(ringSize_);
+        lock_guard<mutex> locker(ringMtx_);
+        rings_.push_back(localRing.ring);
+    }
+    return localRing.ring.get();
+}
+
+uint32_t Log::RegisterSite(const LogSite* site) {
+    lock_guard<mutex> locker(siteMtx_);
+    sites_.push_back(site);
+    return sites_.size() - 1;
+}
+
+void Log::Preamble_(bool withSync) {
+    preamble_.clear();
+    char rec[LINE_SIZE];
+    if(fileBytes_ == 0) {
+        binlog::RecordWriter w(rec, sizeof(rec));
+        w.Begin(binlog::REC_HEADER);
+        for(char c: binlog::MAGIC) { w.Put<char>(c); }
+        w.Put<uint64_t>(binlog::ReadTsc());
+        w.Put<uint64_t>(binlog::WallNs());
+        w.Put<uint64_t>(ticksPerSec_);
+        preamble_.append(rec, w.End());
+    }
+    // 上一批之后新登记的调用点，新文件要把所有调用点重新写一遍
     {
-        unique_lock<mutex> locker(mtx_);
-        lineCount_++;
-        int n = snprintf(buff_.BeginWrite(), 128, "%d-%02d-%02d %02d:%02d:%02d.%06ld ",
-                    t.tm_year + 1900, t.tm_mon + 1, t.tm_mday,
-                    t.tm_hour, t.tm_min, t.tm_sec, now.tv_usec);
-                    
-        buff_.HasWritten(n);
-        AppendLogLevelTitle_(level);
-
-        va_start(vaList, format);
-        int m = vsnprintf(buff_.BeginWrite(), buff_.WritableBytes(), format, vaList);
-        va_end(vaList);
-
-        buff_.HasWritten(m);
-        buff_.Append("\n\0", 2);
-
-        if(isAsync_ && deque_ && !deque_->full()) {
-            deque_->push_back(buff_.RetrieveAllToStr());
-        } else {
-            fputs(buff_.Peek(), fp_);
+        lock_guard<mutex> locker(siteMtx_);
+        for(; sitesWritten_ < sites_.size(); sitesWritten_++) {
+            const LogSite* site = sites_[sitesWritten_];
+            binlog::RecordWriter w(rec, sizeof(rec));
+            w.Begin(binlog::REC_SITE);
+            w.Put<uint32_t>(sitesWritten_);
+            w.Put<uint8_t>(site->level);
+            w.Put<uint32_t>(site->line);
+            w.PutStr(site->file, strlen(site->file));
+            w.PutStr(site->format, strlen(site->format));
+            preamble_.append(rec, w.End());
         }
-        buff_.RetrieveAll();
+    }
+    if(withSync) {
+        binlog::RecordWriter w(rec, sizeof(rec));
+        w.Begin(binlog::REC_SYNC);
+        w.Put<uint64_t>(binlog::ReadTsc());
+        w.Put<uint64_t>(binlog::WallNs());
+        preamble_.append(rec, w.End());
     }
 }
 
-void Log::AppendLogLevelTitle_(int level) {
-    switch(level) {
-    case 0:
-        buff_.Append("[debug]: ", 9);
-        break;
-    case 1:
-        buff_.Append("[info] : ", 9);
-        break;
-    case 2:
-        buff_.Append("[warn] : ", 9);
-        break;
-    case 3:
-        buff_.Append("[error]: ", 9);
-        break;
-    default:
-        buff_.Append("[info] : ", 9);
-        break;
+size_t Log::DropNote_(uint64_t dropped, char* buf, size_t cap) {
+    if(binary_) {
+        static const LogSite site = { "log ring full, %lu lines dropped", __FILE__, __LINE__, 2 };
+        static const uint32_t siteId = RegisterSite(&site);
+        binlog::RecordWriter w(buf, cap);
+        w.Begin(binlog::REC_LOG);
+        w.Put<uint32_t>(siteId);
+        w.Put<uint64_t>(binlog::ReadTsc());
+        binlog::EncodeArgs(w, dropped);
+        return w.End();
     }
+    int n = FormatHead_(2, buf);
+    n += snprintf(buf + n, cap - n, "log ring full, %lu lines dropped\n", (unsigned long)dropped);
+    return n;
 }
 
 void Log::flush() {
-    if(isAsync_) { 
-        deque_->flush(); 
+    if(isAsync_) {
+        cond_.notify_one();
     }
-    fflush(fp_);
 }
 
 void Log::AsyncWrite_() {
-    string str = "";
-    while(deque_->pop(str)) {
+    vector<shared_ptr<LogRing>> rings;
+    while(true) {
+        bool closing;
+        {
+            unique_lock<mutex> locker(mtx_);
+            if(!isClose_) {
+                cond_.wait_for(locker, chrono::milliseconds(static_cast<int>(FLUSH_INTERVAL_MS)));
+            }
+            closing = isClose_;
+        }
+        {
+            lock_guard<mutex> locker(ringMtx_);
+            rings = rings_;
+        }
+        WriteBatch_(rings);
+        {
+            // 回收已经退出并且写完了的线程的环
+            lock_guard<mutex> locker(ringMtx_);
+            rings_.erase(remove_if(rings_.begin(), rings_.end(), [](const shared_ptr<LogRing>& ring) {
+                return ring->IsClosed() && ring->Empty();
+            }), rings_.end());
+        }
+        if(closing) { break; }
+    }
+}
+
+void Log::WriteBatch_(vector<shared_ptr<LogRing>>& rings) {
+    vector<struct iovec> iov;
+    vector<size_t> taken(rings.size(), 0);
+    iov.reserve(rings.size() * 2 + 1);
+    int lines = 0;
+    for(size_t i = 0; i < rings.size(); i++) {
+        const char* seg[2];
+        size_t segLen[2];
+        int cnt = rings[i]->Peek(seg, segLen, taken[i]);
+        for(int k = 0; k < cnt; k++) {
+            iov.push_back({ const_cast<char*>(seg[k]), segLen[k] });
+            lines += count(seg[k], seg[k] + segLen[k], '\n');
+        }
+    }
+    char note[128];
+    uint64_t dropped = dropped_.exchange(0, memory_order_relaxed);
+    if(dropped) {
+        iov.push_back({ note, DropNote_(dropped, note, sizeof(note)) });
+        lines++;
+    }
+    if(iov.empty()) { return; }
+
+    {
         lock_guard<mutex> locker(mtx_);
-        fputs(str.c_str(), fp_);
+        Rotate_();
+        // 二进制日志先写文件头、这一批用到的新调用点和时间同步记录
+        // 调用点一定在记录放进环之前登记，上面取完环之后再取调用点就不会漏
+        if(binary_) {
+            Preamble_(true);
+            iov.insert(iov.begin(), { const_cast<char*>(preamble_.data()), preamble_.size() });
+        }
+        size_t bytes = 0;
+        for(auto& v: iov) { bytes += v.iov_len; }
+        WriteAll_(iov.data(), iov.size());
+        lineCount_ += binary_ ? 0 : lines;
+        fileBytes_ += bytes;
+    }
+    for(size_t i = 0; i < rings.size(); i++) {
+        if(taken[i]) { rings[i]->Consume(taken[i]); }
+    }
+}
+
+void Log::WriteAll_(struct iovec* iov, int cnt) {
+    while(cnt > 0) {
+        ssize_t len = writev(fd_, iov, min(cnt, IOV_MAX));
+        if(len < 0) {
+            if(errno == EINTR) { continue; }
+            return;
+        }
+        while(cnt > 0 && static_cast<size_t>(len) >= iov->iov_len) {
+            len -= iov->iov_len;
+            iov++;
+            cnt--;
+        }
+        if(cnt > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + len;
+            iov->iov_len -= len;
+        }
     }
 }
 
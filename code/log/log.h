@@ -4,17 +4,37 @@
 #include <mutex>
 #include <string>
 #include <thread>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <condition_variable>
 #include <sys/time.h>
+#include <sys/uio.h>          // writev
 #include <string.h>
+#include <errno.h>
+#include <time.h>
 #include <stdarg.h>           // vastart va_end
 #include <assert.h>
+#include <fcntl.h>            // open
+#include <unistd.h>           // write, close
 #include <sys/stat.h>         //mkdir
-#include "blockqueue.h"
-#include "../buffer/buffer.h"
+#include "logring.h"
+#include "binlog.h"
 
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0     // 编译期的最低日志级别，低于它的LOG_*调用整个被编译掉
+#endif
+
+/**
+ * 日志，单例
+ * 异步模式下每个写日志的线程有自己的LogRing，格式化好的一行直接放进去，全程不加锁；
+ * 环满了就丢掉这一行并计数，写日志的线程永远不会因为磁盘慢而阻塞
+ * 后台线程定时（FLUSH_INTERVAL_MS）或者某个环用掉一半时被唤醒，把所有环里攒下的内容用一次writev写进文件
+ * 编译时定义LOG_BINARY则写二进制日志（格式见binlog.h），调用线程不做任何格式化，用tools/logdecode还原成文本
+*/
 class Log {
 public:
-    void init(int level, const char* path = "./log", 
+    void init(int level, const char* path = "./log",
                 const char* suffix =".log",
                 int maxQueueCapacity = 1024);
 
@@ -22,51 +42,106 @@ public:
     static void FlushLogThread();
 
     void write(int level, const char *format,...);
-    void flush();
+    void flush();   // 唤醒后台线程马上写一批
+
+    uint32_t RegisterSite(const LogSite* site);     // 每个调用点第一次执行时登记一次，返回编号
+
+    template<typename... Args>
+    void WriteBinary(uint32_t siteId, const Args&... args) {
+        char rec[LINE_SIZE];
+        binlog::RecordWriter w(rec, sizeof(rec));
+        w.Begin(binlog::REC_LOG);
+        w.Put<uint32_t>(siteId);
+        w.Put<uint64_t>(binlog::ReadTsc());
+        binlog::EncodeArgs(w, args...);
+        size_t len = w.End();
+        if(len == 0) {
+            dropTotal_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        Append_(rec, len);
+    }
+
+    int GetLevel() { return level_.load(std::memory_order_relaxed); }
+    void SetLevel(int level) { level_.store(level, std::memory_order_relaxed); }
+    bool IsOpen() { return isOpen_.load(std::memory_order_relaxed); }
+
+    uint64_t GetDropCount() const { return dropTotal_.load(std::memory_order_relaxed); }
 
-    int GetLevel();
-    void SetLevel(int level);
-    bool IsOpen() { return isOpen_; }
-    
 private:
     Log();
-    void AppendLogLevelTitle_(int level);
     virtual ~Log();
+    int FormatHead_(int level, char* buf);
+    void Append_(const char* data, size_t len);
+    void Preamble_(bool withSync);
+    size_t DropNote_(uint64_t dropped, char* buf, size_t cap);
+    LogRing* LocalRing_();
     void AsyncWrite_();
+    void WriteBatch_(std::vector<std::shared_ptr<LogRing>>& rings);
+    void WriteAll_(struct iovec* iov, int cnt);
+    void Rotate_();
 
 private:
     static const int LOG_PATH_LEN = 256;    // 日志路径的长度
     static const int LOG_NAME_LEN = 256;    // 日志的文件名称的长度
     static const int MAX_LINES = 50000;     // 日志文件里能保存的最大行数，超过50000行就开辟一个新的日志文件
+    static const int LINE_SIZE = 2048;      // 一行日志的最大长度，超出的部分截断
+    static const int LINE_BYTES = 256;      // 按平均一行的长度把maxQueueCapacity换算成环的字节数
+    static const int FLUSH_INTERVAL_MS = 100;
+    static const size_t MAX_BIN_BYTES = 64 << 20;   // 二进制日志没有行的概念，按字节数换文件
 
     const char* path_;
     const char* suffix_;
 
-    int MAX_LINES_;
-
-    int lineCount_;     // 当前已经写了多少行了
-    int toDay_;         // 今天的日期
+    int lineCount_;     // 当前文件已经写了多少行了
+    size_t fileBytes_;  // 当前文件已经写了多少字节
+    int fileIdx_;       // 当天的第几个文件
+    time_t dayEnd_;     // 今天结束的时间，到了就换新文件
 
-    bool isOpen_;
- 
-    Buffer buff_;
-    int level_;     // 日志的级别
+    std::atomic<bool> isOpen_;
+    std::atomic<int> level_;     // 日志的级别
     bool isAsync_;  // 是否异步
+    bool binary_;   // 是否写二进制日志，由LOG_BINARY决定
+
+    int fd_;        // 日志文件，只在后台线程（同步模式下持有mtx_）里写
+    size_t ringSize_;   // 每个线程的环的字节数
 
-    FILE* fp_;      // 文件指针，操作日志文件的
-    std::unique_ptr<BlockDeque<std::string>> deque_; 
+    std::mutex ringMtx_;    // 保护rings_，只在线程第一次写日志和后台线程取快照时用
+    std::vector<std::shared_ptr<LogRing>> rings_;
+    std::atomic<uint64_t> dropped_;     // 还没有报告的丢弃行数
+    std::atomic<uint64_t> dropTotal_;
+
+    std::mutex siteMtx_;    // 保护sites_
+    std::vector<const LogSite*> sites_;     // 下标就是调用点编号
+    size_t sitesWritten_;   // 当前文件里已经写过的调用点个数，换文件时清零
+    uint64_t ticksPerSec_;  // init时测出来的tsc频率
+    std::string preamble_;  // 每批数据前面的文件头、新调用点和时间同步记录
+
+    std::atomic<bool> isClose_;
     std::unique_ptr<std::thread> writeThread_;  // 写的线程
-    std::mutex mtx_;
+    std::mutex mtx_;    // 保护文件和lineCount_等状态
+    std::condition_variable cond_;
 };
 
+#ifdef LOG_BINARY
+#define LOG_BASE(level, format, ...) \
+    if (level >= LOG_MIN_LEVEL) {\
+        Log* log = Log::Instance();\
+        if (log->IsOpen() && log->GetLevel() <= level) {\
+            static const LogSite logSite = { format, __FILE__, __LINE__, level };\
+            static const uint32_t logSiteId = log->RegisterSite(&logSite);\
+            log->WriteBinary(logSiteId, ##__VA_ARGS__); \
+        }\
+    }
+#else
 #define LOG_BASE(level, format, ...) \
-    {\
+    if (level >= LOG_MIN_LEVEL) {\
         Log* log = Log::Instance();\
         if (log->IsOpen() && log->GetLevel() <= level) {\
             log->write(level, format, ##__VA_ARGS__); \
-            log->flush();\
         }\
-    } 
+    }
+#endif
 
 #define LOG_DEBUG(format, ...) LOG_BASE(0, format, ##__VA_ARGS__)
 #define LOG_INFO(format, ...)  LOG_BASE(1, format, ##__VA_ARGS__)
@@ -0,0 +1,74 @@
+#ifndef LOGRING_H
+#define LOGRING_H
+
+#include <atomic>
+#include <algorithm>
+#include <memory>
+#include <string.h>
+#include <assert.h>
+
+/**
+ * 单生产者单消费者的字节环形缓冲区，每个写日志的线程一个
+ * 生产者（写日志的线程）只移动head_，消费者（后台写线程）只移动tail_，两边都不加锁
+ * 后台线程直接把[tail_, head_)这段（最多绕回一次，两段）交给writev，不需要再拷贝一次
+*/
+class LogRing {
+public:
+    explicit LogRing(size_t capacity): mask_(capacity - 1), buf_(new char[capacity]), head_(0), tail_(0), closed_(false) {
+        assert(capacity >= 2 && (capacity & (capacity - 1)) == 0);  // 容量必须是2的幂
+    }
+
+    // 生产者调用，空间不够时不等待，直接返回false；usedAfter返回放进去之后已用的字节数
+    bool Push(const char* data, size_t len, size_t& usedAfter) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t tail = tail_.load(std::memory_order_acquire);
+        if(Capacity() - (head - tail) < len) { return false; }
+        size_t off = head & mask_;
+        size_t first = std::min(len, Capacity() - off);
+        memcpy(buf_.get() + off, data, first);
+        memcpy(buf_.get(), data + first, len - first);
+        head_.store(head + len, std::memory_order_release);
+        usedAfter = head + len - tail;
+        return true;
+    }
+
+    // 消费者调用，取出当前可读的部分，最多两段，返回段数；读完之后调用Consume
+    int Peek(const char* seg[2], size_t segLen[2], size_t& total) const {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        total = head_.load(std::memory_order_acquire) - tail;
+        if(total == 0) { return 0; }
+        size_t off = tail & mask_;
+        size_t first = std::min(total, Capacity() - off);
+        seg[0] = buf_.get() + off;
+        segLen[0] = first;
+        if(first == total) { return 1; }
+        seg[1] = buf_.get();
+        segLen[1] = total - first;
+        return 2;
+    }
+
+    void Consume(size_t len) {
+        tail_.store(tail_.load(std::memory_order_relaxed) + len, std::memory_order_release);
+    }
+
+    bool Empty() const {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_relaxed);
+    }
+
+    size_t Capacity() const { return mask_ + 1; }
+
+    // 生产者线程退出时标记，后台线程写完剩下的内容后回收
+    void Close() { closed_.store(true, std::memory_order_release); }
+    bool IsClosed() const { return closed_.load(std::memory_order_acquire); }
+
+private:
+    const size_t mask_;
+    std::unique_ptr<char[]> buf_;
+    char pad0_[64];     // head_和tail_分开在不同的cache line
+    std::atomic<size_t> head_;
+    char pad1_[64];
+    std::atomic<size_t> tail_;
+    std::atomic<bool> closed_;
+};
+
+#endif //LOGRING_H
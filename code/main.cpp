@@ -8,7 +8,11 @@ int main() {
     WebServer server(
         1316, 3, 60000, false,             /* 端口 ET模式 timeoutMs 优雅退出  */
         3306, "root", "root", "webserver", /* Mysql配置 */
-        12, 6, true, 1, 1024);             /* 连接池数量 线程池数量 日志开关 日志等级 日志异步队列容量 */
+        12, 6, true, 1, 1024,              /* 连接池数量 线程池数量 日志开关 日志等级 日志异步队列容量 */
+        0, false, false,                   /* 从Reactor数量（0为单Reactor+线程池） SO_REUSEPORT分片监听 按CPU分流 */
+        false, -1, 0,                      /* 使用io_uring（内核不支持时退回epoll） sendfile阈值（字节，-1不使用） 文件缓存字节数（0不缓存） */
+        nullptr, 0, 1 << 20);              /* 用户文件（nullptr用MySQL存用户，给路径就用本地哈希文件，不连数据库）
+                                              静态文件的Cache-Control max-age（秒，0为no-cache，每次都用ETag验证） 请求体上限（字节） */
     server.Start();
 } 
   
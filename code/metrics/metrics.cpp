@@ -0,0 +1,180 @@
+#include "metrics.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <algorithm>
+
+using namespace std;
+
+const int Metrics::STATUS_CODES[] = { 200, 206, 304, 400, 403, 404, 413, 416, 500, 503, 0 };
+
+Metrics::MetricsShard::MetricsShard() {
+    for(auto& c: counters) { c.store(0, memory_order_relaxed); }
+    for(auto& c: status) { c.store(0, memory_order_relaxed); }
+    for(auto& h: hists) {
+        for(auto& b: h.buckets) { b.store(0, memory_order_relaxed); }
+        h.count.store(0, memory_order_relaxed);
+        h.sum.store(0, memory_order_relaxed);
+    }
+}
+
+Metrics* Metrics::Instance() {
+    static Metrics inst;
+    return &inst;
+}
+
+Metrics::MetricsShard* Metrics::NewShard_() {
+    MetricsShard* shard = new MetricsShard();
+    lock_guard<mutex> locker(mtx_);
+    shards_.emplace_back(shard);
+    return shard;
+}
+
+void Metrics::Status(int code) {
+    int idx = 0;
+    while(idx < STATUS_NUM - 1 && STATUS_CODES[idx] != code) { idx++; }
+    Add_(Local_()->status[idx], 1);
+}
+
+int Metrics::BucketIndex(uint64_t us) {
+    if(us < static_cast<uint64_t>(SUB_COUNT)) {
+        return us;
+    }
+    int pow = 63 - __builtin_clzll(us);
+    if(pow > MAX_POW) {
+        return BUCKET_NUM - 1;
+    }
+    int sub = (us >> (pow - SUB_BITS)) & (SUB_COUNT - 1);
+    return (pow - SUB_BITS + 1) * SUB_COUNT + sub;
+}
+
+uint64_t Metrics::BucketUpper(int idx) {
+    if(idx < SUB_COUNT) {
+        return idx + 1;
+    }
+    int pow = idx / SUB_COUNT + SUB_BITS - 1;
+    int sub = idx % SUB_COUNT;
+    return static_cast<uint64_t>(SUB_COUNT + sub + 1) << (pow - SUB_BITS);
+}
+
+void Metrics::Observe(Histogram hist, uint64_t us, uint64_t n) {
+    HistogramData& h = Local_()->hists[hist];
+    Add_(h.buckets[BucketIndex(us)], n);
+    Add_(h.count, n);
+    Add_(h.sum, us * n);
+}
+
+void Metrics::AddGauge(const string& name, const string& help, const string& type, function<double()> func) {
+    lock_guard<mutex> locker(mtx_);
+    gauges_.push_back({ name, help, type, move(func) });
+}
+
+void Metrics::ClearGauges() {
+    lock_guard<mutex> locker(mtx_);
+    gauges_.clear();
+}
+
+static void AppendLine(string& out, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void AppendLine(string& out, const char* fmt, ...) {
+    char line[256];
+    va_list vaList;
+    va_start(vaList, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, vaList);
+    va_end(vaList);
+    out.append(line, min<int>(n, sizeof(line) - 1));
+}
+
+static void AppendFamily(string& out, const char* name, const char* help, const char* type) {
+    AppendLine(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void Metrics::RenderHistogram_(string& out, const char* name, const char* help, Histogram hist) {
+    uint64_t buckets[BUCKET_NUM] = { 0 };
+    uint64_t count = 0, sum = 0;
+    for(auto& shard: shards_) {
+        HistogramData& h = shard->hists[hist];
+        for(int i = 0; i < BUCKET_NUM; i++) {
+            buckets[i] += h.buckets[i].load(memory_order_relaxed);
+        }
+        count += h.count.load(memory_order_relaxed);
+        sum += h.sum.load(memory_order_relaxed);
+    }
+    // 按2的幂输出累计的桶，桶的集合每次抓取都一样
+    AppendFamily(out, name, help, "histogram");
+    uint64_t cumulative = 0;
+    for(int i = 0; i < BUCKET_NUM; i++) {
+        cumulative += buckets[i];
+        if(i % SUB_COUNT == SUB_COUNT - 1) {
+            AppendLine(out, "%s_bucket{le=\"%g\"} %lu\n", name, BucketUpper(i) / 1e6, (unsigned long)cumulative);
+        }
+    }
+    AppendLine(out, "%s_bucket{le=\"+Inf\"} %lu\n", name, (unsigned long)count);
+    AppendLine(out, "%s_sum %g\n", name, sum / 1e6);
+    AppendLine(out, "%s_count %lu\n", name, (unsigned long)count);
+
+    // 用细分的桶算分位数，取桶的上界
+    static const double QUANTILES[] = { 0.5, 0.9, 0.99, 0.999 };
+    string qname = string(name) + "_quantile";
+    AppendFamily(out, qname.c_str(), "Latency quantiles from the fine-grained histogram buckets.", "gauge");
+    for(double q: QUANTILES) {
+        uint64_t rank = static_cast<uint64_t>(q * count + 0.5);
+        uint64_t seen = 0;
+        double val = 0;
+        for(int i = 0; i < BUCKET_NUM && count > 0; i++) {
+            seen += buckets[i];
+            if(seen >= rank && seen > 0) {
+                val = BucketUpper(i) / 1e6;
+                break;
+            }
+        }
+        AppendLine(out, "%s{quantile=\"%g\"} %g\n", qname.c_str(), q, val);
+    }
+}
+
+string Metrics::Render() {
+    static const char* COUNTER_INFO[COUNTER_NUM][2] = {
+        { "tinywebserver_connections_accepted_total", "Accepted client connections." },
+        { "tinywebserver_connections_closed_total", "Closed client connections." },
+        { "tinywebserver_bytes_read_total", "Bytes read from client sockets." },
+        { "tinywebserver_bytes_sent_total", "Bytes written to client sockets, including sendfile." },
+        { "tinywebserver_socket_reads_total", "Reads from client sockets that returned data." },
+        { "tinywebserver_socket_read_overflows_total", "Socket reads that spilled past the buffer chunk into the per-thread scratch." },
+    };
+    Local_();   // 先建好本线程的分片，下面持有mtx_时不能再去建
+    string out;
+    out.reserve(8192);
+    lock_guard<mutex> locker(mtx_);
+
+    for(int c = 0; c < COUNTER_NUM; c++) {
+        uint64_t total = 0;
+        for(auto& shard: shards_) {
+            total += shard->counters[c].load(memory_order_relaxed);
+        }
+        AppendFamily(out, COUNTER_INFO[c][0], COUNTER_INFO[c][1], "counter");
+        AppendLine(out, "%s %lu\n", COUNTER_INFO[c][0], (unsigned long)total);
+    }
+
+    AppendFamily(out, "tinywebserver_responses_total", "Responses by status code.", "counter");
+    for(int s = 0; s < STATUS_NUM; s++) {
+        uint64_t total = 0;
+        for(auto& shard: shards_) {
+            total += shard->status[s].load(memory_order_relaxed);
+        }
+        if(STATUS_CODES[s]) {
+            AppendLine(out, "tinywebserver_responses_total{code=\"%d\"} %lu\n", STATUS_CODES[s], (unsigned long)total);
+        } else {
+            AppendLine(out, "tinywebserver_responses_total{code=\"other\"} %lu\n", (unsigned long)total);
+        }
+    }
+
+    RenderHistogram_(out, "tinywebserver_request_duration_seconds",
+                     "Time from a request being parsed to its response being fully written.", REQUEST_LATENCY);
+    RenderHistogram_(out, "tinywebserver_sql_query_duration_seconds",
+                     "Time spent in user verification queries.", SQL_LATENCY);
+
+    for(auto& gauge: gauges_) {
+        AppendFamily(out, gauge.name.c_str(), gauge.help.c_str(), gauge.type.c_str());
+        AppendLine(out, "%s %.17g\n", gauge.name.c_str(), gauge.func());
+    }
+    return out;
+}
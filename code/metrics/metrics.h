@@ -0,0 +1,122 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <time.h>       // clock_gettime
+
+/**
+ * 运行指标，单例
+ * 计数器和延迟直方图每个线程一份（MetricsShard），只有自己的线程写，用relaxed的load+store，没有锁也没有原子的读改写，
+ * 不同线程的分片在不同的cache line上；只有抓取（Render）时才把所有分片加起来
+ * 连接数、队列长度这类当前值用AddGauge注册回调，抓取时才去读
+ * Render输出Prometheus的文本格式，由HttpConn在metricsPath上返回
+*/
+class Metrics {
+public:
+    enum Counter {
+        CONN_ACCEPTED,
+        CONN_CLOSED,
+        BYTES_READ,
+        BYTES_SENT,
+        SOCKET_READS,       // 读到数据的read调用
+        READ_OVERFLOWS,     // 其中缓冲区的块装不下、用到线程暂存区的
+        COUNTER_NUM,
+    };
+
+    enum Histogram {
+        REQUEST_LATENCY,    // 请求解析完到响应全部写进socket
+        SQL_LATENCY,        // UserVerify里的数据库查询
+        HISTOGRAM_NUM,
+    };
+
+    // 统计的状态码，其他的都算在最后一个里
+    static const int STATUS_CODES[];
+    static const int STATUS_NUM = 11;
+
+    /* HDR风格的直方图：每个2的幂区间再分成8份，相对误差不超过12.5%，单位微秒，最大约67秒 */
+    static const int SUB_BITS = 3;
+    static const int SUB_COUNT = 1 << SUB_BITS;
+    static const int MAX_POW = 26;
+    static const int BUCKET_NUM = (MAX_POW - SUB_BITS + 2) * SUB_COUNT;
+
+    static Metrics* Instance();
+
+    static void Inc(Counter counter, uint64_t n = 1) {
+        Add_(Local_()->counters[counter], n);
+    }
+
+    static void Status(int code);
+
+    static void Observe(Histogram hist, uint64_t us, uint64_t n = 1);
+
+    static uint64_t NowUs() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+    }
+
+    // 抓取时才计算的值，type是"gauge"或者"counter"
+    void AddGauge(const std::string& name, const std::string& help, const std::string& type,
+                  std::function<double()> func);
+    void ClearGauges();
+
+    std::string Render();
+
+    static int BucketIndex(uint64_t us);
+    static uint64_t BucketUpper(int idx);   // 这个桶的上界（不含）
+
+private:
+    typedef std::atomic<uint64_t> Cell;
+
+    struct HistogramData {
+        Cell buckets[BUCKET_NUM];
+        Cell count;
+        Cell sum;
+    };
+
+    struct MetricsShard {
+        char pad0[64];      // 和别的分片、别的对象隔开cache line
+        Cell counters[COUNTER_NUM];
+        Cell status[STATUS_NUM];
+        HistogramData hists[HISTOGRAM_NUM];
+        char pad1[64];
+        MetricsShard();
+    };
+
+    struct Gauge {
+        std::string name;
+        std::string help;
+        std::string type;
+        std::function<double()> func;
+    };
+
+    Metrics() = default;
+    ~Metrics() = default;
+
+    // 只有所属线程写，不需要原子的读改写
+    static void Add_(Cell& cell, uint64_t n) {
+        cell.store(cell.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    static MetricsShard* Local_() {
+        static thread_local MetricsShard* local = nullptr;
+        if(!local) { local = Instance()->NewShard_(); }
+        return local;
+    }
+
+    MetricsShard* NewShard_();
+    void RenderHistogram_(std::string& out, const char* name, const char* help, Histogram hist);
+
+    std::mutex mtx_;    // 保护shards_和gauges_，只在线程第一次记录和抓取时用
+    // 线程退出后分片也保留，计数不会丢；服务器的线程数是固定的
+    std::vector<std::unique_ptr<MetricsShard>> shards_;
+    std::vector<Gauge> gauges_;
+};
+
+#endif //METRICS_H
@@ -1,9 +1,20 @@
 #include "sqlconnpool.h"
+#include <vector>
+#include <time.h>
 using namespace std;
 
-SqlConnPool::SqlConnPool() {
+const char* SqlConnPool::STMT_SQL[STMT_NUM] = {
+    "SELECT password FROM user WHERE username = ? LIMIT 1",
+    "INSERT INTO user(username, password) VALUES(?, ?)",
+};
+
+SqlConnPool::SqlConnPool(): busyCnt_(0), createCnt_(0), reconnectCnt_(0) {
+    MAX_CONN_ = 0;
+    minConn_ = 0;
     useCount_ = 0;
-    freeCount_ = 0;
+    demand_ = 0;
+    isClose_ = true;
+    port_ = 0;
 }
 
 /**
@@ -12,55 +23,166 @@ SqlConnPool::SqlConnPool() {
  * C++11中可以保证static变量是多线程安全的，在底层实现了加锁操作，所以不需要像以前那样自己写加锁操作
  * 由于是一个static对象，可以保证对象只生成一次；
  * 程序结束时，系统会调用对应的析构函数；如果是new出来的对象，程序结束时，系统不会自动调用析构函数
-*/   
+*/
 SqlConnPool* SqlConnPool::Instance() {
     static SqlConnPool connPool;
     return &connPool;
 }
 
+uint64_t SqlConnPool::NowMs_() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
 // 初始化
 void SqlConnPool::Init(const char* host, int port,
             const char* user,const char* pwd, const char* dbName,
-            int connSize = 10) {    // 默认池子里开始创建10个连接
+            int connSize, int maxConnSize) {
     assert(connSize > 0);
-    for (int i = 0; i < connSize; i++) {
-        // 可以认为就是MYSQL的一个连接
-        MYSQL *sql = nullptr;
-        // 初始化
-        sql = mysql_init(sql);
-        if (!sql) {
-            LOG_ERROR("MySql init error!");
-            assert(sql);
+    host_ = host;
+    user_ = user;
+    pwd_ = pwd;
+    dbName_ = dbName;
+    port_ = port;
+    minConn_ = connSize;
+    MAX_CONN_ = max(maxConnSize > 0 ? maxConnSize : 2 * connSize, connSize);
+    demand_ = 0;
+    isClose_ = false;
+    // 初始化信号量
+    sem_init(&semId_, 0, 0);
+
+    // 多线程用客户端库之前要先初始化一次
+    mysql_library_init(0, nullptr, nullptr);
+    // 建连接主要是等网络往返，几个线程并行建，启动时间不再是连接数乘以往返时间
+    atomic<int> next(0);
+    vector<thread> threads;
+    int threadNum = min(connSize, static_cast<int>(WARMUP_THREADS));
+    for(int t = 0; t < threadNum; t++) {
+        threads.emplace_back([this, &next, connSize] {
+            while(next.fetch_add(1) < connSize) {
+                MYSQL* sql = Connect_();
+                // 连不上的不放进池子，后台线程以后再补
+                if(sql) {
+                    {
+                        lock_guard<mutex> locker(mtx_);
+                        useCount_++;
+                    }
+                    Push_(sql, NowMs_(), false);
+                }
+            }
+            mysql_thread_end();
+        });
+    }
+    for(auto& th: threads) { th.join(); }
+    LOG_INFO("SqlConnPool warm up %d/%d connections, max %d", GetConnCount(), minConn_, MAX_CONN_);
+    keeper_ = thread(&SqlConnPool::Keeper_, this);
+}
+
+MYSQL* SqlConnPool::Connect_() {
+    // 初始化
+    MYSQL *sql = mysql_init(nullptr);
+    if (!sql) {
+        LOG_ERROR("MySql init error!");
+        return nullptr;
+    }
+#if SQL_NONBLOCK
+    // MariaDB Connector/C：打开非阻塞接口（*_start/*_cont），要在连接之前设置
+    mysql_options(sql, MYSQL_OPT_NONBLOCK, 0);
+#endif
+    // 连接数据库
+    if (!mysql_real_connect(sql, host_.c_str(),
+                            user_.c_str(), pwd_.c_str(),
+                            dbName_.c_str(), port_, nullptr, 0)) {
+        LOG_ERROR("MySql Connect error!");
+        mysql_close(sql);
+        return nullptr;
+    }
+    // 语句在服务端解析一次，之后每次只发参数（二进制协议）
+    array<MYSQL_STMT*, STMT_NUM> stmts;
+    for(int i = 0; i < STMT_NUM; i++) {
+        stmts[i] = mysql_stmt_init(sql);
+        if(stmts[i] && mysql_stmt_prepare(stmts[i], STMT_SQL[i], strlen(STMT_SQL[i])) != 0) {
+            LOG_ERROR("MySql prepare error: %s", mysql_stmt_error(stmts[i]));
+            mysql_stmt_close(stmts[i]);
+            stmts[i] = nullptr;
         }
-        // 连接数据库
-        sql = mysql_real_connect(sql, host,
-                                 user, pwd,
-                                 dbName, port, nullptr, 0);
-        if (!sql) {
-            LOG_ERROR("MySql Connect error!");
+    }
+    lock_guard<mutex> locker(mtx_);
+    stmts_[sql] = stmts;
+    return sql;
+}
+
+void SqlConnPool::Close_(MYSQL* sql) {
+    assert(sql);
+    array<MYSQL_STMT*, STMT_NUM> stmts;
+    stmts.fill(nullptr);
+    {
+        lock_guard<mutex> locker(mtx_);
+        auto it = stmts_.find(sql);
+        if(it != stmts_.end()) {
+            stmts = it->second;
+            stmts_.erase(it);
         }
-        // 放到连接队列里面
-        connQue_.push(sql);
     }
-    MAX_CONN_ = connSize;
-    // 初始化信号量
-    sem_init(&semId_, 0, MAX_CONN_);
+    for(MYSQL_STMT* stmt: stmts) {
+        if(stmt) { mysql_stmt_close(stmt); }
+    }
+    mysql_close(sql);
+}
+
+MYSQL_STMT* SqlConnPool::GetStmt(MYSQL* sql, SqlStmt id) {
+    assert(sql && id < STMT_NUM);
+    lock_guard<mutex> locker(mtx_);
+    auto it = stmts_.find(sql);
+    return it == stmts_.end() ? nullptr : it->second[id];
+}
+
+void SqlConnPool::Push_(MYSQL* sql, uint64_t lastUsed, bool front) {
+    {
+        lock_guard<mutex> locker(mtx_);
+        IdleConn item = { sql, lastUsed, NowMs_() };
+        if(front) { connQue_.push_front(item); }
+        else { connQue_.push_back(item); }
+    }
+    // semId_加一，连接池里面连接多了一个
+    sem_post(&semId_);
+}
+
+bool SqlConnPool::Grow_() {
+    lock_guard<mutex> locker(mtx_);
+    if(isClose_ || (useCount_ >= minConn_ && demand_ == 0)) { return false; }
+    if(useCount_ >= MAX_CONN_) {
+        // 到上限了，缺口补不上，等别人归还
+        demand_ = 0;
+        return false;
+    }
+    useCount_++;
+    if(demand_ > 0) { demand_--; }
+    return true;
 }
 
 // 获取一个MySQL的连接
 MYSQL* SqlConnPool::GetConn() {
+    if(isClose_) { return nullptr; }
     MYSQL *sql = nullptr;
-    if(connQue_.empty()){
+    if(sem_trywait(&semId_) != 0) {
+        // 没有空闲的：不在这里建连接也不等，记下缺口叫醒后台线程，这次请求由调用方回503
+        busyCnt_.fetch_add(1, memory_order_relaxed);
+        {
+            lock_guard<mutex> locker(mtx_);
+            if(useCount_ + demand_ < MAX_CONN_) { demand_++; }
+        }
+        keeperCond_.notify_one();
         LOG_WARN("SqlConnPool busy!");
         return nullptr;
     }
-    // 如果大于0就执行，等于0代表没有没有可以取的连接，就在这等待
-    sem_wait(&semId_);
     {
         lock_guard<mutex> locker(mtx_);
-        // 取到数据就拿出来第一个，移除掉第一个
-        sql = connQue_.front();
-        connQue_.pop();
+        // 信号量保证队列里至少有一个；拿最近归还的
+        assert(!connQue_.empty());
+        sql = connQue_.back().sql;
+        connQue_.pop_back();
     }
     return sql;
 }
@@ -68,23 +190,115 @@ MYSQL* SqlConnPool::GetConn() {
 // 释放一个数据库连接（不是真的释放，是放到池子里）
 void SqlConnPool::FreeConn(MYSQL* sql) {
     assert(sql);
-    lock_guard<mutex> locker(mtx_);
-    // 放到池子里面
-    connQue_.push(sql);
-    // semId_加一，连接池里面连接多了一个
-    sem_post(&semId_);
+    if(isClose_) {
+        // 池子已经关了，借出去的连接还回来时直接关掉
+        DiscardConn(sql);
+        return;
+    }
+    Push_(sql, NowMs_(), false);
+}
+
+void SqlConnPool::DiscardConn(MYSQL* sql) {
+    assert(sql);
+    Close_(sql);
+    {
+        lock_guard<mutex> locker(mtx_);
+        useCount_--;
+    }
+    // 少于最小连接数时后台线程会补上，不在调用线程（可能是事件循环）里重连
+    keeperCond_.notify_one();
+}
+
+void SqlConnPool::Keeper_() {
+    while(true) {
+        {
+            unique_lock<mutex> locker(mtx_);
+            // 有缺口时不等，接着加连接
+            if(demand_ == 0 && !isClose_) {
+                keeperCond_.wait_for(locker, chrono::milliseconds(static_cast<int>(CHECK_INTERVAL_MS)));
+            }
+            if(isClose_) { break; }
+        }
+        // 补足最小连接数，再按缺口加连接
+        while(Grow_()) {
+            MYSQL* sql = Connect_();
+            if(!sql) {
+                lock_guard<mutex> locker(mtx_);
+                useCount_--;
+                demand_ = 0;
+                break;      // 数据库还连不上，下次再试
+            }
+            createCnt_.fetch_add(1, memory_order_relaxed);
+            Push_(sql, NowMs_(), true);
+        }
+        CheckIdle_();
+    }
+    mysql_thread_end();
+}
+
+// 从队头（最久没用的）开始，把要回收或者要ping的连接取出来，和GetConn一样先占信号量
+void SqlConnPool::CheckIdle_() {
+    uint64_t now = NowMs_();
+    vector<IdleConn> items;
+    {
+        lock_guard<mutex> locker(mtx_);
+        int extra = useCount_ - minConn_;
+        for(auto it = connQue_.begin(); it != connQue_.end();) {
+            bool close = extra > 0 && now - it->lastUsed >= IDLE_CLOSE_MS;
+            bool ping = now - it->lastCheck >= PING_INTERVAL_MS;
+            if(!close && !ping) {
+                ++it;
+                continue;
+            }
+            if(sem_trywait(&semId_) != 0) { break; }
+            if(close) { extra--; }
+            items.push_back(*it);
+            it = connQue_.erase(it);
+        }
+    }
+    for(IdleConn& item: items) {
+        if(now - item.lastUsed >= IDLE_CLOSE_MS && GetConnCount() > minConn_) {
+            LOG_DEBUG("SqlConnPool close idle connection");
+            DiscardConn(item.sql);
+            continue;
+        }
+        if(mysql_ping(item.sql) != 0) {
+            // 断了就重连，新连接上重新准备语句
+            LOG_WARN("SqlConnPool ping error, reconnect");
+            reconnectCnt_.fetch_add(1, memory_order_relaxed);
+            Close_(item.sql);
+            item.sql = Connect_();
+            if(!item.sql) {
+                lock_guard<mutex> locker(mtx_);
+                useCount_--;
+                continue;
+            }
+        }
+        Push_(item.sql, item.lastUsed, true);
+    }
 }
 
 // 关闭池子
-void SqlConnPool::ClosePool() { 
-    lock_guard<mutex> locker(mtx_);
-    while(!connQue_.empty()) {
-        auto item = connQue_.front();
-        connQue_.pop();
-        mysql_close(item);
+void SqlConnPool::ClosePool() {
+    {
+        lock_guard<mutex> locker(mtx_);
+        if(isClose_) { return; }
+        isClose_ = true;
+    }
+    keeperCond_.notify_one();
+    if(keeper_.joinable()) { keeper_.join(); }
+    while(sem_trywait(&semId_) == 0) {
+        MYSQL* sql = nullptr;
+        {
+            lock_guard<mutex> locker(mtx_);
+            sql = connQue_.front().sql;
+            connQue_.pop_front();
+            useCount_--;
+        }
+        Close_(sql);
     }
     // 关闭MySQL整体的资源
-    mysql_library_end();        
+    mysql_library_end();
 }
 
 // 获取空闲的用户的数量
@@ -93,6 +307,11 @@ int SqlConnPool::GetFreeConnCount() {
     return connQue_.size();
 }
 
+int SqlConnPool::GetConnCount() {
+    lock_guard<mutex> locker(mtx_);
+    return useCount_;
+}
+
 SqlConnPool::~SqlConnPool() {
     ClosePool();
 }
@@ -3,44 +3,117 @@
 
 #include <mysql/mysql.h>
 #include <string>
-#include <queue>
+#include <deque>
+#include <array>
+#include <unordered_map>
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
 #include <semaphore.h>
 #include <thread>
 #include "../log/log.h"
 
+/**
+ * 非阻塞查询（mysql_stmt_execute_start/cont）只有MariaDB Connector/C有，Oracle的libmysqlclient没有
+ * 链到没有它的库上查询会阻塞事件循环，所以默认找不到就编译失败；
+ * 确实只能用libmysqlclient时make SQL_BLOCKING=1，明确退回阻塞查询
+*/
+#if defined(MYSQL_WAIT_READ)
+#define SQL_NONBLOCK 1
+#elif defined(SQL_BLOCKING)
+#define SQL_NONBLOCK 0
+#else
+#error "mysql.h is not MariaDB Connector/C (no MYSQL_WAIT_READ): install libmariadb-dev, or build with SQL_BLOCKING=1 to use blocking queries"
+#endif
+
 /**
  * 也是一个生产者消费者模型，和线程池一样
  * 原理也是，在一开始就创建出一些连接对象出来，要用的时候就直接从池子里面那一个连接对象去用就行了
  * 不用了以后就放到池子里面，不断开它，下一次可以继续去使用
+ *
+ * 连接数在[minConn, maxConn]之间伸缩：启动时并行建好minConn个，之后建连接、ping、重连、回收都在后台线程里做
+ * 取连接只是try：调用方可能是事件循环，不能在它里面建连接（TCP握手、认证、准备语句），也不能等别人归还；
+ * 没有空闲连接时马上返回nullptr，同时记一次缺口，后台线程醒来按缺口加连接（不超过maxConn）
+ * 空闲太久的多余连接由后台线程关掉，空闲的连接定期ping，断了就重连（重新准备语句）
+ * 信号量的值就是空闲连接数
+ * 空闲连接后进先出，常用的几个一直是热的，不常用的沉到队头，方便回收
 */
 class SqlConnPool {
 public:
+    // 每个连接上预处理好的语句，下标对应STMT_SQL
+    enum SqlStmt {
+        STMT_SELECT_USER,   // 按用户名查密码
+        STMT_INSERT_USER,   // 注册新用户
+        STMT_NUM,
+    };
+    static const char* STMT_SQL[STMT_NUM];
+
     static SqlConnPool *Instance();     // 提供一个方法访问静态实例（单例模式）
 
-    MYSQL *GetConn();   // 获取一个MySQL的连接
+    MYSQL *GetConn();   // 取一个空闲的MySQL连接，不阻塞，没有空闲的返回nullptr
     void FreeConn(MYSQL * conn);    // 释放一个数据库连接（不是真的释放，是放到池子里）
+    void DiscardConn(MYSQL * conn); // 连接状态不确定（非阻塞查询做到一半放弃了），关掉它，缺的连接以后再补
     int GetFreeConnCount();     // 获取空闲的用户的数量
+    int GetConnCount();         // 当前的连接总数（空闲的加上借出去的）
+    // 和连接一起拿到的预处理语句，连接建立时准备好，重连后换成新连接上的；准备失败时返回nullptr
+    MYSQL_STMT* GetStmt(MYSQL* conn, SqlStmt id);
+
+    // 取连接的统计
+    uint64_t GetBusyCount() const { return busyCnt_.load(std::memory_order_relaxed); }
+    uint64_t GetCreateCount() const { return createCnt_.load(std::memory_order_relaxed); }
+    uint64_t GetReconnectCount() const { return reconnectCnt_.load(std::memory_order_relaxed); }
 
-    // 初始化
+    // 初始化，maxConnSize为0时取connSize的两倍
     void Init(const char* host, int port,
-              const char* user,const char* pwd, 
-              const char* dbName, int connSize);
-              
+              const char* user,const char* pwd,
+              const char* dbName, int connSize,
+              int maxConnSize = 0);
+
     void ClosePool();   // 关闭池子
 
+    static const int CHECK_INTERVAL_MS = 1000;  // 后台线程多久检查一次
+    static const int PING_INTERVAL_MS = 30000;  // 空闲多久的连接要ping一下
+    static const int IDLE_CLOSE_MS = 60000;     // 超过minConn的连接空闲多久关掉
+    static const int WARMUP_THREADS = 8;        // 启动时并行建连接的线程数
+
 private:
     // 单例模式，所以构造函数私有化
     SqlConnPool();  // 构造函数
     ~SqlConnPool(); // 析构函数
 
+    struct IdleConn {
+        MYSQL* sql;
+        uint64_t lastUsed;      // 上次归还的时间，毫秒
+        uint64_t lastCheck;     // 上次ping（或者归还）的时间
+    };
+
+    MYSQL* Connect_();  // 新建一个连接并准备好语句，失败返回nullptr
+    void Close_(MYSQL* sql);    // 关闭连接和它上面的语句
+    void Push_(MYSQL* sql, uint64_t lastUsed, bool front);     // 放回空闲队列，信号量加一
+    bool Grow_();       // 少于最小连接数或者有缺口、又没到上限时占一个名额
+    void Keeper_();     // 后台线程：补足最小连接数、按缺口加连接、回收空闲连接、ping
+    void CheckIdle_();
+    static uint64_t NowMs_();
+
     int MAX_CONN_;  // 最大连接数
-    int useCount_;  // 当前的用户数
-    int freeCount_; // 空闲的用户数（还可以连接几个用户）
+    int minConn_;   // 最小连接数
+    int useCount_;  // 当前的连接总数（包括正在建立的）
+    int demand_;    // 取不到连接的次数里还没补上的，后台线程按它加连接
+    bool isClose_;
 
-    std::queue<MYSQL *> connQue_;   // 队列（MySQL *），用来操作MySQL数据库的
+    std::string host_, user_, pwd_, dbName_;   // 连接参数，重连时用
+    int port_;
+
+    std::deque<IdleConn> connQue_;  // 空闲连接，队尾是最近归还的
+    std::unordered_map<MYSQL*, std::array<MYSQL_STMT*, STMT_NUM>> stmts_;  // 每个连接上的预处理语句
     std::mutex mtx_;    // 互斥锁
-    sem_t semId_;   // 信号量
+    sem_t semId_;   // 信号量，值等于空闲连接数
+    std::condition_variable keeperCond_;
+    std::thread keeper_;
+
+    std::atomic<uint64_t> busyCnt_;     // 没有空闲连接、返回nullptr的次数
+    std::atomic<uint64_t> createCnt_;   // 启动以后新建的连接数
+    std::atomic<uint64_t> reconnectCnt_;    // ping失败重连的次数
 };
 
 
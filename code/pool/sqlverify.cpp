@@ -0,0 +1,227 @@
+#include "sqlverify.h"
+#include <mysql/mysqld_error.h>     // ER_DUP_ENTRY
+#include "../metrics/metrics.h"
+using namespace std;
+
+SqlVerify::SqlVerify(const string& name, const string& pwd, bool isLogin):
+    name_(name), pwd_(pwd), isLogin_(isLogin), result_(false), unavailable_(false), step_(SELECT),
+    sql_(nullptr), stmt_(nullptr), broken_(false), fd_(-1), wait_(0), err_(0), start_(0),
+    columnLen_(0) {
+    memset(params_, 0, sizeof(params_));
+    memset(&column_, 0, sizeof(column_));
+    paramLen_[0] = paramLen_[1] = 0;
+    columnBuf_[0] = '\0';
+}
+
+SqlVerify::~SqlVerify() {
+    if(!sql_) { return; }
+    if(step_ == DONE && !broken_) {
+        if(stmt_) { mysql_stmt_free_result(stmt_); }
+        SqlConnPool::Instance()->FreeConn(sql_);
+    } else {
+        // 查询做到一半或者出错了，连接上可能还有没读完的结果，不能给别人用
+        LOG_WARN("Verify name:%s %s, replace sql connection", name_.c_str(), broken_ ? "error" : "abandoned");
+        SqlConnPool::Instance()->DiscardConn(sql_);
+    }
+}
+
+bool SqlVerify::Start() {
+    if(name_ == "" || pwd_ == "") { return Finish_(false); }
+    LOG_INFO("Verify name:%s", name_.c_str());
+    // 缓存和过滤器能回答的不借数据库连接
+    UserCache* cache = UserCache::Instance();
+    string cached;
+    // 过滤器说不存在时登录直接失败；注册还是要先查：别处直接插进user表的用户过滤器里没有，不查会插入重复的行
+    if(isLogin_ && !cache->MayExist(name_)) {
+        LOG_DEBUG("user not exist!");
+        return Finish_(false);
+    }
+    if(cache->Get(name_, &cached)) {
+        if(!isLogin_) { LOG_DEBUG("user used!"); }
+        return Finish_(isLogin_ && cached == pwd_);
+    }
+
+    sql_ = SqlConnPool::Instance()->GetConn();
+    if(!sql_) {
+        unavailable_ = true;
+        return Finish_(false);
+    }
+#if SQL_NONBLOCK
+    fd_ = mysql_get_socket(sql_);
+#endif
+    if(!Begin_(SqlConnPool::STMT_SELECT_USER)) {
+        return Finish_(false);
+    }
+    return Run_(0);
+}
+
+bool SqlVerify::Continue(uint32_t events) {
+    assert(step_ != DONE);
+    int ready = 0;
+#if SQL_NONBLOCK
+    if(events & EPOLLIN) { ready |= MYSQL_WAIT_READ; }
+    if(events & EPOLLOUT) { ready |= MYSQL_WAIT_WRITE; }
+    // 出错时按等待的事件交给库去读写，由它报告错误
+    if(events & (EPOLLERR | EPOLLHUP)) { ready |= wait_; }
+#endif
+    return Run_(ready);
+}
+
+uint32_t SqlVerify::WaitEvents() const {
+    uint32_t events = 0;
+#if SQL_NONBLOCK
+    if(wait_ & MYSQL_WAIT_READ) { events |= EPOLLIN; }
+    if(wait_ & MYSQL_WAIT_WRITE) { events |= EPOLLOUT; }
+#endif
+    return events;
+}
+
+bool SqlVerify::Begin_(SqlConnPool::SqlStmt id) {
+    if(stmt_) { mysql_stmt_free_result(stmt_); }
+    stmt_ = SqlConnPool::Instance()->GetStmt(sql_, id);
+    if(!stmt_) {
+        LOG_ERROR("No prepared statement %d", (int)id);
+        return false;
+    }
+    // 参数按长度传，不需要转义，也没有固定长度的拼接缓冲区
+    int paramNum = (id == SqlConnPool::STMT_INSERT_USER) ? 2 : 1;
+    const string* values[2] = { &name_, &pwd_ };
+    for(int i = 0; i < paramNum; i++) {
+        paramLen_[i] = values[i]->size();
+        params_[i].buffer_type = MYSQL_TYPE_STRING;
+        params_[i].buffer = const_cast<char*>(values[i]->data());
+        params_[i].buffer_length = paramLen_[i];
+        params_[i].length = &paramLen_[i];
+    }
+    if(mysql_stmt_bind_param(stmt_, params_)) {
+        LOG_ERROR("Bind param error: %s", mysql_stmt_error(stmt_));
+        broken_ = true;
+        return false;
+    }
+    LOG_DEBUG("%s", SqlConnPool::STMT_SQL[id]);
+    start_ = Metrics::NowUs();
+    return true;
+}
+
+int SqlVerify::Execute_(int ready) {
+#if SQL_NONBLOCK
+    if(ready == 0) {
+        return mysql_stmt_execute_start(&err_, stmt_);
+    }
+    return mysql_stmt_execute_cont(&err_, stmt_, ready);
+#else
+    err_ = mysql_stmt_execute(stmt_);
+    return 0;
+#endif
+}
+
+int SqlVerify::Store_(int ready) {
+#if SQL_NONBLOCK
+    if(ready == 0) {
+        return mysql_stmt_store_result_start(&err_, stmt_);
+    }
+    return mysql_stmt_store_result_cont(&err_, stmt_, ready);
+#else
+    err_ = mysql_stmt_store_result(stmt_);
+    return 0;
+#endif
+}
+
+bool SqlVerify::Run_(int ready) {
+    while(step_ != DONE) {
+        int status = 0;
+        switch(step_) {
+        case SELECT:
+        case INSERT:
+            status = Execute_(ready);
+            break;
+        case STORE:
+            status = Store_(ready);
+            break;
+        default:
+            break;
+        }
+        if(status) {
+            // 要等数据库，记下等什么
+            wait_ = status;
+            return false;
+        }
+        ready = 0;
+        wait_ = 0;
+        if(err_ && step_ == INSERT && mysql_stmt_errno(stmt_) == ER_DUP_ENTRY) {
+            // username有唯一键时，查完到插入之间被别人注册了：和查到用户一样，连接没有问题
+            LOG_DEBUG("user used!");
+            UserCache::Instance()->AddName(name_);
+            return Finish_(false);
+        }
+        if(err_) {
+            // 连接断了或者语句在服务端失效了，归还时重连，新连接上会重新准备语句
+            LOG_ERROR("Verify step %d error: %s", (int)step_, mysql_stmt_error(stmt_));
+            broken_ = true;
+            return Finish_(false);
+        }
+        switch(step_) {
+        case SELECT:
+            step_ = STORE;
+            break;
+        case STORE:
+            Metrics::Observe(Metrics::SQL_LATENCY, Metrics::NowUs() - start_);
+            CheckRows_();
+            /* 注册行为 且 用户名未被使用*/
+            if(!isLogin_ && result_) {
+                LOG_DEBUG("regirster!");
+                if(!Begin_(SqlConnPool::STMT_INSERT_USER)) { return Finish_(false); }
+                step_ = INSERT;
+                break;
+            }
+            return Finish_(result_);
+        case INSERT:
+            Metrics::Observe(Metrics::SQL_LATENCY, Metrics::NowUs() - start_);
+            // 写穿：新用户进缓存和过滤器
+            UserCache::Instance()->Put(name_, pwd_);
+            UserCache::Instance()->AddName(name_);
+            return Finish_(true);
+        default:
+            break;
+        }
+    }
+    return true;
+}
+
+void SqlVerify::CheckRows_() {
+    result_ = !isLogin_;
+    column_.buffer_type = MYSQL_TYPE_STRING;
+    column_.buffer = columnBuf_;
+    column_.buffer_length = sizeof(columnBuf_);
+    column_.length = &columnLen_;
+    if(mysql_stmt_bind_result(stmt_, &column_)) {
+        LOG_ERROR("Bind result error: %s", mysql_stmt_error(stmt_));
+        result_ = false;
+        return;
+    }
+    // 结果已经在本地了（store_result），取行不会再等数据库
+    int ret;
+    while((ret = mysql_stmt_fetch(stmt_)) == 0 || ret == MYSQL_DATA_TRUNCATED) {
+        string password(columnBuf_, min<unsigned long>(columnLen_, sizeof(columnBuf_)));
+        // 密码不进日志
+        LOG_DEBUG("MYSQL ROW: %s", name_.c_str());
+        // 查到了就进过滤器：别处直接插进表里的用户，查到过一次以后登录也能通过过滤器
+        UserCache::Instance()->AddName(name_);
+        UserCache::Instance()->Put(name_, password);
+        if(isLogin_) {
+            result_ = (ret == 0 && pwd_ == password);
+            if(!result_) { LOG_DEBUG("pwd error!"); }
+        } else {
+            result_ = false;
+            LOG_DEBUG("user used!");
+        }
+    }
+}
+
+bool SqlVerify::Finish_(bool result) {
+    result_ = result;
+    step_ = DONE;
+    wait_ = 0;
+    LOG_DEBUG("UserVerify %s!!", result_ ? "success" : "fail");
+    return true;
+}
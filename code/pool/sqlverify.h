@@ -0,0 +1,85 @@
+#ifndef SQLVERIFY_H
+#define SQLVERIFY_H
+
+#include <string>
+#include <stdint.h>
+#include <sys/epoll.h>  // EPOLLIN EPOLLOUT
+#include "sqlconnpool.h"
+#include "usercache.h"
+#include "userstore.h"
+
+/**
+ * 登录/注册时的用户验证，一个状态机：查用户 -> 取结果 -> （注册且用户名没被用过）插入
+ * 先问UserCache，缓存命中或者过滤器判定用户不存在（只对登录）时不用借数据库连接
+ * 非阻塞模式下每一步要等数据库时就返回，调用方把Fd()按WaitEvents()注册到poller里，
+ * 就绪后调用Continue接着走，工作线程/从Reactor不会被数据库的往返卡住
+ * 从SqlConnPool借一个连接（不等，没有空闲的就是Unavailable，回503），析构时归还：调用方要先把Fd()从poller里删掉再析构，免得连接被别的请求拿去注册之后又被删掉
+ * 没完成就析构（客户端断开）时连接的协议状态不确定，关掉换一个新的
+*/
+class SqlVerify: public UserVerify {
+public:
+    SqlVerify(const std::string& name, const std::string& pwd, bool isLogin);
+
+    ~SqlVerify() override;
+
+    bool Start() override;  // 开始验证，返回true表示已经有结果（阻塞模式下总是true）
+
+    bool Continue(uint32_t events) override;    // 数据库的socket就绪，events是poller返回的事件，返回值同Start
+
+    bool Done() const override { return step_ == DONE; }
+
+    bool Result() const override { return result_; }
+
+    bool Unavailable() const override { return unavailable_; }
+
+    int Fd() const override { return fd_; }     // 等待中的数据库socket
+
+    uint32_t WaitEvents() const override;       // 要等的事件，EPOLLIN/EPOLLOUT
+
+private:
+    enum STEP {
+        SELECT,     // 按用户名查密码
+        STORE,      // 取查询结果
+        INSERT,     // 注册新用户
+        DONE,
+    };
+
+    bool Run_(int ready);           // 从当前这一步往下走，ready是就绪的MYSQL_WAIT_*，0表示这一步刚开始
+    bool Begin_(SqlConnPool::SqlStmt id);   // 取这个连接上预处理好的语句，绑定参数
+    int Execute_(int ready);        // 执行stmt_，返回0表示完成，否则是要等待的MYSQL_WAIT_*
+    int Store_(int ready);
+    void CheckRows_();
+    bool Finish_(bool result);
+
+    std::string name_;
+    std::string pwd_;
+    bool isLogin_;
+    bool result_;
+    bool unavailable_;  // 连接池没有空闲连接，没有验证
+    STEP step_;
+    MYSQL* sql_;
+    MYSQL_STMT* stmt_;  // 当前执行的预处理语句，属于sql_
+    bool broken_;       // 语句执行出错，连接或者语句可能已经失效，归还时换一个新连接
+    int fd_;
+    int wait_;          // 正在等的MYSQL_WAIT_*
+    int err_;
+    uint64_t start_;    // 这一条语句开始的时间，记录SQL延迟
+
+    MYSQL_BIND params_[2];      // 用户名、密码，直接指向name_和pwd_
+    unsigned long paramLen_[2];
+    MYSQL_BIND column_;         // 查到的密码
+    unsigned long columnLen_;
+    char columnBuf_[256];
+};
+
+// 用户存在MySQL里，连接池和用户缓存由WebServer初始化
+class MySqlUserStore: public UserStore {
+public:
+    UserVerify* NewVerify(const std::string& name, const std::string& pwd, bool isLogin) override {
+        return new SqlVerify(name, pwd, isLogin);
+    }
+
+    const char* Name() const override { return "mysql"; }
+};
+
+#endif //SQLVERIFY_H
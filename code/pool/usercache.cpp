@@ -0,0 +1,139 @@
+#include "usercache.h"
+#include <time.h>
+using namespace std;
+
+UserCache::UserCache(): ttlMs_(0), maxPerShard_(0), bloomBits_(0), bloomReady_(false),
+    hits_(0), misses_(0), bloomNegatives_(0) {}
+
+UserCache* UserCache::Instance() {
+    static UserCache inst;
+    return &inst;
+}
+
+void UserCache::Init(int ttlSec, size_t maxEntries) {
+    ttlMs_ = ttlSec > 0 ? ttlSec * 1000ULL : 0;
+    maxPerShard_ = (maxEntries + SHARD_NUM - 1) / SHARD_NUM;
+}
+
+uint64_t UserCache::NowMs_() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+bool UserCache::LoadNames(SqlConnPool* pool) {
+    assert(pool);
+    MYSQL* sql = pool->GetConn();
+    if(!sql) {
+        LOG_WARN("UserCache: no sql connection, bloom filter off");
+        return false;
+    }
+    vector<string> names;
+    bool ok = false;
+    if(mysql_query(sql, "SELECT username FROM user") == 0) {
+        MYSQL_RES* res = mysql_store_result(sql);
+        if(res) {
+            while(MYSQL_ROW row = mysql_fetch_row(res)) {
+                if(row[0]) { names.emplace_back(row[0]); }
+            }
+            mysql_free_result(res);
+            ok = true;
+        }
+    }
+    pool->FreeConn(sql);
+    if(!ok) {
+        LOG_WARN("UserCache: load user names error, bloom filter off");
+        return false;
+    }
+    // 留出一倍的余量给之后注册的用户，位数取2的幂
+    size_t bits = BLOOM_MIN_BITS;
+    while(bits < names.size() * 2 * BLOOM_BITS_PER_KEY) { bits <<= 1; }
+    bloom_.reset(new atomic<uint64_t>[bits / 64]);
+    for(size_t i = 0; i < bits / 64; i++) {
+        bloom_[i].store(0, memory_order_relaxed);
+    }
+    bloomBits_ = bits;
+    for(const string& name: names) {
+        AddName(name);
+    }
+    bloomReady_ = true;
+    LOG_INFO("UserCache: %zu user names, bloom %zu bits", names.size(), bits);
+    return true;
+}
+
+// 双重哈希：第i个位置是 h1 + i * h2
+void UserCache::BloomPos_(size_t hash, int i, size_t* word, uint64_t* mask) const {
+    uint64_t h1 = hash;
+    uint64_t h2 = ((hash * 0x9E3779B97F4A7C15ULL) >> 17) | 1;
+    uint64_t bit = (h1 + i * h2) & (bloomBits_ - 1);
+    *word = bit / 64;
+    *mask = 1ULL << (bit % 64);
+}
+
+bool UserCache::MayExist(const string& name) const {
+    if(!bloomReady_) { return true; }
+    size_t hash = std::hash<string>()(name);
+    for(int i = 0; i < BLOOM_HASHES; i++) {
+        size_t word;
+        uint64_t mask;
+        BloomPos_(hash, i, &word, &mask);
+        if(!(bloom_[word].load(memory_order_relaxed) & mask)) {
+            bloomNegatives_.fetch_add(1, memory_order_relaxed);
+            return false;
+        }
+    }
+    return true;
+}
+
+void UserCache::AddName(const string& name) {
+    if(!bloom_) { return; }
+    size_t hash = std::hash<string>()(name);
+    for(int i = 0; i < BLOOM_HASHES; i++) {
+        size_t word;
+        uint64_t mask;
+        BloomPos_(hash, i, &word, &mask);
+        bloom_[word].fetch_or(mask, memory_order_relaxed);
+    }
+}
+
+bool UserCache::Get(const string& name, string* pwd) {
+    if(ttlMs_ == 0) { return false; }
+    Shard& shard = ShardOf_(std::hash<string>()(name));
+    {
+        lock_guard<mutex> locker(shard.mtx);
+        auto it = shard.index.find(name);
+        if(it != shard.index.end()) {
+            if(it->second->expire > NowMs_()) {
+                if(pwd) { *pwd = it->second->pwd; }
+                shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+                hits_.fetch_add(1, memory_order_relaxed);
+                return true;
+            }
+            shard.lru.erase(it->second);
+            shard.index.erase(it);
+        }
+    }
+    misses_.fetch_add(1, memory_order_relaxed);
+    return false;
+}
+
+void UserCache::Put(const string& name, const string& pwd) {
+    if(ttlMs_ == 0) { return; }
+    Shard& shard = ShardOf_(std::hash<string>()(name));
+    uint64_t now = NowMs_();
+    lock_guard<mutex> locker(shard.mtx);
+    auto it = shard.index.find(name);
+    if(it != shard.index.end()) {
+        it->second->pwd = pwd;
+        it->second->expire = now + ttlMs_;
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        return;
+    }
+    // 满了踢掉最久没用的一个，过期的条目没人用，会先走到尾部
+    if(shard.lru.size() >= maxPerShard_ && !shard.lru.empty()) {
+        shard.index.erase(shard.lru.back().name);
+        shard.lru.pop_back();
+    }
+    shard.lru.push_front({ name, pwd, now + ttlMs_ });
+    shard.index[name] = shard.lru.begin();
+}
@@ -0,0 +1,82 @@
+#ifndef USERCACHE_H
+#define USERCACHE_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include "sqlconnpool.h"
+
+/**
+ * 挡在数据库前面的用户缓存，单例
+ * 1. 用户名 -> 密码的缓存，按用户名哈希分片，每片一把锁和一个LRU，条目有TTL；查到过或者注册成功的用户写进来，
+ *    重复登录、重复注册不用再借数据库连接
+ * 2. 所有已存在用户名的布隆过滤器，启动时从user表加载，注册成功后加进去；
+ *    过滤器说不存在就一定不存在：登录直接失败；注册不用它，还是先SELECT
+ * 用户只通过这个服务器注册时过滤器才是准的，别处往user表里加了用户要重启才能登录；没加载成功时过滤器不起作用
+*/
+class UserCache {
+public:
+    static UserCache* Instance();
+
+    // ttlSec为0时不缓存密码，只用过滤器
+    void Init(int ttlSec, size_t maxEntries);
+
+    bool LoadNames(SqlConnPool* pool);  // 从user表加载用户名建过滤器
+
+    bool Get(const std::string& name, std::string* pwd);    // 缓存里有没过期的条目返回true
+
+    void Put(const std::string& name, const std::string& pwd);
+
+    bool MayExist(const std::string& name) const;   // 返回false时用户一定不存在
+
+    void AddName(const std::string& name);
+
+    uint64_t GetHitCount() const { return hits_.load(std::memory_order_relaxed); }
+    uint64_t GetMissCount() const { return misses_.load(std::memory_order_relaxed); }
+    uint64_t GetBloomNegativeCount() const { return bloomNegatives_.load(std::memory_order_relaxed); }
+
+private:
+    UserCache();
+    ~UserCache() = default;
+
+    struct Entry {
+        std::string name;
+        std::string pwd;
+        uint64_t expire;    // 过期时间，毫秒
+    };
+
+    struct Shard {
+        std::mutex mtx;
+        std::list<Entry> lru;   // 头部是最近使用的，满了从尾部踢
+        std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    };
+
+    static uint64_t NowMs_();
+    Shard& ShardOf_(size_t hash) { return shards_[hash % SHARD_NUM]; }
+    void BloomPos_(size_t hash, int i, size_t* word, uint64_t* mask) const;
+
+    static const int SHARD_NUM = 16;
+    static const int BLOOM_HASHES = 7;              // 每个键置7位，10位/键时误判率约1%
+    static const size_t BLOOM_BITS_PER_KEY = 10;
+    static const size_t BLOOM_MIN_BITS = 1 << 16;
+
+    Shard shards_[SHARD_NUM];
+    uint64_t ttlMs_;
+    size_t maxPerShard_;
+
+    // 只在启动时分配，之后只置位，不需要锁
+    std::unique_ptr<std::atomic<uint64_t>[]> bloom_;
+    size_t bloomBits_;
+    bool bloomReady_;
+
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+    mutable std::atomic<uint64_t> bloomNegatives_;   // 过滤器判定不存在、省掉查询的次数
+};
+
+#endif //USERCACHE_H
@@ -0,0 +1,244 @@
+#include "userfile.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>   // flock
+using namespace std;
+
+const char FileUserStore::MAGIC[8] = { 'T', 'W', 'S', 'U', 'S', 'E', 'R', '1' };
+
+namespace {
+
+// 本地文件不用等，Start就有结果
+class FileVerify: public UserVerify {
+public:
+    FileVerify(FileUserStore* store, const string& name, const string& pwd, bool isLogin):
+        store_(store), name_(name), pwd_(pwd), isLogin_(isLogin), done_(false), result_(false) {}
+
+    bool Start() override {
+        LOG_INFO("Verify name:%s", name_.c_str());
+        if(name_ != "" && pwd_ != "") {
+            if(isLogin_) {
+                string pwd;
+                result_ = store_->Lookup(name_, &pwd) && pwd == pwd_;
+            } else {
+                result_ = store_->Insert(name_, pwd_);
+            }
+        }
+        done_ = true;
+        LOG_DEBUG("UserVerify %s!!", result_ ? "success" : "fail");
+        return true;
+    }
+
+    bool Done() const override { return done_; }
+
+    bool Result() const override { return result_; }
+
+private:
+    FileUserStore* store_;
+    string name_;
+    string pwd_;
+    bool isLogin_;
+    bool done_;
+    bool result_;
+};
+
+inline uint64_t LoadAcquire(const uint64_t* p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+inline void StoreRelease(uint64_t* p, uint64_t v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+
+}
+
+FileUserStore::FileUserStore(const char* path, uint32_t bucketNum):
+    path_(path), initBuckets_(bucketNum), fd_(-1), base_(nullptr), fileSize_(0) {
+    assert(path && bucketNum > 0 && (bucketNum & (bucketNum - 1)) == 0);
+    fd_ = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if(fd_ < 0) {
+        LOG_ERROR("FileUserStore open %s error: %s", path, strerror(errno));
+        return;
+    }
+    if(flock(fd_, LOCK_EX | LOCK_NB) < 0) {
+        LOG_ERROR("FileUserStore %s is used by another process", path);
+        close(fd_);
+        fd_ = -1;
+        return;
+    }
+    struct stat st;
+    if(fstat(fd_, &st) < 0) {
+        LOG_ERROR("FileUserStore stat %s error: %s", path, strerror(errno));
+        return;
+    }
+    fileSize_ = st.st_size;
+    // 地址空间一次留够，文件变长以后不用重新映射；超出文件长度的部分不会去访问
+    void* addr = mmap(nullptr, MAX_FILE_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if(addr == MAP_FAILED) {
+        LOG_ERROR("FileUserStore mmap %s error: %s", path, strerror(errno));
+        return;
+    }
+    base_ = static_cast<char*>(addr);
+    if(!(fileSize_ == 0 ? Create_() : Check_())) {
+        munmap(base_, MAX_FILE_BYTES);
+        base_ = nullptr;
+        return;
+    }
+    LOG_INFO("FileUserStore %s: %zu users, %u buckets", path, Count(), Head_()->bucketNum);
+}
+
+FileUserStore::~FileUserStore() {
+    if(base_) {
+        msync(base_, fileSize_, MS_SYNC);
+        munmap(base_, MAX_FILE_BYTES);
+    }
+    if(fd_ >= 0) { close(fd_); }
+}
+
+bool FileUserStore::Create_() {
+    uint64_t dataStart = HEADER_SIZE + static_cast<uint64_t>(initBuckets_) * sizeof(uint64_t);
+    if(!Reserve_(dataStart)) { return false; }
+    // ftruncate出来的部分都是0，桶都是空的
+    Header* head = Head_();
+    head->bucketNum = initBuckets_;
+    head->dataStart = dataStart;
+    head->end = dataStart;
+    head->count = 0;
+    // 文件头写完整了最后写魔数
+    memcpy(head->magic, MAGIC, sizeof(MAGIC));
+    return true;
+}
+
+bool FileUserStore::Check_() {
+    const Header* head = Head_();
+    if(fileSize_ < HEADER_SIZE || memcmp(head->magic, MAGIC, sizeof(MAGIC)) != 0) {
+        LOG_ERROR("FileUserStore %s: not a user file", path_.c_str());
+        return false;
+    }
+    uint32_t bucketNum = head->bucketNum;
+    if(bucketNum == 0 || (bucketNum & (bucketNum - 1)) != 0 ||
+       head->dataStart != HEADER_SIZE + static_cast<uint64_t>(bucketNum) * sizeof(uint64_t) ||
+       head->end < head->dataStart || head->end > fileSize_) {
+        LOG_ERROR("FileUserStore %s: corrupt header", path_.c_str());
+        return false;
+    }
+    // 查找时直接按偏移访问，坏的偏移会读到映射外面，这里把每条链表都走一遍
+    uint64_t records = 0;
+    const uint64_t* buckets = Buckets_();
+    for(uint32_t i = 0; i < bucketNum; i++) {
+        if(!CheckChain_(buckets[i], head->end, &records)) {
+            LOG_ERROR("FileUserStore %s: corrupt record in bucket %u", path_.c_str(), i);
+            return false;
+        }
+    }
+    // 注册到一半崩溃时count可能比链表里的多一个，不算坏
+    if(records > head->count || head->count > records + 1) {
+        LOG_ERROR("FileUserStore %s: count %lu, found %lu records", path_.c_str(),
+                  static_cast<unsigned long>(head->count), static_cast<unsigned long>(records));
+        return false;
+    }
+    return true;
+}
+
+// 链表里的记录按偏移从大到小，每条都在[dataStart, end)里、8字节对齐、长度不超过end
+bool FileUserStore::CheckChain_(uint64_t off, uint64_t end, uint64_t* records) const {
+    const uint64_t dataStart = Head_()->dataStart;
+    uint64_t prev = end;
+    while(off) {
+        if(off < dataStart || off >= prev || off % 8 != 0 || end - off < sizeof(Record)) {
+            return false;
+        }
+        const Record* rec = reinterpret_cast<const Record*>(base_ + off);
+        if(rec->nameLen == 0 || rec->nameLen > MAX_FIELD_LEN || rec->pwdLen > MAX_FIELD_LEN ||
+           end - off - sizeof(Record) < static_cast<uint64_t>(rec->nameLen) + rec->pwdLen) {
+            return false;
+        }
+        (*records)++;
+        prev = off;
+        off = rec->next;
+    }
+    return true;
+}
+
+bool FileUserStore::Reserve_(uint64_t bytes) {
+    if(bytes <= fileSize_) { return true; }
+    uint64_t size = (bytes + GROW_BYTES - 1) / GROW_BYTES * GROW_BYTES;
+    if(size > MAX_FILE_BYTES) {
+        LOG_ERROR("FileUserStore %s is full", path_.c_str());
+        return false;
+    }
+    if(ftruncate(fd_, size) < 0) {
+        LOG_ERROR("FileUserStore ftruncate %s error: %s", path_.c_str(), strerror(errno));
+        return false;
+    }
+    fileSize_ = size;
+    return true;
+}
+
+// FNV-1a，结果要写进文件，不能用std::hash（不同的标准库实现不一样）
+uint64_t FileUserStore::Hash_(const string& name) {
+    uint64_t hash = 14695981039346656037ULL;
+    for(unsigned char c: name) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+const FileUserStore::Record* FileUserStore::Find_(const string& name, uint64_t hash) const {
+    uint64_t* buckets = Buckets_();
+    uint64_t off = LoadAcquire(&buckets[hash & (Head_()->bucketNum - 1)]);
+    while(off) {
+        const Record* rec = reinterpret_cast<const Record*>(base_ + off);
+        if(rec->hash == static_cast<uint32_t>(hash >> 32) && rec->nameLen == name.size() &&
+           memcmp(RecordData_(rec), name.data(), name.size()) == 0) {
+            return rec;
+        }
+        off = rec->next;
+    }
+    return nullptr;
+}
+
+bool FileUserStore::Lookup(const string& name, string* pwd) const {
+    assert(base_);
+    if(name.size() > MAX_FIELD_LEN) { return false; }
+    const Record* rec = Find_(name, Hash_(name));
+    if(!rec) { return false; }
+    if(pwd) { pwd->assign(RecordData_(rec) + rec->nameLen, rec->pwdLen); }
+    return true;
+}
+
+bool FileUserStore::Insert(const string& name, const string& pwd) {
+    assert(base_);
+    if(name.empty() || name.size() > MAX_FIELD_LEN || pwd.size() > MAX_FIELD_LEN) { return false; }
+    uint64_t hash = Hash_(name);
+    lock_guard<mutex> locker(mtx_);
+    if(Find_(name, hash)) {
+        LOG_DEBUG("user used!");
+        return false;
+    }
+    Header* head = Head_();
+    uint64_t off = head->end;
+    uint64_t len = (sizeof(Record) + name.size() + pwd.size() + 7) & ~7ULL;
+    if(!Reserve_(off + len)) { return false; }
+    uint64_t* bucket = &Buckets_()[hash & (head->bucketNum - 1)];
+    Record* rec = reinterpret_cast<Record*>(base_ + off);
+    rec->next = *bucket;
+    rec->hash = static_cast<uint32_t>(hash >> 32);
+    rec->nameLen = name.size();
+    rec->pwdLen = pwd.size();
+    char* data = base_ + off + sizeof(Record);
+    memcpy(data, name.data(), name.size());
+    memcpy(data + name.size(), pwd.data(), pwd.size());
+    // 记录写完再提交末尾，最后挂到链表头，查找的线程看到偏移时记录一定是完整的
+    StoreRelease(&head->end, off + len);
+    __atomic_store_n(&head->count, head->count + 1, __ATOMIC_RELAXED);
+    StoreRelease(bucket, off);
+    return true;
+}
+
+size_t FileUserStore::Count() const {
+    return __atomic_load_n(&Head_()->count, __ATOMIC_RELAXED);
+}
+
+UserVerify* FileUserStore::NewVerify(const string& name, const string& pwd, bool isLogin) {
+    return new FileVerify(this, name, pwd, isLogin);
+}
@@ -0,0 +1,86 @@
+#ifndef USERFILE_H
+#define USERFILE_H
+
+#include <string>
+#include <mutex>
+#include <stdint.h>
+#include <stddef.h>
+#include "userstore.h"
+#include "../log/log.h"
+
+/**
+ * 用户存在本地的一个只追加的哈希文件里，整个文件mmap进来
+ * 文件布局：4KB文件头 | 桶数组（每个桶是链表头记录的偏移，0表示空） | 记录区
+ * 记录：下一条记录的偏移、名字的哈希、名字和密码的长度、名字、密码，按8字节对齐；
+ * 链表头是最新的记录，next一定比自己的偏移小
+ * 注册时把记录追加到末尾，先更新文件头里的末尾，再把新记录挂到桶的链表头；
+ * 进程在中间崩溃最多留下一条没人指向的记录，已有的数据不会坏
+ * 查找不加锁（偏移用acquire/release读写），注册用一把锁串起来
+ * 打开已有的文件时检查所有的链表，每个偏移都要落在记录区里、整条记录不超过文件头里的末尾，坏文件不用
+ * 启动时映射一段固定大小的地址空间，文件按需ftruncate变长，映射不用换，查找的线程拿到的指针一直有效
+ * 数据什么时候落盘交给页缓存，析构时msync；同一个文件只能被一个进程打开（flock）
+*/
+class FileUserStore: public UserStore {
+public:
+    // bucketNum只在新建文件时用，取2的幂
+    explicit FileUserStore(const char* path, uint32_t bucketNum = DEFAULT_BUCKETS);
+
+    ~FileUserStore() override;
+
+    bool IsOpen() const { return base_ != nullptr; }
+
+    bool Lookup(const std::string& name, std::string* pwd) const;   // 用户存在返回true
+
+    bool Insert(const std::string& name, const std::string& pwd);   // 用户名已存在或者文件满了返回false
+
+    size_t Count() const;   // 用户数
+
+    UserVerify* NewVerify(const std::string& name, const std::string& pwd, bool isLogin) override;
+
+    const char* Name() const override { return "file"; }
+
+    static const uint32_t DEFAULT_BUCKETS = 1 << 16;
+    static const size_t MAX_FIELD_LEN = 255;            // 用户名、密码的最大长度
+    static const size_t MAX_FILE_BYTES = 1ULL << 30;    // 映射的地址空间，也是文件的最大长度
+    static const size_t GROW_BYTES = 1 << 20;           // 文件每次变长多少
+
+private:
+    struct Header {
+        char magic[8];
+        uint32_t bucketNum;
+        uint32_t dataStart;     // 记录区的起始偏移
+        uint64_t end;           // 已提交的记录的末尾
+        uint64_t count;
+    };
+
+    // 记录头，后面紧接着名字和密码
+    struct Record {
+        uint64_t next;
+        uint32_t hash;
+        uint16_t nameLen;
+        uint16_t pwdLen;
+    };
+
+    bool Create_();
+    bool Check_();
+    bool CheckChain_(uint64_t off, uint64_t end, uint64_t* records) const;
+    bool Reserve_(uint64_t bytes);  // 保证文件至少这么长
+    static uint64_t Hash_(const std::string& name);
+    const Record* Find_(const std::string& name, uint64_t hash) const;
+
+    Header* Head_() const { return reinterpret_cast<Header*>(base_); }
+    const char* RecordData_(const Record* rec) const { return reinterpret_cast<const char*>(rec) + sizeof(Record); }
+    uint64_t* Buckets_() const { return reinterpret_cast<uint64_t*>(base_ + HEADER_SIZE); }
+
+    static const size_t HEADER_SIZE = 4096;
+    static const char MAGIC[8];
+
+    std::string path_;
+    uint32_t initBuckets_;
+    int fd_;
+    char* base_;
+    uint64_t fileSize_;
+    std::mutex mtx_;    // 注册时持有
+};
+
+#endif //USERFILE_H
@@ -0,0 +1,46 @@
+#ifndef USERSTORE_H
+#define USERSTORE_H
+
+#include <string>
+#include <stdint.h>
+
+/**
+ * 一次登录/注册的验证
+ * Start返回false表示还没有结果，调用方把Fd()按WaitEvents()注册到poller里，就绪后调用Continue接着做；
+ * 同步的后端Start总是返回true，Fd()是-1
+*/
+class UserVerify {
+public:
+    virtual ~UserVerify() = default;
+
+    virtual bool Start() = 0;   // 开始验证，返回true表示已经有结果
+
+    virtual bool Continue(uint32_t events) { (void)events; return true; }   // 等的事件就绪了，返回值同Start
+
+    virtual bool Done() const = 0;
+
+    virtual bool Result() const = 0;
+
+    virtual bool Unavailable() const { return false; }  // 后端忙（没有空闲的数据库连接），没有验证，回503
+
+    virtual int Fd() const { return -1; }   // 等待中的socket
+
+    virtual uint32_t WaitEvents() const { return 0; }   // 要等的事件，EPOLLIN/EPOLLOUT
+};
+
+/**
+ * 用户名/密码存储的抽象接口，HttpConn只通过它查用户、注册新用户
+ * MySqlUserStore：SqlConnPool + UserCache，链接MariaDB Connector/C时查询不阻塞线程
+ * FileUserStore：本地只追加的mmap哈希文件，不依赖外部服务，压测动态请求或者小规模部署用
+*/
+class UserStore {
+public:
+    virtual ~UserStore() = default;
+
+    // 返回的对象由调用方释放
+    virtual UserVerify* NewVerify(const std::string& name, const std::string& pwd, bool isLogin) = 0;
+
+    virtual const char* Name() const = 0;   // 后端的名字，打日志用
+};
+
+#endif //USERSTORE_H
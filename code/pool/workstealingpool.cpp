@@ -0,0 +1,148 @@
+#include "workstealingpool.h"
+
+using namespace std;
+
+WorkStealingPool::WorkStealingPool(size_t threadCount, size_t queueSize):
+            affinity_(new atomic<int>[AFFINITY_SIZE]), next_(0), idle_(0), isClosed_(false), overflowSize_(0) {
+    assert(threadCount > 0);
+    for(size_t i = 0; i < AFFINITY_SIZE; i++) {
+        affinity_[i].store(-1, memory_order_relaxed);
+    }
+    for(size_t i = 0; i < threadCount; i++) {
+        workers_.emplace_back(new Worker(queueSize));
+    }
+    // 队列都建好之后再启动线程，偷任务时不会访问到还没建好的队列
+    for(size_t i = 0; i < threadCount; i++) {
+        workers_[i]->thread = thread(&WorkStealingPool::Run_, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    isClosed_ = true;
+    for(auto& worker: workers_) {
+        Wake_(*worker);
+    }
+    for(auto& worker: workers_) {
+        if(worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+}
+
+void WorkStealingPool::AddTask(Task&& task, int hint) {
+    size_t target;
+    int last = hint >= 0 ? affinity_[hint % AFFINITY_SIZE].load(memory_order_relaxed) : -1;
+    if(last >= 0) {
+        target = last;
+    } else {
+        target = next_.fetch_add(1, memory_order_relaxed) % workers_.size();
+    }
+    Worker& worker = *workers_[target];
+    pair<Task, int> item(std::move(task), hint);
+    if(!worker.tasks.Push(std::move(item))) {
+        lock_guard<mutex> locker(overflowMtx_);
+        overflow_.push(std::move(item));
+        overflowSize_++;
+    }
+    // 放进队列之后再看有没有线程在睡，和Run_里先标记睡眠再检查队列配对，不会漏掉唤醒
+    atomic_thread_fence(memory_order_seq_cst);
+    if(worker.sleeping.load()) {
+        Wake_(worker);
+    }
+    else if(idle_.load() > 0) {
+        // 目标线程正忙，叫醒一个睡着的线程过来偷
+        WakeIdle_(target);
+    }
+}
+
+void WorkStealingPool::Wake_(Worker& worker) {
+    {
+        lock_guard<mutex> locker(worker.mtx);
+        worker.sleeping = false;
+    }
+    worker.cond.notify_one();
+}
+
+void WorkStealingPool::WakeIdle_(size_t except) {
+    for(size_t i = 0; i < workers_.size(); i++) {
+        if(i != except && workers_[i]->sleeping.load()) {
+            Wake_(*workers_[i]);
+            return;
+        }
+    }
+}
+
+bool WorkStealingPool::TryGet_(size_t self, pair<Task, int>& task) {
+    // 先取自己的，再从下一个线程开始依次偷
+    if(workers_[self]->tasks.Pop(task)) {
+        return true;
+    }
+    size_t n = workers_.size();
+    for(size_t i = 1; i < n; i++) {
+        if(workers_[(self + i) % n]->tasks.Pop(task)) {
+            return true;
+        }
+    }
+    if(overflowSize_.load(memory_order_relaxed) > 0) {
+        lock_guard<mutex> locker(overflowMtx_);
+        if(!overflow_.empty()) {
+            task = std::move(overflow_.front());
+            overflow_.pop();
+            overflowSize_--;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool WorkStealingPool::HasWork_() {
+    for(auto& worker: workers_) {
+        if(!worker->tasks.Empty()) { return true; }
+    }
+    return overflowSize_.load() > 0;
+}
+
+void WorkStealingPool::Run_(size_t self) {
+    Worker& me = *workers_[self];
+    pair<Task, int> task;
+    int spins = 0;
+    while(true) {
+        if(TryGet_(self, task)) {
+            spins = 0;
+            // 记下这个连接最后是在哪个线程上处理的，下次优先交给它
+            if(task.second >= 0) {
+                atomic<int>& last = affinity_[task.second % AFFINITY_SIZE];
+                if(last.load(memory_order_relaxed) != static_cast<int>(self)) {
+                    last.store(static_cast<int>(self), memory_order_relaxed);
+                }
+            }
+            task.first();
+            task.first = nullptr;
+            continue;
+        }
+        if(isClosed_) { break; }
+        if(++spins < SPIN_ROUNDS) {
+            this_thread::yield();
+            continue;
+        }
+        // 自旋了一段时间还是没有任务，睡眠
+        spins = 0;
+        me.sleeping = true;
+        idle_++;
+        atomic_thread_fence(memory_order_seq_cst);
+        if(!HasWork_() && !isClosed_) {
+            unique_lock<mutex> locker(me.mtx);
+            me.cond.wait(locker, [&me, this] { return !me.sleeping || isClosed_; });
+        }
+        me.sleeping = false;
+        idle_--;
+    }
+}
+
+size_t WorkStealingPool::QueueDepth() const {
+    size_t depth = overflowSize_.load(memory_order_relaxed);
+    for(auto& worker: workers_) {
+        depth += worker->tasks.Size();
+    }
+    return depth;
+}
@@ -0,0 +1,137 @@
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+#include <assert.h>
+#include <stdint.h>
+
+/* 有界无锁队列（Vyukov MPMC），多个线程可以同时放，多个线程可以同时取 */
+template<typename T>
+class LockFreeQueue {
+public:
+    explicit LockFreeQueue(size_t capacity): mask_(capacity - 1), cells_(new Cell[capacity]), enqPos_(0), deqPos_(0) {
+        assert(capacity >= 2 && (capacity & (capacity - 1)) == 0);  // 容量必须是2的幂
+        for(size_t i = 0; i < capacity; i++) {
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool Push(T&& item) {
+        Cell* cell;
+        size_t pos = enqPos_.load(std::memory_order_relaxed);
+        while(true) {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if(dif == 0) {
+                if(enqPos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) { break; }
+            }
+            else if(dif < 0) { return false; }  // 满了
+            else { pos = enqPos_.load(std::memory_order_relaxed); }
+        }
+        cell->data = std::move(item);
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool Pop(T& item) {
+        Cell* cell;
+        size_t pos = deqPos_.load(std::memory_order_relaxed);
+        while(true) {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if(dif == 0) {
+                if(deqPos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) { break; }
+            }
+            else if(dif < 0) { return false; }  // 空的
+            else { pos = deqPos_.load(std::memory_order_relaxed); }
+        }
+        item = std::move(cell->data);
+        cell->seq.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool Empty() const {
+        return enqPos_.load(std::memory_order_seq_cst) == deqPos_.load(std::memory_order_seq_cst);
+    }
+
+    // 近似的元素个数，只用于统计
+    size_t Size() const {
+        size_t deq = deqPos_.load(std::memory_order_relaxed);
+        size_t enq = enqPos_.load(std::memory_order_relaxed);
+        return enq > deq ? enq - deq : 0;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+    const size_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+    std::atomic<size_t> enqPos_;
+    char pad_[64];      // 放和取的位置分开在不同的cache line
+    std::atomic<size_t> deqPos_;
+};
+
+/**
+ * 工作窃取线程池
+ * 每个工作线程有自己的无锁队列，AddTask带一个亲和提示（比如fd），同一个连接的任务优先交给上一次处理它的线程，
+ * 连接的数据还在那个核的缓存里；自己的队列空了就去别的线程的队列里偷任务
+ * 空闲时先自旋一会儿再睡眠，提交任务时只唤醒需要的线程
+ * 析构时处理完剩下的任务再join所有线程
+*/
+class WorkStealingPool {
+public:
+    typedef std::function<void()> Task;
+
+    explicit WorkStealingPool(size_t threadCount = 8, size_t queueSize = 1024);
+
+    ~WorkStealingPool();
+
+    void AddTask(Task&& task, int hint = -1);
+
+    size_t ThreadCount() const { return workers_.size(); }
+
+    size_t QueueDepth() const;  // 所有队列里排队的任务数，近似值
+
+private:
+    struct Worker {
+        explicit Worker(size_t queueSize): tasks(queueSize), sleeping(false) {}
+        LockFreeQueue<std::pair<Task, int>> tasks;
+        std::atomic<bool> sleeping;
+        std::mutex mtx;     // 只用来睡眠和唤醒
+        std::condition_variable cond;
+        std::thread thread;
+    };
+
+    void Run_(size_t self);
+    bool TryGet_(size_t self, std::pair<Task, int>& task);
+    bool HasWork_();
+    void Wake_(Worker& worker);
+    void WakeIdle_(size_t except);
+
+    static const int SPIN_ROUNDS = 64;          // 睡眠之前自旋找任务的次数
+    static const size_t AFFINITY_SIZE = 4096;   // 亲和表的大小，提示值取模
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::unique_ptr<std::atomic<int>[]> affinity_;  // 提示值 -> 上一次执行它的线程，-1表示没有
+    std::atomic<size_t> next_;      // 没有提示时轮询分配
+    std::atomic<int> idle_;         // 睡眠中的线程数
+    std::atomic<bool> isClosed_;
+
+    std::mutex overflowMtx_;        // 队列满了之后放到这里（很少发生）
+    std::queue<std::pair<Task, int>> overflow_;
+    std::atomic<size_t> overflowSize_;
+};
+
+#endif //WORK_STEALING_POOL_H
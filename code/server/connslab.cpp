@@ -0,0 +1,44 @@
+#include "connslab.h"
+
+ConnSlab::ConnSlab(size_t capacity): maxFd_(-1) {
+    capacity_ = capacity > 0 ? capacity : FdLimit();
+    mapSize_ = capacity_ * sizeof(Slot);
+    // 匿名映射的内存是全0，正好是gen为0、conn为空的状态
+    void* ptr = mmap(nullptr, mapSize_, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    assert(ptr != MAP_FAILED);
+    slots_ = static_cast<Slot*>(ptr);
+}
+
+ConnSlab::~ConnSlab() {
+    for(int fd = 0; fd <= maxFd_; fd++) {
+        delete slots_[fd].conn;
+    }
+    munmap(slots_, mapSize_);
+}
+
+size_t ConnSlab::FdLimit() {
+    struct rlimit limit;
+    if(getrlimit(RLIMIT_NOFILE, &limit) < 0 || limit.rlim_cur == RLIM_INFINITY) {
+        return 1 << 20;
+    }
+    return limit.rlim_cur;
+}
+
+HttpConn* ConnSlab::Open(int fd) {
+    assert(fd >= 0 && static_cast<size_t>(fd) < capacity_);
+    Slot& slot = slots_[fd];
+    // 同一个fd同一时间只属于一个线程，这里不会有竞争
+    if(!slot.conn) {
+        slot.conn = new HttpConn();
+        int maxFd = maxFd_.load();
+        while(fd > maxFd && !maxFd_.compare_exchange_weak(maxFd, fd)) {}
+    }
+    slot.gen.fetch_add(1, std::memory_order_release);
+    return slot.conn;
+}
+
+void ConnSlab::Close(int fd) {
+    if(fd < 0 || static_cast<size_t>(fd) >= capacity_) { return; }
+    slots_[fd].gen.fetch_add(1, std::memory_order_release);
+}
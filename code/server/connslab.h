@@ -0,0 +1,74 @@
+#ifndef CONN_SLAB_H
+#define CONN_SLAB_H
+
+#include <atomic>
+#include <assert.h>
+#include <stdint.h>
+#include <sys/mman.h>       // mmap, munmap
+#include <sys/resource.h>   // getrlimit
+
+#include "../http/httpconn.h"
+
+/**
+ * 以fd为下标的连接表，代替unordered_map<int, HttpConn>
+ * 大小按RLIMIT_NOFILE一次性预留（mmap，用到哪一页才真正分配内存），之后不会扩容，
+ * 工作线程拿着的HttpConn*一直有效；派发事件时直接按fd取下标，不需要哈希也不需要分配
+ * 每个槽有一个代数，连接打开和关闭时各加一，注册到poller里的事件带着代数，对不上的就是旧连接的事件
+ * 连接等数据库时，数据库的socket也注册到poller里，代数用SqlTag(连接的fd)，最高位区分两种事件
+*/
+class ConnSlab {
+public:
+    explicit ConnSlab(size_t capacity = 0);     // 0表示按RLIMIT_NOFILE
+
+    ~ConnSlab();
+
+    HttpConn* Open(int fd);     // 新连接，换代，第一次用到这个fd时才创建HttpConn
+
+    void Close(int fd);         // 连接关闭，换代，已经在队列里的事件都作废
+
+    static const uint32_t SQL_TAG = 1u << 31;
+    static const uint32_t GEN_MASK = SQL_TAG - 1;
+
+    HttpConn* Get(int fd, uint32_t gen) const {    // 代数对不上返回nullptr
+        if(fd < 0 || static_cast<size_t>(fd) >= capacity_) { return nullptr; }
+        const Slot& slot = slots_[fd];
+        if((slot.gen.load(std::memory_order_acquire) & GEN_MASK) != gen) { return nullptr; }
+        return slot.conn;
+    }
+
+    uint32_t Gen(int fd) const {
+        assert(fd >= 0 && static_cast<size_t>(fd) < capacity_);
+        return slots_[fd].gen.load(std::memory_order_acquire) & GEN_MASK;
+    }
+
+    static uint32_t SqlTag(int fd) { return SQL_TAG | static_cast<uint32_t>(fd); }
+
+    static bool IsSqlEvent(uint32_t gen) { return gen & SQL_TAG; }
+
+    // 数据库socket的事件，找到还在等这个socket的连接，已经关闭或者不再等了返回nullptr
+    HttpConn* GetSqlWaiter(int sqlFd, uint32_t gen) const {
+        size_t fd = gen & GEN_MASK;
+        if(fd >= capacity_) { return nullptr; }
+        HttpConn* conn = slots_[fd].conn;
+        if(!conn || !conn->SqlPending() || conn->SqlFd() != sqlFd) { return nullptr; }
+        return conn;
+    }
+
+    size_t Capacity() const { return capacity_; }
+
+    static size_t FdLimit();    // 进程能打开的文件描述符个数
+
+private:
+    // 每个槽占一个cache line，不同线程处理相邻的fd时不会伪共享
+    struct alignas(64) Slot {
+        std::atomic<uint32_t> gen;
+        HttpConn* conn;
+    };
+
+    size_t capacity_;
+    size_t mapSize_;
+    Slot* slots_;
+    std::atomic<int> maxFd_;    // 用到过的最大fd，析构时只需要遍历到这里
+};
+
+#endif //CONN_SLAB_H
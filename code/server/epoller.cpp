@@ -8,18 +8,23 @@ Epoller::~Epoller() {
     close(epollFd_);
 }
 
-bool Epoller::AddFd(int fd, uint32_t events) {
+// epoll_event.data里低32位放fd，高32位放代数
+uint64_t Epoller::Encode_(int fd, uint32_t gen) {
+    return (static_cast<uint64_t>(gen) << 32) | static_cast<uint32_t>(fd);
+}
+
+bool Epoller::AddFd(int fd, uint32_t events, uint32_t gen) {
     if(fd < 0) return false;
     epoll_event ev = {0};
-    ev.data.fd = fd;
+    ev.data.u64 = Encode_(fd, gen);
     ev.events = events;
     return 0 == epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev);
 }
 
-bool Epoller::ModFd(int fd, uint32_t events) {
+bool Epoller::ModFd(int fd, uint32_t events, uint32_t gen) {
     if(fd < 0) return false;
     epoll_event ev = {0};
-    ev.data.fd = fd;
+    ev.data.u64 = Encode_(fd, gen);
     ev.events = events;
     return 0 == epoll_ctl(epollFd_, EPOLL_CTL_MOD, fd, &ev);
 }
@@ -36,10 +41,15 @@ int Epoller::Wait(int timeoutMs) {
 
 int Epoller::GetEventFd(size_t i) const {
     assert(i < events_.size() && i >= 0);
-    return events_[i].data.fd;
+    return static_cast<int>(events_[i].data.u64 & 0xffffffff);
 }
 
 uint32_t Epoller::GetEvents(size_t i) const {
     assert(i < events_.size() && i >= 0);
     return events_[i].events;
 }
+
+uint32_t Epoller::GetEventGen(size_t i) const {
+    assert(i < events_.size() && i >= 0);
+    return static_cast<uint32_t>(events_[i].data.u64 >> 32);
+}
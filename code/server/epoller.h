@@ -8,25 +8,33 @@
 #include <vector>
 #include <errno.h>
 
-class Epoller {
+#include "poller.h"
+
+class Epoller : public Poller {
 public:
     explicit Epoller(int maxEvent = 1024);  
 
-    ~Epoller();
+    ~Epoller() override;
+
+    bool AddFd(int fd, uint32_t events, uint32_t gen = 0) override;
 
-    bool AddFd(int fd, uint32_t events);
+    bool ModFd(int fd, uint32_t events, uint32_t gen = 0) override;
 
-    bool ModFd(int fd, uint32_t events);
+    bool DelFd(int fd) override;
 
-    bool DelFd(int fd);
+    int Wait(int timeoutMs = -1) override;
 
-    int Wait(int timeoutMs = -1);
+    int GetEventFd(size_t i) const override;
 
-    int GetEventFd(size_t i) const;
+    uint32_t GetEvents(size_t i) const override;
 
-    uint32_t GetEvents(size_t i) const;
+    uint32_t GetEventGen(size_t i) const override;
+
+    const char* Name() const override { return "epoll"; }
         
 private:
+    static uint64_t Encode_(int fd, uint32_t gen);
+
     int epollFd_;   // epoll_create创建一个epoll对象，返回值就是epollFd，可以通过它操作epoll对象
 
     std::vector<struct epoll_event> events_;    // 检测到的事件的集合
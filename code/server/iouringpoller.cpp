@@ -0,0 +1,598 @@
+#include "iouringpoller.h"
+
+using namespace std;
+
+IoUringPoller::IoUringPoller(int maxEvent):
+            ringFd_(-1), ringPtr_(nullptr), ringSz_(0), sqes_(nullptr), sqesSz_(0),
+            bufRing_(nullptr), bufBase_(nullptr), bufTail_(0), wakeFd_(-1),
+            owner_(thread::id()), hasOps_(false), events_(maxEvent) {
+    assert(events_.size() > 0);
+    if(Setup_(maxEvent)) {
+        // 唤醒用的eventfd一直挂着多次poll，第一次Wait时提交
+        PrepWake_();
+    }
+}
+
+IoUringPoller::~IoUringPoller() {
+    Teardown_();
+}
+
+bool IoUringPoller::KernelAtLeast_(int major, int minor) {
+    struct utsname name;
+    int ma = 0, mi = 0;
+    if(uname(&name) < 0 || sscanf(name.release, "%d.%d", &ma, &mi) != 2) {
+        return false;
+    }
+    return ma > major || (ma == major && mi >= minor);
+}
+
+bool IoUringPoller::Setup_(unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    // 多次poll/accept/recv会持续产生CQE，CQ开大一些
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+    params.cq_entries = entries * 4;
+    int fd = syscall(__NR_io_uring_setup, entries, &params);
+    if(fd < 0) {
+        return false;
+    }
+    ringFd_ = fd;
+
+    // EXT_ARG(5.11)用来带超时等待，RSRC_TAGS(5.13)和多次poll同一个版本，用来判断内核是否支持IORING_POLL_ADD_MULTI
+    const unsigned need = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP |
+                          IORING_FEAT_EXT_ARG | IORING_FEAT_RSRC_TAGS;
+    if((params.features & need) != need) {
+        Teardown_();
+        return false;
+    }
+
+    size_t sqSz = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cqSz = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ringSz_ = sqSz > cqSz ? sqSz : cqSz;
+    void* ring = mmap(nullptr, ringSz_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQ_RING);
+    if(ring == MAP_FAILED) {
+        Teardown_();
+        return false;
+    }
+    ringPtr_ = ring;
+
+    sqesSz_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(nullptr, sqesSz_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQES);
+    if(sqes == MAP_FAILED) {
+        Teardown_();
+        return false;
+    }
+    sqes_ = static_cast<struct io_uring_sqe*>(sqes);
+
+    char* base = static_cast<char*>(ringPtr_);
+    sqHead_ = reinterpret_cast<unsigned*>(base + params.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+    sqMask_ = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+    sqEntries_ = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_entries);
+    // SQ的下标数组固定成一一对应，之后只需要移动tail
+    unsigned* sqArray = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+    for(unsigned i = 0; i < sqEntries_; i++) {
+        sqArray[i] = i;
+    }
+    cqHead_ = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe*>(base + params.cq_off.cqes);
+
+    wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(wakeFd_ < 0) {
+        Teardown_();
+        return false;
+    }
+    // 缓冲区环(5.19)和multishot recv(6.0)都有才用完成模式，否则只做就绪通知
+    if(KernelAtLeast_(6, 0)) {
+        SetupBufRing_();
+    }
+    return true;
+}
+
+bool IoUringPoller::SetupBufRing_() {
+    void* ring = mmap(nullptr, BUF_COUNT * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(ring == MAP_FAILED) {
+        return false;
+    }
+    void* bufs = mmap(nullptr, BUF_COUNT * BUF_SIZE, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(bufs == MAP_FAILED) {
+        munmap(ring, BUF_COUNT * sizeof(struct io_uring_buf));
+        return false;
+    }
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+    reg.ring_entries = BUF_COUNT;
+    reg.bgid = BUF_GROUP;
+    if(syscall(__NR_io_uring_register, ringFd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        munmap(bufs, BUF_COUNT * BUF_SIZE);
+        munmap(ring, BUF_COUNT * sizeof(struct io_uring_buf));
+        return false;
+    }
+    bufRing_ = static_cast<struct io_uring_buf_ring*>(ring);
+    bufBase_ = static_cast<char*>(bufs);
+    bufTail_ = 0;
+    // 所有缓冲区都交给内核
+    for(unsigned i = 0; i < BUF_COUNT; i++) {
+        usedBufs_.push_back(i);
+    }
+    RecycleBufs_();
+    return true;
+}
+
+void IoUringPoller::Teardown_() {
+    if(bufRing_) {
+        munmap(bufBase_, BUF_COUNT * BUF_SIZE);
+        munmap(bufRing_, BUF_COUNT * sizeof(struct io_uring_buf));
+        bufRing_ = nullptr;
+        bufBase_ = nullptr;
+    }
+    if(sqes_) {
+        munmap(sqes_, sqesSz_);
+        sqes_ = nullptr;
+    }
+    if(ringPtr_) {
+        munmap(ringPtr_, ringSz_);
+        ringPtr_ = nullptr;
+    }
+    if(ringFd_ >= 0) {
+        close(ringFd_);
+        ringFd_ = -1;
+    }
+    if(wakeFd_ >= 0) {
+        close(wakeFd_);
+        wakeFd_ = -1;
+    }
+}
+
+uint64_t IoUringPoller::Encode_(Kind kind, int fd, uint32_t gen) {
+    return (static_cast<uint64_t>(kind) << 61) | (static_cast<uint64_t>(gen & GEN_MASK) << 32) |
+           static_cast<uint32_t>(fd);
+}
+
+unsigned IoUringPoller::Pending_() const {
+    return *sqTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+}
+
+int IoUringPoller::Enter_(unsigned toSubmit, unsigned minComplete, int timeoutMs) {
+    unsigned flags = 0;
+    void* arg = nullptr;
+    size_t argSz = 0;
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg extArg;
+    if(minComplete > 0) {
+        flags |= IORING_ENTER_GETEVENTS;
+        if(timeoutMs >= 0) {
+            ts.tv_sec = timeoutMs / 1000;
+            ts.tv_nsec = (timeoutMs % 1000) * 1000000LL;
+            memset(&extArg, 0, sizeof(extArg));
+            extArg.ts = reinterpret_cast<uint64_t>(&ts);
+            flags |= IORING_ENTER_EXT_ARG;
+            arg = &extArg;
+            argSz = sizeof(extArg);
+        }
+    }
+    else if(toSubmit == 0) {
+        return 0;
+    }
+    int ret = syscall(__NR_io_uring_enter, ringFd_, toSubmit, minComplete, flags, arg, argSz);
+    return ret < 0 ? -errno : ret;
+}
+
+struct io_uring_sqe* IoUringPoller::GetSqe_() {
+    if(Pending_() >= sqEntries_) {
+        // SQ满了，先把攒着的提交掉
+        Enter_(Pending_(), 0, 0);
+        if(Pending_() >= sqEntries_) {
+            return nullptr;
+        }
+    }
+    struct io_uring_sqe* sqe = &sqes_[*sqTail_ & sqMask_];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+void IoUringPoller::Push_() {
+    // SQE填好之后再移动tail，内核不会取到没填完的SQE
+    __atomic_store_n(sqTail_, *sqTail_ + 1, __ATOMIC_RELEASE);
+}
+
+void IoUringPoller::PrepPoll_(int fd, FdState& st) {
+    uint32_t mask = st.events & ~(EPOLLET | EPOLLONESHOT);
+    if(st.receiver) {
+        // 数据由recv交回来，poll只用来等可写
+        mask &= ~EPOLLIN;
+        if(!(mask & EPOLLOUT)) {
+            st.armed = false;
+            return;
+        }
+    }
+    struct io_uring_sqe* sqe = GetSqe_();
+    if(!sqe) {
+        st.armed = false;
+        return;
+    }
+#if __BYTE_ORDER == __BIG_ENDIAN
+    mask = (mask << 16) | (mask >> 16);
+#endif
+    st.pollGen = (st.pollGen + 1) & GEN_MASK;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = mask;
+    if((st.events & EPOLLET) && !(st.events & EPOLLONESHOT)) {
+        sqe->len = IORING_POLL_ADD_MULTI;
+    }
+    sqe->user_data = Encode_(KIND_POLL, fd, st.pollGen);
+    Push_();
+    st.armed = true;
+}
+
+void IoUringPoller::PrepAccept_(int fd, FdState& st) {
+    struct io_uring_sqe* sqe = GetSqe_();
+    if(!sqe) {
+        st.armed = false;
+        return;
+    }
+    // 不要对端地址：多次accept共用一个地址缓冲区会被后面的连接覆盖，需要时由连接自己getpeername
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = Encode_(KIND_ACCEPT, fd, st.pollGen);
+    Push_();
+    st.armed = true;
+}
+
+void IoUringPoller::PrepRecv_(int fd, FdState& st) {
+    struct io_uring_sqe* sqe = GetSqe_();
+    if(!sqe) {
+        st.recvArmed = false;
+        return;
+    }
+    // 每次有数据就从缓冲区环里取一个缓冲区，一直挂着直到出错、对端关闭或者被取消
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUF_GROUP;
+    sqe->user_data = Encode_(KIND_RECV, fd, st.recvGen);
+    Push_();
+    st.recvArmed = true;
+}
+
+void IoUringPoller::PrepCancel_(uint64_t target, bool isPoll) {
+    struct io_uring_sqe* sqe = GetSqe_();
+    if(!sqe) { return; }
+    sqe->opcode = isPoll ? IORING_OP_POLL_REMOVE : IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->user_data = INTERNAL_OP;
+    Push_();
+}
+
+void IoUringPoller::PrepWake_() {
+    struct io_uring_sqe* sqe = GetSqe_();
+    if(!sqe) { return; }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = wakeFd_;
+    sqe->poll32_events = EPOLLIN;
+#if __BYTE_ORDER == __BIG_ENDIAN
+    sqe->poll32_events = (EPOLLIN << 16) | (EPOLLIN >> 16);
+#endif
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = Encode_(KIND_WAKE, wakeFd_, 0);
+    Push_();
+}
+
+void IoUringPoller::RecycleBufs_() {
+    if(usedBufs_.empty()) { return; }
+    // 不用bufRing_->bufs：头文件里的柔性数组在C++下前面多了一个空结构体，偏移和内核不一致；
+    // 环本身就是io_uring_buf数组，tail和第0项的resv重叠
+    struct io_uring_buf* bufs = reinterpret_cast<struct io_uring_buf*>(bufRing_);
+    for(unsigned short bid: usedBufs_) {
+        struct io_uring_buf* buf = &bufs[bufTail_ & (BUF_COUNT - 1)];
+        buf->addr = reinterpret_cast<uint64_t>(bufBase_ + static_cast<size_t>(bid) * BUF_SIZE);
+        buf->len = BUF_SIZE;
+        buf->bid = bid;
+        bufTail_++;
+    }
+    // 缓冲区填好之后再移动tail
+    __atomic_store_n(&bufRing_->tail, bufTail_, __ATOMIC_RELEASE);
+    usedBufs_.clear();
+}
+
+bool IoUringPoller::IsOwner_() const {
+    return owner_.load(memory_order_acquire) == this_thread::get_id();
+}
+
+bool IoUringPoller::Submit_(const Op& op) {
+    if(IsOwner_()) {
+        // 先执行别的线程排在前面的操作，比如工作线程关闭连接时的DelFd要在同一个fd重新AddFd之前
+        DrainOps_();
+        return Apply_(op);
+    }
+    {
+        lock_guard<mutex> locker(mtx_);
+        ops_.push_back(op);
+    }
+    // 事件循环还没开始时不用叫醒，第一次Wait会先执行排队的操作
+    if(!hasOps_.exchange(true, memory_order_acq_rel) && owner_.load(memory_order_acquire) != thread::id()) {
+        uint64_t one = 1;
+        if(::write(wakeFd_, &one, sizeof(one)) != sizeof(one)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void IoUringPoller::DrainOps_() {
+    if(!hasOps_.exchange(false, memory_order_acq_rel)) { return; }
+    {
+        lock_guard<mutex> locker(mtx_);
+        draining_.swap(ops_);
+    }
+    for(const Op& op: draining_) {
+        Apply_(op);
+    }
+    draining_.clear();
+}
+
+IoUringPoller::FdState* IoUringPoller::State_(int fd, bool grow) {
+    if(static_cast<size_t>(fd) >= fds_.size()) {
+        if(!grow) { return nullptr; }
+        fds_.resize(max(static_cast<size_t>(fd) + 1, fds_.size() * 2));
+    }
+    return &fds_[fd];
+}
+
+bool IoUringPoller::Apply_(const Op& op) {
+    bool add = op.type == OP_ADD || op.type == OP_ACCEPT || op.type == OP_RECV;
+    FdState* st = State_(op.fd, add);
+    if(!st || (!add && !st->events)) {
+        errno = ENOENT;
+        return false;
+    }
+    switch(op.type) {
+    case OP_ADD:
+        if(st->events) {
+            errno = EEXIST;
+            return false;
+        }
+        st->events = op.events | EPOLLERR;
+        st->connGen = op.gen;
+        PrepPoll_(op.fd, *st);
+        return st->armed;
+    case OP_MOD:
+        if(st->armed && !st->acceptor) {
+            PrepCancel_(Encode_(KIND_POLL, op.fd, st->pollGen), true);
+            st->armed = false;
+        }
+        st->events = op.events | EPOLLERR;
+        st->connGen = op.gen;
+        PrepPoll_(op.fd, *st);
+        return true;
+    case OP_DEL:
+        if(st->armed) {
+            PrepCancel_(Encode_(st->acceptor ? KIND_ACCEPT : KIND_POLL, op.fd, st->pollGen), !st->acceptor);
+        }
+        if(st->recvArmed) {
+            PrepCancel_(Encode_(KIND_RECV, op.fd, st->recvGen), false);
+        }
+        // 代数加一，已经在CQ里的这个fd的结果都作废（recv的缓冲区照样回收）
+        st->pollGen = (st->pollGen + 1) & GEN_MASK;
+        st->recvGen = (st->recvGen + 1) & GEN_MASK;
+        st->events = 0;
+        st->armed = st->acceptor = st->receiver = st->recvPaused = st->recvArmed = false;
+        return true;
+    case OP_ACCEPT:
+        if(st->events) {
+            errno = EEXIST;
+            return false;
+        }
+        st->events = EPOLLIN | EPOLLERR;
+        st->acceptor = true;
+        st->connGen = 0;
+        PrepAccept_(op.fd, *st);
+        return st->armed;
+    case OP_RECV:
+        if(!st->events) {
+            st->events = EPOLLIN | EPOLLERR;
+            st->connGen = op.gen;
+        }
+        if(st->armed && !st->receiver) {
+            // 原来AddFd挂的poll里可能有EPOLLIN，按收数据的方式重新挂
+            PrepCancel_(Encode_(KIND_POLL, op.fd, st->pollGen), true);
+            st->receiver = true;
+            PrepPoll_(op.fd, *st);
+        }
+        st->receiver = true;
+        st->recvPaused = false;
+        // 暂停时发出的取消还没回来的话，等它回来再重新挂
+        if(!st->recvArmed) {
+            PrepRecv_(op.fd, *st);
+        }
+        return true;
+    case OP_NORECV:
+        if(!st->receiver) {
+            errno = EINVAL;
+            return false;
+        }
+        if(!st->recvPaused && st->recvArmed) {
+            // 代数不变：取消之前已经收进缓冲区的数据还要交回去
+            PrepCancel_(Encode_(KIND_RECV, op.fd, st->recvGen), false);
+        }
+        st->recvPaused = true;
+        return true;
+    }
+    return false;
+}
+
+bool IoUringPoller::AddFd(int fd, uint32_t events, uint32_t gen) {
+    if(fd < 0) return false;
+    return Submit_({ OP_ADD, fd, events, gen });
+}
+
+bool IoUringPoller::ModFd(int fd, uint32_t events, uint32_t gen) {
+    if(fd < 0) return false;
+    return Submit_({ OP_MOD, fd, events, gen });
+}
+
+bool IoUringPoller::DelFd(int fd) {
+    if(fd < 0) return false;
+    return Submit_({ OP_DEL, fd, 0, 0 });
+}
+
+bool IoUringPoller::AddAcceptor(int listenFd) {
+    if(listenFd < 0 || !bufRing_) return false;
+    return Submit_({ OP_ACCEPT, listenFd, 0, 0 });
+}
+
+bool IoUringPoller::AddReceiver(int fd, uint32_t gen) {
+    if(fd < 0 || !bufRing_) return false;
+    return Submit_({ OP_RECV, fd, 0, gen });
+}
+
+bool IoUringPoller::DelReceiver(int fd) {
+    if(fd < 0 || !bufRing_) return false;
+    return Submit_({ OP_NORECV, fd, 0, 0 });
+}
+
+int IoUringPoller::Harvest_() {
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    int n = 0;
+    while(head != tail && n < static_cast<int>(events_.size())) {
+        struct io_uring_cqe* cqe = &cqes_[head & cqMask_];
+        head++;
+        uint64_t data = cqe->user_data;
+        if(data & INTERNAL_OP) { continue; }
+        Kind kind = static_cast<Kind>((data >> 61) & 3);
+        int fd = static_cast<int>(data & 0xffffffff);
+        uint32_t gen = static_cast<uint32_t>(data >> 32) & GEN_MASK;
+        int res = cqe->res;
+        bool more = cqe->flags & IORING_CQE_F_MORE;
+        const char* buf = nullptr;
+        if(kind == KIND_RECV && (cqe->flags & IORING_CQE_F_BUFFER)) {
+            // 不管这个结果还要不要，缓冲区都要还
+            unsigned short bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+            usedBufs_.push_back(bid);
+            buf = bufBase_ + static_cast<size_t>(bid) * BUF_SIZE;
+        }
+        if(kind == KIND_WAKE) {
+            uint64_t cnt = 0;
+            if(::read(wakeFd_, &cnt, sizeof(cnt)) < 0 && errno != EAGAIN) { continue; }
+            if(!more) { PrepWake_(); }
+            continue;
+        }
+        if(static_cast<size_t>(fd) >= fds_.size()) { continue; }
+        FdState& st = fds_[fd];
+        Event& ev = events_[n];
+        ev.fd = fd;
+        ev.connGen = st.connGen;
+        ev.res = 0;
+        ev.data = nullptr;
+        ev.completion = false;
+
+        if(kind == KIND_RECV) {
+            // 连接已经删掉了，这是它的旧结果
+            if(!st.receiver || st.recvGen != gen) { continue; }
+            if(!more) { st.recvArmed = false; }
+            // 缓冲区用完了(-ENOBUFS)或者暂停时被取消，数据还在socket里，重新挂上就行
+            bool retry = res == -ENOBUFS || res == -ECANCELED;
+            if(!retry) {
+                ev.events = res < 0 ? EPOLLERR : EPOLLIN;
+                ev.res = res;
+                ev.data = buf;
+                ev.completion = true;
+                n++;
+            }
+            if(!st.recvArmed && !st.recvPaused && (res > 0 || retry)) {
+                PrepRecv_(fd, st);
+            }
+            continue;
+        }
+        if(kind == KIND_ACCEPT) {
+            if(!st.acceptor || st.pollGen != gen) { continue; }
+            if(!more) { st.armed = false; }
+            if(res != -ECANCELED) {
+                ev.events = res < 0 ? EPOLLERR : EPOLLIN;
+                ev.res = res;
+                ev.completion = true;
+                n++;
+            }
+            // 出错（比如fd用完了）时内核会停掉multishot accept，重新挂上
+            if(!st.armed && res != -EINVAL) {
+                PrepAccept_(fd, st);
+            }
+            continue;
+        }
+        // 已经删除或者重新注册过了，这是旧的poll产生的事件
+        if(!st.events || st.acceptor || st.pollGen != gen) { continue; }
+        if(!more) {
+            st.armed = false;
+        }
+        if(res != -ECANCELED) {
+            ev.events = res < 0 ? EPOLLERR : static_cast<uint32_t>(res);
+            n++;
+        }
+        // 水平触发，或者多次poll被内核终止了，重新挂上poll，下次Wait时一起提交
+        if(!st.armed && !(st.events & EPOLLONESHOT)) {
+            PrepPoll_(fd, st);
+        }
+    }
+    __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+    return n;
+}
+
+int IoUringPoller::Wait(int timeoutMs) {
+    if(!IsOwner_()) {
+        owner_.store(this_thread::get_id(), memory_order_release);
+    }
+    // 别的线程排的注册操作、上一轮交出去的缓冲区，和等待一起提交
+    DrainOps_();
+    if(bufRing_) { RecycleBufs_(); }
+    // CQ里还有上次没取完的事件，不用再等了
+    if(*cqHead_ != __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE)) {
+        Enter_(Pending_(), 0, 0);
+        return Harvest_();
+    }
+    // 把攒下来的注册和等待合成一次io_uring_enter，没提交完的（如-EBUSY）留在SQ里下次再提交
+    Enter_(Pending_(), timeoutMs == 0 ? 0 : 1, timeoutMs);
+    return Harvest_();
+}
+
+int IoUringPoller::GetEventFd(size_t i) const {
+    assert(i < events_.size() && i >= 0);
+    return events_[i].fd;
+}
+
+uint32_t IoUringPoller::GetEvents(size_t i) const {
+    assert(i < events_.size() && i >= 0);
+    return events_[i].events;
+}
+
+uint32_t IoUringPoller::GetEventGen(size_t i) const {
+    assert(i < events_.size() && i >= 0);
+    return events_[i].connGen;
+}
+
+bool IoUringPoller::IsCompletion(size_t i) const {
+    assert(i < events_.size() && i >= 0);
+    return events_[i].completion;
+}
+
+int IoUringPoller::GetEventResult(size_t i) const {
+    assert(i < events_.size() && i >= 0);
+    return events_[i].res;
+}
+
+const char* IoUringPoller::GetEventData(size_t i) const {
+    assert(i < events_.size() && i >= 0);
+    return events_[i].data;
+}
@@ -0,0 +1,183 @@
+#ifndef IOURING_POLLER_H
+#define IOURING_POLLER_H
+
+#include <linux/io_uring.h>
+#include <linux/time_types.h>   // __kernel_timespec
+#include <sys/syscall.h>        // __NR_io_uring_setup, __NR_io_uring_enter, __NR_io_uring_register
+#include <sys/mman.h>           // mmap, munmap
+#include <sys/eventfd.h>        // eventfd()
+#include <sys/utsname.h>        // uname()
+#include <sys/socket.h>         // SOCK_NONBLOCK, SOCK_CLOEXEC
+#include <unistd.h>             // close()
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>              // sscanf
+#include <string.h>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+
+#include "poller.h"
+
+/**
+ * 基于io_uring的Poller，直接用系统调用，不依赖liburing
+ * 就绪模式：用IORING_OP_POLL_ADD代替epoll_ctl，注册/修改/删除都只是往SQ里放一个SQE，
+ * 在下一次Wait的io_uring_enter里和等待一起提交，一次系统调用完成"改监听+等事件"
+ *   EPOLLONESHOT       -> 单次poll，触发后需要ModFd重新注册
+ *   EPOLLET            -> 多次poll（IORING_POLL_ADD_MULTI），一直挂着不用重新注册
+ *   水平触发            -> 单次poll，触发后自动重新挂上，下次Wait时一起提交
+ * 完成模式（内核6.0以上）：监听socket挂multishot accept，连接挂multishot recv，
+ * recv的数据由内核直接放进注册好的缓冲区环（provided buffer ring），事件里带着数据，
+ * 读请求不再需要"等可读 + readv"两次系统调用；缓冲区在下一次Wait时还给内核
+ *
+ * SQ、CQ、缓冲区环和fds_只有调用Wait的线程（事件循环）在用，不加锁；
+ * 别的线程调用AddFd/ModFd/DelFd时把操作放进ops_排队，用eventfd唤醒事件循环，由它来提交
+*/
+class IoUringPoller : public Poller {
+public:
+    explicit IoUringPoller(int maxEvent = 1024);
+
+    ~IoUringPoller() override;
+
+    bool IsValid() const { return ringFd_ >= 0; }  // 内核不支持时为false
+
+    bool AddFd(int fd, uint32_t events, uint32_t gen = 0) override;
+
+    bool ModFd(int fd, uint32_t events, uint32_t gen = 0) override;
+
+    bool DelFd(int fd) override;
+
+    int Wait(int timeoutMs = -1) override;
+
+    int GetEventFd(size_t i) const override;
+
+    uint32_t GetEvents(size_t i) const override;
+
+    uint32_t GetEventGen(size_t i) const override;
+
+    const char* Name() const override { return "io_uring"; }
+
+    bool AddAcceptor(int listenFd) override;
+
+    bool AddReceiver(int fd, uint32_t gen = 0) override;
+
+    bool DelReceiver(int fd) override;
+
+    bool IsCompletion(size_t i) const override;
+
+    int GetEventResult(size_t i) const override;
+
+    const char* GetEventData(size_t i) const override;
+
+    static const unsigned BUF_COUNT = 256;      // 缓冲区环的大小，2的幂
+    static const unsigned BUF_SIZE = 8192;      // 每个缓冲区的大小，一个recv最多交回来这么多
+    static const unsigned BUF_GROUP = 0;
+
+private:
+    // 注册操作，别的线程调用时排队
+    enum OpType {
+        OP_ADD,
+        OP_MOD,
+        OP_DEL,
+        OP_ACCEPT,
+        OP_RECV,
+        OP_NORECV,
+    };
+
+    struct Op {
+        OpType type;
+        int fd;
+        uint32_t events;
+        uint32_t gen;
+    };
+
+    // user_data里区分是哪一种请求
+    enum Kind {
+        KIND_POLL,
+        KIND_ACCEPT,
+        KIND_RECV,
+        KIND_WAKE,
+    };
+
+    struct FdState {
+        uint32_t events = 0;    // 注册的事件，0表示没有注册
+        uint32_t pollGen = 0;   // 每次重新挂poll加一，用来过滤已经删除的poll产生的旧事件
+        uint32_t recvGen = 0;   // 同上，recv用
+        bool armed = false;     // 内核里是否还挂着poll
+        bool acceptor = false;  // 监听socket，挂的是multishot accept
+        bool receiver = false;  // 用recv收数据（AddReceiver），EPOLLIN不再poll
+        bool recvPaused = false;    // DelReceiver暂停了，已经收到的数据照常交回去
+        bool recvArmed = false; // 内核里是否还挂着recv
+        uint32_t connGen = 0;   // 调用者传进来的连接代数，事件返回时带回去
+    };
+
+    struct Event {
+        int fd;
+        uint32_t events;
+        uint32_t connGen;
+        int res;            // 完成模式的结果，就绪事件是0
+        const char* data;   // recv到的数据
+        bool completion;
+    };
+
+    bool Setup_(unsigned entries);
+    bool SetupBufRing_();
+    void Teardown_();
+
+    bool IsOwner_() const;
+    bool Submit_(const Op& op);     // 事件循环线程直接执行，其他线程排队
+    void DrainOps_();
+    bool Apply_(const Op& op);
+    FdState* State_(int fd, bool grow);
+
+    struct io_uring_sqe* GetSqe_();     // 以下函数只在事件循环线程里调用
+    void Push_();
+    void PrepPoll_(int fd, FdState& st);
+    void PrepAccept_(int fd, FdState& st);
+    void PrepRecv_(int fd, FdState& st);
+    void PrepCancel_(uint64_t target, bool isPoll);
+    void PrepWake_();
+    void RecycleBufs_();
+    unsigned Pending_() const;      // 放进SQ还没有被内核取走的SQE个数
+    int Enter_(unsigned toSubmit, unsigned minComplete, int timeoutMs);
+    int Harvest_();
+
+    static uint64_t Encode_(Kind kind, int fd, uint32_t gen);
+    static bool KernelAtLeast_(int major, int minor);
+
+    static const uint64_t INTERNAL_OP = 1ULL << 63;     // POLL_REMOVE、ASYNC_CANCEL等内部操作的user_data标记
+    static const uint32_t GEN_MASK = (1u << 29) - 1;    // user_data里代数占29位，上面是类型
+
+    int ringFd_;
+    void* ringPtr_;     // SQ和CQ共用一次mmap（IORING_FEAT_SINGLE_MMAP）
+    size_t ringSz_;
+    struct io_uring_sqe* sqes_;
+    size_t sqesSz_;
+
+    unsigned* sqHead_;
+    unsigned* sqTail_;
+    unsigned sqMask_;
+    unsigned sqEntries_;
+    unsigned* cqHead_;
+    unsigned* cqTail_;
+    unsigned cqMask_;
+    struct io_uring_cqe* cqes_;
+
+    struct io_uring_buf_ring* bufRing_;     // 缓冲区环，和内核共享，nullptr表示不支持完成模式
+    char* bufBase_;         // BUF_COUNT个缓冲区连在一起
+    unsigned short bufTail_;
+    std::vector<unsigned short> usedBufs_;  // 上一次Wait交出去的缓冲区，下一次Wait时还给内核
+
+    int wakeFd_;    // 别的线程排了操作时写它，把事件循环从io_uring_enter里叫醒
+    std::atomic<std::thread::id> owner_;    // 调用Wait的线程
+    std::atomic<bool> hasOps_;  // ops_里有没有东西，没有时事件循环不用拿锁
+    std::mutex mtx_;        // 保护ops_
+    std::vector<Op> ops_;   // 别的线程排队的注册操作
+    std::vector<Op> draining_;
+
+    std::vector<FdState> fds_;      // 以fd为下标
+    std::vector<Event> events_;     // 检测到的事件的集合
+};
+
+#endif //IOURING_POLLER_H
@@ -0,0 +1,17 @@
+#include "poller.h"
+#include "epoller.h"
+#include "iouringpoller.h"
+#include "../log/log.h"
+
+Poller* Poller::Create(bool useIoUring, int maxEvent) {
+    if(useIoUring) {
+        IoUringPoller* poller = new IoUringPoller(maxEvent);
+        if(poller->IsValid()) {
+            return poller;
+        }
+        // 内核太老、被禁用（kernel.io_uring_disabled）或者被seccomp拦截时退回epoll
+        delete poller;
+        LOG_WARN("io_uring unavailable, fallback to epoll!");
+    }
+    return new Epoller(maxEvent);
+}
@@ -0,0 +1,59 @@
+#ifndef POLLER_H
+#define POLLER_H
+
+#include <sys/epoll.h>  // EPOLLIN EPOLLOUT EPOLLET EPOLLONESHOT ...
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * I/O多路复用的抽象接口
+ * 事件统一用epoll的标志表示（EPOLLIN/EPOLLOUT/EPOLLRDHUP/EPOLLET/EPOLLONESHOT）
+ * 注册时可以带一个连接的代数，事件返回时原样带回来，用来识别fd被复用之前的旧事件
+ * 默认实现是Epoller，内核支持时可以换成IoUringPoller
+ * 注册函数可以在别的线程里调用（线程池模式下工作线程重新注册EPOLLONESHOT）
+*/
+class Poller {
+public:
+    virtual ~Poller() = default;
+
+    virtual bool AddFd(int fd, uint32_t events, uint32_t gen = 0) = 0;
+
+    virtual bool ModFd(int fd, uint32_t events, uint32_t gen = 0) = 0;
+
+    virtual bool DelFd(int fd) = 0;
+
+    virtual int Wait(int timeoutMs = -1) = 0;
+
+    virtual int GetEventFd(size_t i) const = 0;
+
+    virtual uint32_t GetEvents(size_t i) const = 0;
+
+    virtual uint32_t GetEventGen(size_t i) const = 0;
+
+    virtual const char* Name() const = 0;   // 后端的名字，打日志用
+
+    /**
+     * 完成模式：accept/recv由内核直接做完，事件里带着结果，不用再调用accept4/readv
+     * 只有io_uring支持，不支持的后端返回false，调用方照常用AddFd注册就绪事件
+     * 只能在调用Wait的线程里用（recv的数据所在的缓冲区由它回收）
+    */
+    virtual bool AddAcceptor(int listenFd) { (void)listenFd; return false; }   // 每个新连接一个事件
+
+    // 注册fd并一直收数据，收到的数据作为带结果的EPOLLIN事件交回来；
+    // 之后ModFd只用来等EPOLLOUT（EPOLLIN不再另外poll），DelFd时一起取消
+    virtual bool AddReceiver(int fd, uint32_t gen = 0) { (void)fd; (void)gen; return false; }
+
+    virtual bool DelReceiver(int fd) { (void)fd; return false; }    // 暂停收数据（回压），AddReceiver恢复
+
+    virtual bool IsCompletion(size_t i) const { (void)i; return false; }   // 这个事件是否带着结果
+
+    // accept到的fd，或者recv到的字节数（0表示对端关闭），出错时是-errno
+    virtual int GetEventResult(size_t i) const { (void)i; return 0; }
+
+    virtual const char* GetEventData(size_t i) const { (void)i; return nullptr; }   // recv到的数据，下一次Wait之前有效
+
+    // useIoUring为true时优先使用io_uring，内核不支持就退回epoll
+    static Poller* Create(bool useIoUring, int maxEvent = 1024);
+};
+
+#endif //POLLER_H
@@ -0,0 +1,326 @@
+#include "subreactor.h"
+
+using namespace std;
+
+SubReactor::SubReactor(int id, int timeoutMS, uint32_t connEvent, ConnSlab* slab, bool ioUring):
+            id_(id), timeoutMS_(timeoutMS), connEvent_(connEvent), isClose_(false),
+            listenFd_(-1), listenEvent_(0), cpu_(-1),
+            timer_(new TimingWheel([this](WheelNode* node) { CloseConn_(static_cast<HttpConn*>(node->owner)); })), poller_(Poller::Create(ioUring)), slab_(slab)
+    {
+    wakeupFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    assert(wakeupFd_ >= 0);
+    // eventfd用水平触发，读掉计数之前一直有事件
+    poller_->AddFd(wakeupFd_, EPOLLIN);
+}
+
+SubReactor::~SubReactor() {
+    Stop();
+    // 还没来得及注册的连接直接关掉
+    for(auto& item: pending_) {
+        close(item.first);
+    }
+    pending_.clear();
+    if(listenFd_ >= 0) { close(listenFd_); }
+    close(wakeupFd_);
+}
+
+void SubReactor::SetListener(int listenFd, uint32_t listenEvent, int cpu) {
+    assert(listenFd >= 0 && listenFd_ < 0);
+    listenFd_ = listenFd;
+    listenEvent_ = listenEvent;
+    cpu_ = cpu;
+    // 支持的话由内核直接accept，每个新连接一个事件
+    if(!poller_->AddAcceptor(listenFd_)) {
+        poller_->AddFd(listenFd_, listenEvent_ | EPOLLIN);
+    }
+}
+
+void SubReactor::Start() {
+    thread_ = std::thread(&SubReactor::Loop_, this);
+}
+
+void SubReactor::Stop() {
+    isClose_ = true;
+    Wakeup_();
+    if(thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+// 在主线程中执行
+void SubReactor::AddConn(int fd, const sockaddr_in& addr) {
+    assert(fd > 0);
+    {
+        lock_guard<mutex> locker(mtx_);
+        pending_.emplace_back(fd, addr);
+    }
+    Wakeup_();
+}
+
+void SubReactor::Wakeup_() {
+    uint64_t one = 1;
+    ssize_t ret = ::write(wakeupFd_, &one, sizeof(one));
+    if(ret != sizeof(one)) {
+        LOG_WARN("Reactor[%d] wakeup error!", id_);
+    }
+}
+
+void SubReactor::HandleWakeup_() {
+    uint64_t cnt = 0;
+    ssize_t ret = ::read(wakeupFd_, &cnt, sizeof(cnt));
+    if(ret != sizeof(cnt) && errno != EAGAIN) {
+        LOG_WARN("Reactor[%d] read wakeup error!", id_);
+    }
+    // 把待注册的连接一次性换出来，尽量缩短持锁时间
+    vector<pair<int, sockaddr_in>> conns;
+    {
+        lock_guard<mutex> locker(mtx_);
+        conns.swap(pending_);
+    }
+    for(auto& item: conns) {
+        AddClient_(item.first, item.second);
+    }
+}
+
+void SubReactor::Loop_() {
+    int timeMS = -1;  /* epoll wait timeout == -1 无事件将阻塞 */
+    if(cpu_ >= 0) {
+        // 绑定到监听socket对应的CPU上，accept和后续读写都不离开这个核
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(cpu_, &cpuset);
+        if(pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset) != 0) {
+            LOG_WARN("Reactor[%d] bind cpu %d error!", id_, cpu_);
+        }
+    }
+    LOG_INFO("Reactor[%d] start, poller: %s", id_, poller_->Name());
+    while(!isClose_) {
+        if(timeoutMS_ > 0) {
+            timeMS = timer_->GetNextTick();
+        }
+        int eventCnt = poller_->Wait(timeMS);
+        for(int i = 0; i < eventCnt; i++) {
+            int fd = poller_->GetEventFd(i);
+            uint32_t events = poller_->GetEvents(i);
+            if(fd == wakeupFd_) {
+                HandleWakeup_();
+                continue;
+            }
+            else if(fd == listenFd_) {
+                if(!poller_->IsCompletion(i)) {
+                    DealListen_();
+                }
+                else if(poller_->GetEventResult(i) > 0) {
+                    // 对端地址等用到时再取
+                    sockaddr_in addr = {};
+                    AcceptFd_(poller_->GetEventResult(i), addr);
+                }
+                continue;
+            }
+            uint32_t gen = poller_->GetEventGen(i);
+            if(ConnSlab::IsSqlEvent(gen)) {
+                // 连接等待的数据库socket有结果了
+                HttpConn* client = slab_->GetSqlWaiter(fd, gen);
+                if(client) {
+                    ExtentTime_(client);
+                    OnSql_(client, events);
+                }
+                continue;
+            }
+            HttpConn* client = slab_->Get(fd, gen);
+            if(!client) {
+                LOG_DEBUG("Client[%d] stale event", fd);
+            }
+            else if(poller_->IsCompletion(i)) {
+                ExtentTime_(client);
+                OnRecv_(client, poller_->GetEventResult(i), poller_->GetEventData(i));
+            }
+            else if((events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) && !client->IsLingering()) {
+                CloseConn_(client);
+            }
+            // 延迟关闭中的连接对端关闭时也要先把数据读掉
+            else if(events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                ExtentTime_(client);
+                OnRead_(client);
+            }
+            else if(events & EPOLLOUT) {
+                ExtentTime_(client);
+                OnWrite_(client);
+            } else {
+                LOG_ERROR("Unexpected event");
+            }
+        }
+    }
+    LOG_INFO("Reactor[%d] quit", id_);
+}
+
+void SubReactor::DealListen_() {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    do {
+        int fd = accept4(listenFd_, (struct sockaddr *)&addr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd <= 0 || !AcceptFd_(fd, addr)) { return; }
+    } while(listenEvent_ & EPOLLET);
+}
+
+// 连接表满了回一句忙就关掉，返回false
+bool SubReactor::AcceptFd_(int fd, const sockaddr_in& addr) {
+    if(static_cast<size_t>(fd) >= slab_->Capacity()) {
+        const char* info = "Server busy!";
+        if(send(fd, info, strlen(info), 0) < 0) {
+            LOG_WARN("send error to client[%d] error!", fd);
+        }
+        close(fd);
+        LOG_WARN("Clients is full!");
+        return false;
+    }
+    AddClient_(fd, addr);
+    return true;
+}
+
+void SubReactor::AddClient_(int fd, const sockaddr_in& addr) {
+    assert(fd > 0);
+    HttpConn* client = slab_->Open(fd);
+    client->init(fd, addr);
+    if(timeoutMS_ > 0) {
+        timer_->Add(client->TimerNode(), timeoutMS_);
+    }
+    // 支持的话由内核一直收数据，读请求不用再等可读
+    if(!poller_->AddReceiver(fd, slab_->Gen(fd))) {
+        poller_->AddFd(fd, EPOLLIN | connEvent_, slab_->Gen(fd));
+    }
+    LOG_INFO("Client[%d] in reactor[%d]!", fd, id_);
+}
+
+void SubReactor::CloseConn_(HttpConn* client) {
+    assert(client);
+    LOG_INFO("Client[%d] quit!", client->GetFd());
+    poller_->DelFd(client->GetFd());
+    if(client->SqlPending()) { poller_->DelFd(client->SqlFd()); }
+    slab_->Close(client->GetFd());
+    // 定时器只在本线程里用，关闭时直接摘掉
+    timer_->Cancel(client->TimerNode());
+    client->Close();
+}
+
+void SubReactor::FinishConn_(HttpConn* client) {
+    if(!client->StartLinger()) {
+        CloseConn_(client);
+        return;
+    }
+    // 写端已经关了，只等对端的数据，读到的都扔掉
+    int fd = client->GetFd();
+    poller_->ModFd(fd, connEvent_ | EPOLLIN, slab_->Gen(fd));
+    poller_->AddReceiver(fd, slab_->Gen(fd));
+}
+
+void SubReactor::ExtentTime_(HttpConn* client) {
+    assert(client);
+    if(timeoutMS_ > 0) { timer_->Adjust(client->TimerNode(), timeoutMS_); }
+}
+
+void SubReactor::OnRead_(HttpConn* client) {
+    assert(client);
+    int readErrno = 0;
+    if(client->IsLingering()) {
+        if(!client->Linger(&readErrno)) { CloseConn_(client); }
+        return;
+    }
+    // 等数据库时对端还在发，最多读到MAX_PENDING_READ
+    ssize_t ret = client->read(&readErrno, client->SqlPending() ? MAX_PENDING_READ : SIZE_MAX);
+    if(ret <= 0 && readErrno != EAGAIN) {
+        CloseConn_(client);
+        return;
+    }
+    // 这一批挂起在等数据库，新读到的请求先留在缓冲区里，攒多了先不监听EPOLLIN，数据库回来以后再恢复
+    if(client->SqlPending()) {
+        if(client->ReadBytes() >= MAX_PENDING_READ) {
+            poller_->ModFd(client->GetFd(), connEvent_, slab_->Gen(client->GetFd()));
+        }
+        return;
+    }
+    OnProcess_(client);
+}
+
+void SubReactor::OnRecv_(HttpConn* client, int len, const char* data) {
+    assert(client);
+    // 0是对端关闭，负数是出错
+    if(len <= 0) {
+        CloseConn_(client);
+        return;
+    }
+    if(client->IsLingering()) {
+        if(!client->Linger(static_cast<size_t>(len))) { CloseConn_(client); }
+        return;
+    }
+    client->AppendRead(data, len);
+    // 上一批还没发完或者在等数据库，新请求先留在缓冲区里，攒多了先暂停收数据
+    if(client->ToWriteBytes() > 0 || client->SqlPending()) {
+        if(client->ReadBytes() >= MAX_PENDING_READ) {
+            poller_->DelReceiver(client->GetFd());
+        }
+        return;
+    }
+    OnProcess_(client);
+}
+
+void SubReactor::OnProcess_(HttpConn* client, bool resumed) {
+    // 解析完直接在本线程里写，写不完才去监听EPOLLOUT
+    while(client->process()) {
+        int writeErrno = 0;
+        ssize_t ret = client->write(&writeErrno);
+        if(client->ToWriteBytes() == 0) {
+            /* 传输完成 */
+            if(client->IsKeepAlive()) { continue; }
+            FinishConn_(client);
+            return;
+        }
+        else if(ret > 0 || writeErrno == EAGAIN) {
+            /* 继续传输 */
+            poller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT, slab_->Gen(client->GetFd()));
+            return;
+        }
+        CloseConn_(client);
+        return;
+    }
+    if(client->SqlPending()) {
+        // 挂起等数据库，不用EPOLLONESHOT，就绪之前一直保持注册
+        poller_->AddFd(client->SqlFd(), client->SqlEvents(), ConnSlab::SqlTag(client->GetFd()));
+    }
+    else if(!poller_->AddReceiver(client->GetFd(), slab_->Gen(client->GetFd())) && resumed) {
+        // 这一批处理完了，之前暂停的话恢复收数据：完成模式下重新收（没暂停时什么都不做），
+        // 就绪模式下等数据库时可能去掉了EPOLLIN，重新监听
+        poller_->ModFd(client->GetFd(), connEvent_ | EPOLLIN, slab_->Gen(client->GetFd()));
+    }
+}
+
+void SubReactor::OnSql_(HttpConn* client, uint32_t events) {
+    assert(client);
+    if(!client->ResumeSql(events)) {
+        poller_->ModFd(client->SqlFd(), client->SqlEvents(), ConnSlab::SqlTag(client->GetFd()));
+        return;
+    }
+    // 先从poller里删掉，process里数据库连接才还回池子
+    poller_->DelFd(client->SqlFd());
+    OnProcess_(client, true);
+}
+
+void SubReactor::OnWrite_(HttpConn* client) {
+    assert(client);
+    int writeErrno = 0;
+    ssize_t ret = client->write(&writeErrno);
+    if(client->ToWriteBytes() == 0) {
+        /* 传输完成，切回监听读事件 */
+        if(client->IsKeepAlive()) {
+            poller_->ModFd(client->GetFd(), connEvent_ | EPOLLIN, slab_->Gen(client->GetFd()));
+            OnProcess_(client);
+            return;
+        }
+        FinishConn_(client);
+        return;
+    }
+    else if(ret > 0 || writeErrno == EAGAIN) {
+        return;     // 没有EPOLLONESHOT，EPOLLOUT仍然在监听
+    }
+    CloseConn_(client);
+}
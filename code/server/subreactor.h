@@ -0,0 +1,85 @@
+#ifndef SUBREACTOR_H
+#define SUBREACTOR_H
+
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <unistd.h>      // close()
+#include <assert.h>
+#include <errno.h>
+#include <sys/eventfd.h> // eventfd()
+#include <sys/socket.h>  // accept4()
+#include <netinet/in.h>
+#include <pthread.h>     // pthread_setaffinity_np()
+#include <sched.h>
+
+#include "poller.h"
+#include "connslab.h"
+#include "../log/log.h"
+#include "../timer/timingwheel.h"
+#include "../http/httpconn.h"
+
+/**
+ * 从Reactor（one loop per thread）
+ * 每个从Reactor在自己的线程里跑一个事件循环，拥有自己的epoll、定时器和连接集合
+ * 主Reactor只负责accept，然后把fd交给某个从Reactor，之后这个连接的读、解析、写都在同一个线程里完成
+ * 不需要再经过线程池排队，也不需要EPOLLONESHOT重新注册
+*/
+class SubReactor {
+public:
+    SubReactor(int id, int timeoutMS, uint32_t connEvent, ConnSlab* slab, bool ioUring = false);
+
+    ~SubReactor();
+
+    void Start();   // 启动事件循环线程
+
+    void Stop();    // 停止事件循环并等待线程退出
+
+    void AddConn(int fd, const sockaddr_in& addr);  // 主Reactor调用，把新连接交给这个从Reactor
+
+    // SO_REUSEPORT模式下给这个从Reactor一个自己的监听socket，线程绑定到cpu上（Start之前调用）
+    void SetListener(int listenFd, uint32_t listenEvent, int cpu);
+
+    int GetListenFd() const { return listenFd_; }
+
+private:
+    void Loop_();
+    void Wakeup_();
+    void HandleWakeup_();
+    void DealListen_();
+    bool AcceptFd_(int fd, const sockaddr_in& addr);
+
+    void AddClient_(int fd, const sockaddr_in& addr);
+    void CloseConn_(HttpConn* client);
+    void FinishConn_(HttpConn* client);     // 响应发完、不保持连接时关闭，需要的话先延迟关闭
+    void ExtentTime_(HttpConn* client);
+
+    void OnRead_(HttpConn* client);
+    void OnRecv_(HttpConn* client, int len, const char* data);
+    void OnWrite_(HttpConn* client);
+    void OnProcess_(HttpConn* client, bool resumed = false);   // resumed：数据库的结果回来以后接着处理
+    void OnSql_(HttpConn* client, uint32_t events);
+
+    static const size_t MAX_PENDING_READ = 256 * 1024;  // 等数据库或者等发送时还没处理的请求攒到这么多就暂停收数据
+
+    int id_;            // 从Reactor的编号
+    int timeoutMS_;     /* 毫秒MS */
+    uint32_t connEvent_;    // 连接的文件描述符的事件（不带EPOLLONESHOT）
+    std::atomic<bool> isClose_;
+    int wakeupFd_;      // eventfd，主Reactor有新连接交过来时用它唤醒epoll_wait
+    int listenFd_;      // 自己的监听socket，-1表示由主Reactor accept
+    uint32_t listenEvent_;
+    int cpu_;           // 绑定的CPU，-1表示不绑定
+
+    std::unique_ptr<TimingWheel> timer_;      // 定时器，只在本线程里使用
+    std::unique_ptr<Poller> poller_;        // epoll/io_uring对象，只在本线程里使用
+    ConnSlab* slab_;    // 所有Reactor共用的连接表，一个fd同一时间只属于一个Reactor
+
+    std::mutex mtx_;    // 保护pending_
+    std::vector<std::pair<int, sockaddr_in>> pending_;  // 主Reactor交过来还没有注册的连接
+    std::thread thread_;
+};
+
+#endif //SUBREACTOR_H
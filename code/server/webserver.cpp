@@ -7,9 +7,13 @@ WebServer::WebServer(
             int port, int trigMode, int timeoutMS, bool OptLinger,
             int sqlPort, const char* sqlUser, const  char* sqlPwd,
             const char* dbName, int connPoolNum, int threadNum,
-            bool openLog, int logLevel, int logQueSize):
-            port_(port), openLinger_(OptLinger), timeoutMS_(timeoutMS), isClose_(false),
-            timer_(new HeapTimer()), threadpool_(new ThreadPool(threadNum)), epoller_(new Epoller())
+            bool openLog, int logLevel, int logQueSize,
+            int subReactorNum, bool reusePort, bool cpuSteering,
+            bool ioUring, long sendfileThreshold, size_t fileCacheBytes, const char* userFile,
+            int cacheMaxAge, size_t maxBodySize):
+            port_(port), openLinger_(OptLinger), reusePort_(reusePort && subReactorNum > 0),
+            cpuSteering_(cpuSteering), timeoutMS_(timeoutMS), isClose_(false), listenFd_(-1),
+            slab_(new ConnSlab()), timer_(new TimingWheel([this](WheelNode* node) { OnTimeout_(static_cast<HttpConn*>(node->owner)); })), poller_(Poller::Create(ioUring)), nextReactor_(0)
     {
     // 初始化资源的目录
     srcDir_ = getcwd(nullptr, 256); // 获取当前的工作目录
@@ -20,13 +24,43 @@ WebServer::WebServer(
     // 初始化静态变量
     HttpConn::userCount = 0;    // 用户数，有多少个客户端连接进来
     HttpConn::srcDir = srcDir_; // 资源目录，赋值给HttpConn类，供其使用
-    // 连接池
-    SqlConnPool::Instance()->Init("localhost", sqlPort, sqlUser, sqlPwd, dbName, connPoolNum);
+    HttpResponse::sendfileThreshold = sendfileThreshold;    // 多大的文件走sendfile
+    HttpRequest::maxBodySize = maxBodySize;     // 请求体的上限，超过回413
+    static DiscardBodyHandler discardBody;
+    HttpRequest::bodyHandler = &discardBody;    // 大的请求体没人用，不放进内存
+    HttpResponse::cacheMaxAge = cacheMaxAge;    // 静态文件的Cache-Control，要在文件缓存拼响应头之前设置
+    // 静态文件缓存，走sendfile的大文件只缓存元数据
+    FileCache::Instance()->Init(fileCacheBytes,
+        sendfileThreshold >= 0 ? (sendfileThreshold > 0 ? sendfileThreshold - 1 : 0) : fileCacheBytes);
+    // 用户存储：给了用户文件就用本地的哈希文件，不连数据库
+    bool storeOk = true;
+    if(userFile) {
+        FileUserStore* store = new FileUserStore(userFile);
+        storeOk = store->IsOpen();
+        userStore_.reset(store);
+    } else {
+        // 连接池
+        SqlConnPool::Instance()->Init("localhost", sqlPort, sqlUser, sqlPwd, dbName, connPoolNum);
+        // 用户缓存，用户名的布隆过滤器启动时从数据库加载
+        UserCache::Instance()->Init(USER_CACHE_TTL, USER_CACHE_MAX);
+        UserCache::Instance()->LoadNames(SqlConnPool::Instance());
+        userStore_.reset(new MySqlUserStore());
+    }
+    HttpConn::userStore = userStore_.get();
 
     // 初始化事件的模式（ET模式还是LT模式）
     InitEventMode_(trigMode);
+    // 多Reactor模式下每个连接只属于一个从Reactor线程，不需要线程池，也不需要EPOLLONESHOT
+    if(subReactorNum > 0) {
+        for(int i = 0; i < subReactorNum; i++) {
+            subReactors_.emplace_back(new SubReactor(i, timeoutMS_, connEvent_ & ~EPOLLONESHOT, slab_.get(), ioUring));
+        }
+    } else {
+        threadpool_.reset(new WorkStealingPool(threadNum));
+    }
+    InitMetrics_();
     // 初始化Socket
-    if(!InitSocket_()) { isClose_ = true;}  // 初始化成功就继续往下执行，初始化失败就关闭服务器
+    if(!storeOk || !InitSocket_()) { isClose_ = true;}  // 初始化成功就继续往下执行，初始化失败就关闭服务器
 
     // 对日志进行初始化的操作
     if(openLog) {
@@ -35,25 +69,85 @@ WebServer::WebServer(
         else {
             LOG_INFO("========== Server init ==========");
             LOG_INFO("Port:%d, OpenLinger: %s", port_, OptLinger? "true":"false");
+            LOG_INFO("ReusePort: %s, CpuSteering: %s",
+                            reusePort_ ? "true":"false", (reusePort_ && cpuSteering_) ? "true":"false");
+            LOG_INFO("Poller: %s", poller_->Name());
+            LOG_INFO("UserStore: %s%s%s", userStore_->Name(), userFile ? " " : "", userFile ? userFile : "");
             LOG_INFO("Listen Mode: %s, OpenConn Mode: %s",
                             (listenEvent_ & EPOLLET ? "ET": "LT"),
                             (connEvent_ & EPOLLET ? "ET": "LT"));
             LOG_INFO("LogSys level: %d", logLevel);
-            LOG_INFO("srcDir: %s", HttpConn::srcDir);
-            LOG_INFO("SqlConnPool num: %d, ThreadPool num: %d", connPoolNum, threadNum);
+            LOG_INFO("srcDir: %s, Max fd: %zu", HttpConn::srcDir, slab_->Capacity());
+            LOG_INFO("Sendfile threshold: %ld, FileCache: %zu bytes, Cache max-age: %d, Max body: %zu bytes",
+                     HttpResponse::sendfileThreshold, fileCacheBytes, cacheMaxAge, maxBodySize);
+            if(subReactorNum > 0) {
+                LOG_INFO("SqlConnPool num: %d, SubReactor num: %d", connPoolNum, subReactorNum);
+            } else {
+                LOG_INFO("SqlConnPool num: %d, ThreadPool num: %d", connPoolNum, threadNum);
+            }
         }
     }
 }
 
 // 析构函数
 WebServer::~WebServer() {
-    close(listenFd_);
+    // 指标的回调里用到了线程池等成员
+    Metrics::Instance()->ClearGauges();
+    if(listenFd_ >= 0) { close(listenFd_); }
     isClose_ = true;
+    for(auto& reactor: subReactors_) {
+        reactor->Stop();
+    }
+    // 先等工作线程把手上的任务做完退出，它们还会用到poller_和连接
+    threadpool_.reset();
     free(srcDir_);
+    if(FileCache::Instance()->IsOpen()) {
+        LOG_INFO("FileCache hit:%llu miss:%llu load:%llu",
+            (unsigned long long)FileCache::Instance()->GetHitCount(),
+            (unsigned long long)FileCache::Instance()->GetMissCount(),
+            (unsigned long long)FileCache::Instance()->GetLoadCount());
+    }
     SqlConnPool::Instance()->ClosePool();
 }
 
 // 设置监听的文件描述符和通信的文件描述符的模式
+// 注册抓取时才读取的指标
+void WebServer::InitMetrics_() {
+    Metrics* metrics = Metrics::Instance();
+    metrics->ClearGauges();
+    metrics->AddGauge("tinywebserver_connections_active", "Currently open client connections.", "gauge",
+                      [] { return HttpConn::userCount.load(); });
+    if(threadpool_) {
+        WorkStealingPool* pool = threadpool_.get();
+        metrics->AddGauge("tinywebserver_threadpool_queue_depth", "Tasks waiting in the thread pool queues.", "gauge",
+                          [pool] { return pool->QueueDepth(); });
+    }
+    metrics->AddGauge("tinywebserver_sqlpool_free_connections", "Idle connections in SqlConnPool.", "gauge",
+                      [] { return SqlConnPool::Instance()->GetFreeConnCount(); });
+    metrics->AddGauge("tinywebserver_sqlpool_connections", "Open connections in SqlConnPool, idle or in use.", "gauge",
+                      [] { return SqlConnPool::Instance()->GetConnCount(); });
+    metrics->AddGauge("tinywebserver_sqlpool_busy_total", "GetConn calls that found no idle connection (answered 503).", "counter",
+                      [] { return SqlConnPool::Instance()->GetBusyCount(); });
+    metrics->AddGauge("tinywebserver_sqlpool_created_total", "Connections opened after warm-up.", "counter",
+                      [] { return SqlConnPool::Instance()->GetCreateCount(); });
+    metrics->AddGauge("tinywebserver_sqlpool_reconnects_total", "Idle connections reopened after a failed ping.", "counter",
+                      [] { return SqlConnPool::Instance()->GetReconnectCount(); });
+    metrics->AddGauge("tinywebserver_usercache_hits_total", "Login/register requests answered from UserCache.", "counter",
+                      [] { return UserCache::Instance()->GetHitCount(); });
+    metrics->AddGauge("tinywebserver_usercache_misses_total", "UserCache lookups that went to the database.", "counter",
+                      [] { return UserCache::Instance()->GetMissCount(); });
+    metrics->AddGauge("tinywebserver_userbloom_negatives_total", "Usernames the Bloom filter proved absent.", "counter",
+                      [] { return UserCache::Instance()->GetBloomNegativeCount(); });
+    metrics->AddGauge("tinywebserver_filecache_hits_total", "FileCache hits.", "counter",
+                      [] { return FileCache::Instance()->GetHitCount(); });
+    metrics->AddGauge("tinywebserver_filecache_misses_total", "FileCache misses.", "counter",
+                      [] { return FileCache::Instance()->GetMissCount(); });
+    metrics->AddGauge("tinywebserver_filecache_bytes", "Bytes held by FileCache.", "gauge",
+                      [] { return FileCache::Instance()->GetBytes(); });
+    metrics->AddGauge("tinywebserver_log_dropped_total", "Log lines dropped because a log ring was full.", "counter",
+                      [] { return Log::Instance()->GetDropCount(); });
+}
+
 void WebServer::InitEventMode_(int trigMode) {
     listenEvent_ = EPOLLRDHUP;  // 检测对方能否正常关闭
     // 设置EPOLLONESHOT，使一个socket连接在任一时刻都只被一个线程处理
@@ -83,6 +177,9 @@ void WebServer::InitEventMode_(int trigMode) {
 void WebServer::Start() {
     int timeMS = -1;  /* epoll wait timeout == -1 无事件将阻塞 */
     if(!isClose_) { LOG_INFO("========== Server start =========="); }
+    for(auto& reactor: subReactors_) {
+        reactor->Start();
+    }
     /**
      * 在主线程
      * 只要服务器没有关闭，就一直运行
@@ -96,33 +193,50 @@ void WebServer::Start() {
         // 不断调用epoll_wait去监测有没有事件到达，返回值为监测到有多少个
         // 检测timeMS时间，如果检测到事件就返回，如果一直没检测到事件超过这个时间也返回
         // 不一直阻塞是因为如果一直没有事件到达就不能返回回来关闭超时连接了
-        int eventCnt = epoller_->Wait(timeMS);    
+        int eventCnt = poller_->Wait(timeMS);    
 
         for(int i = 0; i < eventCnt; i++) {
             /* 处理事件 */
-            int fd = epoller_->GetEventFd(i);   // 先获取要检测的文件描述符的fd
-            uint32_t events = epoller_->GetEvents(i);   // 获取检测的事件
+            int fd = poller_->GetEventFd(i);   // 先获取要检测的文件描述符的fd
+            uint32_t events = poller_->GetEvents(i);   // 获取检测的事件
             // 如果检测到的文件描述符和监听文件描述符一样，就去处理监听事件，也就是accept接收新连接
             // 监听文件描述符有数据代表有新的客户端连接
             if(fd == listenFd_) {
-                DealListen_();      //处理监听事件，接收客户端连接
+                if(!poller_->IsCompletion(i)) {
+                    DealListen_();      //处理监听事件，接收客户端连接
+                }
+                // 内核已经accept好了，事件里带着新连接的fd，对端地址等用到时再取
+                else if(poller_->GetEventResult(i) > 0) {
+                    sockaddr_in addr = {};
+                    AcceptFd_(poller_->GetEventResult(i), addr);
+                }
+                continue;
+            }
+            uint32_t gen = poller_->GetEventGen(i);
+            // 连接等待的数据库socket有结果了
+            if(ConnSlab::IsSqlEvent(gen)) {
+                DealSql_(fd, gen, events);
+                continue;
+            }
+            // 按fd直接取连接，代数对不上说明是fd被复用之前的旧连接的事件
+            HttpConn* client = slab_->Get(fd, gen);
+            if(!client) {
+                LOG_DEBUG("Client[%d] stale event", fd);
             }
             // 连接出现错误，就把和这个文件描述符的连接给关闭掉
-            else if(events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
-                assert(users_.count(fd) > 0);
-                CloseConn_(&users_[fd]);    // 关闭连接
+            else if((events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) && !client->IsLingering()) {
+                CloseConn_(client);    // 关闭连接
             }
             // 如果读事件产生了，就处理读操作
             // 监听到读事件，说明连接请求发送过来了，发送到了服务器的TCP接收缓冲区
-            else if(events & EPOLLIN) {
-                assert(users_.count(fd) > 0);
-                DealRead_(&users_[fd]);     //处理读操作
+            // 延迟关闭中的连接对端关闭时也要先把数据读掉
+            else if(events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                DealRead_(client);     //处理读操作
             }
             // 如果是写事件，就去处理写操作
             // 检测到可以写，就处理DealWrite
             else if(events & EPOLLOUT) {
-                assert(users_.count(fd) > 0);
-                DealWrite_(&users_[fd]);    // 处理写操作
+                DealWrite_(client);    // 处理写操作
             } else {
                 LOG_ERROR("Unexpected event");
             }
@@ -142,23 +256,52 @@ void WebServer::SendError_(int fd, const char*info) {
 void WebServer::CloseConn_(HttpConn* client) {
     assert(client);
     LOG_INFO("Client[%d] quit!", client->GetFd());
-    // 从epoller中将这个文件描述符删掉
-    epoller_->DelFd(client->GetFd());
+    // 从poller中将这个文件描述符删掉
+    poller_->DelFd(client->GetFd());
+    // 还在等数据库的话，数据库的socket也要删掉，连接关闭时会放弃这次查询
+    if(client->SqlPending()) { poller_->DelFd(client->SqlFd()); }
+    // 换代，已经取出来还没处理的这个连接的事件都作废
+    slab_->Close(client->GetFd());
+    // 这里可能在工作线程里，时间轮只能在主线程里操作，节点留在时间轮里，到时间时OnTimeout_跳过
+    // （fd被新连接复用时AddClient_会重新放置节点）
     // 客户端关闭
     client->Close();
 }
 
+// 子线程执行
+void WebServer::FinishConn_(HttpConn* client) {
+    if(!client->StartLinger()) {
+        CloseConn_(client);
+        return;
+    }
+    // 写端已经关了，只等对端的数据，读到的都扔掉
+    poller_->ModFd(client->GetFd(), connEvent_ | EPOLLIN, slab_->Gen(client->GetFd()));
+}
+
+// 主线程的定时器回调
+void WebServer::OnTimeout_(HttpConn* client) {
+    assert(client);
+    // 已经在工作线程里关掉了，fd可能已经给了别的socket，不能再按它删poller、换代
+    if(client->IsClose()) { return; }
+    CloseConn_(client);
+}
+
 void WebServer::AddClient_(int fd, sockaddr_in addr) {
     assert(fd > 0);
-    // users_是map集合，保存用户信息的，键是文件描述符，值是HttpConnection（连接相关的信息都保存在里面）
-    users_[fd].init(fd, addr);
+    // 多Reactor模式：主Reactor只负责accept，轮询交给从Reactor
+    if(!subReactors_.empty()) {
+        subReactors_[nextReactor_++ % subReactors_.size()]->AddConn(fd, addr);
+        return;
+    }
+    // slab_以文件描述符为下标，保存HttpConnection（连接相关的信息都保存在里面）
+    HttpConn* client = slab_->Open(fd);
+    client->init(fd, addr);
     if(timeoutMS_ > 0) {
-        timer_->add(fd, timeoutMS_, std::bind(&WebServer::CloseConn_, this, &users_[fd]));
+        timer_->Add(client->TimerNode(), timeoutMS_);
     }
-    // 把新连接进来的fd添加到epoller身上，监测有没有数据到达
-    epoller_->AddFd(fd, EPOLLIN | connEvent_);
-    SetFdNonblock(fd);  // 设置非阻塞
-    LOG_INFO("Client[%d] in!", users_[fd].GetFd());
+    // 把新连接进来的fd添加到poller身上，监测有没有数据到达（accept4时已经设置了非阻塞）
+    poller_->AddFd(fd, EPOLLIN | connEvent_, slab_->Gen(fd));
+    LOG_INFO("Client[%d] in!", client->GetFd());
 }
 
 // 处理监听
@@ -167,40 +310,57 @@ void WebServer::DealListen_() {
     socklen_t len = sizeof(addr);
     do {
         // 将客户端的信息保存到addr当中，一次一个，当都连接完了，没有客户端需要连接了返回-1
-        // 接受新的连接
-        int fd = accept(listenFd_, (struct sockaddr *)&addr, &len);
+        // 接受新的连接，accept4直接把新连接设为非阻塞，省掉一次fcntl
+        int fd = accept4(listenFd_, (struct sockaddr *)&addr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
         // 小于等于0表示出错了就返回
-        if(fd <= 0) { return;}  
-        // fd>0就是连接成功了，但是有最大客户端数量，需要判断一下
-        // 如果当前用户连接的客户端的数量>=最大的文件描述符的数量，就通知服务器繁忙，
-        else if(HttpConn::userCount >= MAX_FD) {
-            SendError_(fd, "Server busy!");
-            LOG_WARN("Clients is full!");
-            return;
-        }
-        AddClient_(fd, addr);   // 添加客户端
+        if(fd <= 0 || !AcceptFd_(fd, addr)) { return;}  
     } while(listenEvent_ & EPOLLET);
 }
 
+// 新连接，连接表满了返回false
+bool WebServer::AcceptFd_(int fd, const sockaddr_in& addr) {
+    // fd>0就是连接成功了，但是有最大客户端数量，需要判断一下
+    // 如果文件描述符超出了连接表的大小，就通知服务器繁忙，
+    if(static_cast<size_t>(fd) >= slab_->Capacity()) {
+        SendError_(fd, "Server busy!");
+        LOG_WARN("Clients is full!");
+        return false;
+    }
+    AddClient_(fd, addr);   // 添加客户端
+    return true;
+}
+
 void WebServer::DealRead_(HttpConn* client) {
     assert(client);
     // 处理读事件了即有数据传输了，就延长这个客户端的超时时间
     ExtentTime_(client);
     // Reactor模式，主线程不读数据，读写操作和处理逻辑都交给子线程
     // 把客户端的信息添加到线程池里面，让子线程去处理
-    threadpool_->AddTask(std::bind(&WebServer::OnRead_, this, client));
+    // 以fd作为亲和提示，同一个连接尽量交给上一次处理它的线程
+    threadpool_->AddTask(std::bind(&WebServer::OnRead_, this, client), client->GetFd());
 }
 
 void WebServer::DealWrite_(HttpConn* client) {
     assert(client);
     ExtentTime_(client);
     // 添加到线程池里，让子线程去执行写事件
-    threadpool_->AddTask(std::bind(&WebServer::OnWrite_, this, client));
+    threadpool_->AddTask(std::bind(&WebServer::OnWrite_, this, client), client->GetFd());
+}
+
+void WebServer::DealSql_(int sqlFd, uint32_t gen, uint32_t events) {
+    HttpConn* client = slab_->GetSqlWaiter(sqlFd, gen);
+    if(!client) {
+        LOG_DEBUG("Sql fd[%d] stale event", sqlFd);
+        return;
+    }
+    ExtentTime_(client);
+    // 数据库的socket也是EPOLLONESHOT，这个连接同一时间还是只有一个线程在处理
+    threadpool_->AddTask(std::bind(&WebServer::OnSql_, this, client, events), client->GetFd());
 }
 
 void WebServer::ExtentTime_(HttpConn* client) {
     assert(client);
-    if(timeoutMS_ > 0) { timer_->adjust(client->GetFd(), timeoutMS_); }
+    if(timeoutMS_ > 0) { timer_->Adjust(client->TimerNode(), timeoutMS_); }
 }
 
 // 这个方法是在子线程中执行的
@@ -208,6 +368,15 @@ void WebServer::OnRead_(HttpConn* client) {
     assert(client);
     int ret = -1;
     int readErrno = 0;
+    if(client->IsLingering()) {
+        // 延迟关闭：读到的数据扔掉，还没完就重新注册EPOLLONESHOT接着等
+        if(client->Linger(&readErrno)) {
+            poller_->ModFd(client->GetFd(), connEvent_ | EPOLLIN, slab_->Gen(client->GetFd()));
+        } else {
+            CloseConn_(client);
+        }
+        return;
+    }
     ret = client->read(&readErrno);     // 读取客户端的数据，读到client里
     if(ret <= 0 && readErrno != EAGAIN) {
         CloseConn_(client);
@@ -221,13 +390,28 @@ void WebServer::OnRead_(HttpConn* client) {
 void WebServer::OnProcess(HttpConn* client) {
     // 客户端去处理逻辑
     if(client->process()) {
-        // 如果处理业务逻辑成功了，就修改该客户端epoller监听的文件描述符，监听是否可写的事件
-        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);
+        // 如果处理业务逻辑成功了，就修改该客户端poller监听的文件描述符，监听是否可写的事件
+        poller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT, slab_->Gen(client->GetFd()));
+    } else if(client->SqlPending()) {
+        // 挂起等数据库，客户端的fd先不重新注册，等数据库的socket就绪
+        poller_->AddFd(client->SqlFd(), client->SqlEvents() | EPOLLONESHOT, ConnSlab::SqlTag(client->GetFd()));
     } else {
-        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLIN);
+        poller_->ModFd(client->GetFd(), connEvent_ | EPOLLIN, slab_->Gen(client->GetFd()));
     }
 }
 
+// 子线程执行
+void WebServer::OnSql_(HttpConn* client, uint32_t events) {
+    assert(client);
+    if(!client->ResumeSql(events)) {
+        poller_->ModFd(client->SqlFd(), client->SqlEvents() | EPOLLONESHOT, ConnSlab::SqlTag(client->GetFd()));
+        return;
+    }
+    // 先从poller里删掉，process里数据库连接才还回池子
+    poller_->DelFd(client->SqlFd());
+    OnProcess(client);
+}
+
 // 子线程执行
 void WebServer::OnWrite_(HttpConn* client) {
     assert(client);
@@ -240,11 +424,13 @@ void WebServer::OnWrite_(HttpConn* client) {
             OnProcess(client);
             return;
         }
+        FinishConn_(client);
+        return;
     }
     else if(ret < 0) {
         if(writeErrno == EAGAIN) {
             /* 继续传输 */
-            epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);
+            poller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT, slab_->Gen(client->GetFd()));
             return;
         }
     }
@@ -253,13 +439,59 @@ void WebServer::OnWrite_(HttpConn* client) {
 
 /* Create listenFd */
 bool WebServer::InitSocket_() {
-    int ret;
-    struct sockaddr_in addr;    // 套接字地址
     // 判断端口号大小是否符合
     if(port_ > 65535 || port_ < 1024) {
         LOG_ERROR("Port:%d error!",  port_);
         return false;
     }
+
+    /**
+     * SO_REUSEPORT模式：每个从Reactor一个监听socket，各自绑到自己的CPU上accept
+     * 内核在这些socket之间分配新连接，不再由主线程一个人accept再转交
+    */
+    if(reusePort_) {
+        int cpuNum = get_nprocs();
+        for(size_t i = 0; i < subReactors_.size(); i++) {
+            int fd = CreateListenFd_(true);
+            if(fd < 0) { return false; }
+            int cpu = i % cpuNum;
+            if(cpuSteering_ && setsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)) < 0) {
+                LOG_WARN("Set SO_INCOMING_CPU error!");
+            }
+            subReactors_[i]->SetListener(fd, listenEvent_, cpu);
+        }
+        if(cpuSteering_ && !AttachCpuSteering_(subReactors_[0]->GetListenFd(), subReactors_.size())) {
+            LOG_WARN("Attach reuseport cbpf error, fallback to hash!");
+        }
+        LOG_INFO("Server port:%d, reuseport listeners:%d", port_, (int)subReactors_.size());
+        return true;
+    }
+
+    listenFd_ = CreateListenFd_(false);
+    if(listenFd_ < 0) {
+        return false;
+    }
+    /**
+     * 把监听的文件描述符加到epoll身上
+     * 通过epoll检测listenfd有没有数据到达
+     * 有数据到达说明有客户端连接进来
+    */
+    // io_uring支持的话挂multishot accept，内核每accept一个连接交回来一个事件
+    int ret = poller_->AddAcceptor(listenFd_) || poller_->AddFd(listenFd_,  listenEvent_ | EPOLLIN);
+    if(ret == 0) {
+        LOG_ERROR("Add listen error!");
+        close(listenFd_);
+        listenFd_ = -1;
+        return false;
+    }
+    LOG_INFO("Server port:%d", port_);
+    return true;
+}
+
+// 创建、绑定并监听一个非阻塞的socket，失败返回-1
+int WebServer::CreateListenFd_(bool reusePort) {
+    int ret;
+    struct sockaddr_in addr;    // 套接字地址
     // 地址组类型，IPv4
     addr.sin_family = AF_INET;
     //host主机字节序转换为网络字节序
@@ -272,66 +504,69 @@ bool WebServer::InitSocket_() {
         optLinger.l_onoff = 1;
         optLinger.l_linger = 1;
     }
-    // 创建一个socket，返回一个监听的文件描述符
-    listenFd_ = socket(AF_INET, SOCK_STREAM, 0);
-    if(listenFd_ < 0) {
+    // 创建一个非阻塞的socket，返回一个监听的文件描述符
+    int listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(listenFd < 0) {
         LOG_ERROR("Create socket error!", port_);
-        return false;
+        return -1;
     }
 
-    ret = setsockopt(listenFd_, SOL_SOCKET, SO_LINGER, &optLinger, sizeof(optLinger));
+    ret = setsockopt(listenFd, SOL_SOCKET, SO_LINGER, &optLinger, sizeof(optLinger));
     if(ret < 0) {
-        close(listenFd_);
+        close(listenFd);
         LOG_ERROR("Init linger error!", port_);
-        return false;
+        return -1;
     }
 
     int optval = 1;
     /* 端口复用 */
     /* 只有最后一个套接字会正常接收数据。 */
-    ret = setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, (const void*)&optval, sizeof(int));
+    ret = setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, (const void*)&optval, sizeof(int));
     if(ret == -1) {
         LOG_ERROR("set socket setsockopt error !");
-        close(listenFd_);
-        return false;
+        close(listenFd);
+        return -1;
+    }
+
+    /* 多个socket绑定同一个端口，由内核做负载均衡 */
+    if(reusePort) {
+        ret = setsockopt(listenFd, SOL_SOCKET, SO_REUSEPORT, (const void*)&optval, sizeof(int));
+        if(ret == -1) {
+            LOG_ERROR("set SO_REUSEPORT error !");
+            close(listenFd);
+            return -1;
+        }
     }
 
     // 绑定，传递监听的文件描述符，传递地址
-    ret = bind(listenFd_, (struct sockaddr *)&addr, sizeof(addr));
+    ret = bind(listenFd, (struct sockaddr *)&addr, sizeof(addr));
     if(ret < 0) {
         LOG_ERROR("Bind Port:%d error!", port_);
-        close(listenFd_);
-        return false;
+        close(listenFd);
+        return -1;
     }
 
-    // 监听listen()
-    ret = listen(listenFd_, 6);
+    // 监听listen()，backlog太小的话连接风暴时SYN队列会丢包
+    ret = listen(listenFd, LISTEN_BACKLOG);
     if(ret < 0) {
         LOG_ERROR("Listen port:%d error!", port_);
-        close(listenFd_);
-        return false;
+        close(listenFd);
+        return -1;
     }
-
-    /**
-     * 把监听的文件描述符加到epoll身上
-     * 通过epoll检测listenfd有没有数据到达
-     * 有数据到达说明有客户端连接进来
-    */
-    ret = epoller_->AddFd(listenFd_,  listenEvent_ | EPOLLIN);
-    if(ret == 0) {
-        LOG_ERROR("Add listen error!");
-        close(listenFd_);
-        return false;
-    }
-    SetFdNonblock(listenFd_);   // 设置监听文件描述符非阻塞
-    LOG_INFO("Server port:%d", port_);
-    return true;
+    return listenFd;
 }
 
-// 设置文件描述符非阻塞
-int WebServer::SetFdNonblock(int fd) {
-    assert(fd > 0);
-    return fcntl(fd, F_SETFL, fcntl(fd, F_GETFD, 0) | O_NONBLOCK);
+/**
+ * 给reuseport组挂一个CBPF程序：返回 当前CPU号 % 组大小
+ * 组内socket的下标就是listen的顺序，所以第i个CPU上的连接落到第i个从Reactor
+*/
+bool WebServer::AttachCpuSteering_(int listenFd, int groupSize) {
+    assert(listenFd >= 0 && groupSize > 0);
+    struct sock_filter code[] = {
+        { BPF_LD  | BPF_W | BPF_ABS, 0, 0, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU) },   // A = cpu
+        { BPF_ALU | BPF_MOD | BPF_K, 0, 0, (uint32_t)groupSize },   // A = A % groupSize
+        { BPF_RET | BPF_A, 0, 0, 0 },   // return A
+    };
+    struct sock_fprog prog = { sizeof(code) / sizeof(code[0]), code };
+    return 0 == setsockopt(listenFd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog));
 }
-
-
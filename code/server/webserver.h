@@ -1,7 +1,6 @@
  #ifndef WEBSERVER_H
 #define WEBSERVER_H
 
-#include <unordered_map>
 #include <fcntl.h>       // fcntl()
 #include <unistd.h>      // close()
 #include <assert.h>
@@ -9,14 +8,22 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <sys/sysinfo.h>    // get_nprocs()
+#include <linux/filter.h>   // sock_fprog, SKF_AD_CPU
 
-#include "epoller.h"
+#include "poller.h"
+#include "subreactor.h"
+#include "connslab.h"
 #include "../log/log.h"
-#include "../timer/heaptimer.h"
+#include "../timer/timingwheel.h"
 #include "../pool/sqlconnpool.h"
-#include "../pool/threadpool.h"
+#include "../pool/usercache.h"
+#include "../pool/workstealingpool.h"
 #include "../pool/sqlconnRAII.h"
+#include "../pool/sqlverify.h"
+#include "../pool/userfile.h"
 #include "../http/httpconn.h"
+#include "../metrics/metrics.h"
 
 class WebServer {
 public:
@@ -24,34 +31,47 @@ public:
         int port, int trigMode, int timeoutMS, bool OptLinger, 
         int sqlPort, const char* sqlUser, const  char* sqlPwd, 
         const char* dbName, int connPoolNum, int threadNum,
-        bool openLog, int logLevel, int logQueSize);
+        bool openLog, int logLevel, int logQueSize,
+        int subReactorNum = 0, bool reusePort = false, bool cpuSteering = false,
+        bool ioUring = false, long sendfileThreshold = -1, size_t fileCacheBytes = 0,
+        const char* userFile = nullptr, int cacheMaxAge = 0, size_t maxBodySize = 1 << 20);
 
     ~WebServer();
     void Start();
 
 private:
     bool InitSocket_(); 
+    int CreateListenFd_(bool reusePort);
+    bool AttachCpuSteering_(int listenFd, int groupSize);
     void InitEventMode_(int trigMode);
+    void InitMetrics_();
     void AddClient_(int fd, sockaddr_in addr);
   
     void DealListen_();
+    bool AcceptFd_(int fd, const sockaddr_in& addr);
     void DealWrite_(HttpConn* client);
     void DealRead_(HttpConn* client);
+    void DealSql_(int sqlFd, uint32_t gen, uint32_t events);
 
     void SendError_(int fd, const char*info);
     void ExtentTime_(HttpConn* client);
     void CloseConn_(HttpConn* client);
+    void FinishConn_(HttpConn* client);     // 响应发完、不保持连接时关闭，需要的话先延迟关闭
+    void OnTimeout_(HttpConn* client);
 
     void OnRead_(HttpConn* client);
     void OnWrite_(HttpConn* client);
     void OnProcess(HttpConn* client);
+    void OnSql_(HttpConn* client, uint32_t events);
 
-    static const int MAX_FD = 65536;    // 最大的文件描述符的个数
-
-    static int SetFdNonblock(int fd);   // 设置文件描述符非阻塞
+    static const int LISTEN_BACKLOG = SOMAXCONN;    // 全连接队列长度，实际还受net.core.somaxconn限制
+    static const int USER_CACHE_TTL = 300;          // 用户缓存的有效期（秒）
+    static const size_t USER_CACHE_MAX = 1 << 16;   // 用户缓存的最大条目数
 
     int port_;      // 端口
     bool openLinger_;       // 是否打开优雅关闭
+    bool reusePort_;        // 是否每个从Reactor一个SO_REUSEPORT监听socket
+    bool cpuSteering_;      // 是否让内核按CPU把连接分给对应的监听socket
     int timeoutMS_;  /* 毫秒MS */
     bool isClose_;      // 是否关闭
     int listenFd_;      // 监听的文件描述符 
@@ -60,10 +80,14 @@ private:
     uint32_t listenEvent_;  // 监听的文件描述符的事件
     uint32_t connEvent_;    // 连接的文件描述符的事件
    
-    std::unique_ptr<HeapTimer> timer_;      // 定时器
-    std::unique_ptr<ThreadPool> threadpool_;    // 线程池
-    std::unique_ptr<Epoller> epoller_;      // epoll对象
-    std::unordered_map<int, HttpConn> users_;   // 保存的是客户端连接的信息
+    std::unique_ptr<ConnSlab> slab_;        // 保存的是客户端连接的信息，以fd为下标，所有Reactor共用
+    std::unique_ptr<TimingWheel> timer_;      // 定时器
+    std::unique_ptr<WorkStealingPool> threadpool_;    // 线程池
+    std::unique_ptr<Poller> poller_;        // epoll/io_uring对象
+    std::unique_ptr<UserStore> userStore_;  // 登录/注册用的用户存储
+
+    std::vector<std::unique_ptr<SubReactor>> subReactors_;  // 从Reactor，为空时使用单Reactor+线程池模式
+    size_t nextReactor_;    // 轮询分配连接用的下标
 };
 
 
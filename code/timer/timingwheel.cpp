@@ -0,0 +1,180 @@
+#include "timingwheel.h"
+
+TimingWheel::TimingWheel(const TimeoutHandler& handler):
+            handler_(handler), cur_(ToTick_(NowMs(), false)), size_(0),
+            slots_(ROOT_SIZE + (LEVELS - 1) * LEVEL_SIZE) {
+    for(auto& head: slots_) {
+        head.prev = head.next = &head;
+    }
+}
+
+TimingWheel::~TimingWheel() {
+    // 节点不属于时间轮，只把链接断开
+    for(auto& head: slots_) {
+        while(head.next != &head) {
+            Unlink_(head.next);
+        }
+    }
+}
+
+uint64_t TimingWheel::NowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+uint64_t TimingWheel::ToTick_(uint64_t ms, bool roundUp) {
+    return roundUp ? (ms + TICK_MS - 1) / TICK_MS : ms / TICK_MS;
+}
+
+WheelNode* TimingWheel::Slot_(int level, uint64_t idx) {
+    if(level == 0) {
+        return &slots_[idx];
+    }
+    return &slots_[ROOT_SIZE + (level - 1) * LEVEL_SIZE + idx];
+}
+
+void TimingWheel::Link_(WheelNode* head, WheelNode* node) {
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+void TimingWheel::Unlink_(WheelNode* node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = node->next = nullptr;
+}
+
+void TimingWheel::Insert_(WheelNode* node) {
+    // 已经过期的放到下一个要处理的槽
+    uint64_t expire = node->expire < cur_ ? cur_ : node->expire;
+    uint64_t delta = expire - cur_;
+    if(delta >= MAX_DELTA) {
+        // 超出了时间轮的范围，先放在最远的位置，到时候再重新放
+        expire = cur_ + MAX_DELTA - 1;
+        delta = MAX_DELTA - 1;
+    }
+    WheelNode* head;
+    if(delta < ROOT_SIZE) {
+        head = Slot_(0, expire & ROOT_MASK);
+    } else {
+        int level = 1;
+        int shift = ROOT_BITS;
+        while(level < LEVELS - 1 && delta >= (1ULL << (shift + LEVEL_BITS))) {
+            level++;
+            shift += LEVEL_BITS;
+        }
+        head = Slot_(level, (expire >> shift) & LEVEL_MASK);
+    }
+    Link_(head, node);
+}
+
+void TimingWheel::Add(WheelNode* node, int timeoutMs) {
+    assert(node && timeoutMs >= 0);
+    if(node->Linked()) {
+        Unlink_(node);
+    } else {
+        size_++;
+    }
+    node->expire = ToTick_(NowMs() + timeoutMs, true);
+    Insert_(node);
+}
+
+void TimingWheel::Adjust(WheelNode* node, int timeoutMs) {
+    assert(node && timeoutMs >= 0);
+    if(!node->Linked()) {
+        Add(node, timeoutMs);
+        return;
+    }
+    uint64_t expire = ToTick_(NowMs() + timeoutMs, true);
+    // 延后只改时间，节点留在原来的槽里，到时候再挪；提前的话要马上挪过去
+    if(expire < node->expire) {
+        Unlink_(node);
+        node->expire = expire;
+        Insert_(node);
+    } else {
+        node->expire = expire;
+    }
+}
+
+void TimingWheel::Cancel(WheelNode* node) {
+    assert(node);
+    if(node->Linked()) {
+        Unlink_(node);
+        size_--;
+    }
+}
+
+void TimingWheel::Cascade_(int level) {
+    int shift = ROOT_BITS + (level - 1) * LEVEL_BITS;
+    uint64_t idx = (cur_ >> shift) & LEVEL_MASK;
+    // 上一层也转到起点了，先把上一层的分下来
+    if(idx == 0 && level < LEVELS - 1) {
+        Cascade_(level + 1);
+    }
+    WheelNode* head = Slot_(level, idx);
+    WheelNode list;
+    list.prev = list.next = &list;
+    // 整个槽先摘下来，再逐个重新放置
+    if(head->next != head) {
+        list.next = head->next;
+        list.prev = head->prev;
+        list.next->prev = &list;
+        list.prev->next = &list;
+        head->prev = head->next = head;
+    }
+    while(list.next != &list) {
+        WheelNode* node = list.next;
+        Unlink_(node);
+        Insert_(node);
+    }
+}
+
+void TimingWheel::Advance_(uint64_t now) {
+    if(size_ == 0) {
+        if(cur_ <= now) { cur_ = now + 1; }
+        return;
+    }
+    while(cur_ <= now) {
+        uint64_t idx = cur_ & ROOT_MASK;
+        if(idx == 0) {
+            Cascade_(1);
+        }
+        WheelNode* head = Slot_(0, idx);
+        while(head->next != head) {
+            WheelNode* node = head->next;
+            Unlink_(node);
+            if(node->expire > cur_) {
+                // 被延长过，还没到时间，重新放置（一定不会放回当前槽）
+                Insert_(node);
+                continue;
+            }
+            size_--;
+            handler_(node);
+        }
+        cur_++;
+    }
+}
+
+void TimingWheel::Tick() {
+    Advance_(ToTick_(NowMs(), false));
+}
+
+int TimingWheel::GetNextTick() {
+    uint64_t nowMs = NowMs();
+    Advance_(ToTick_(nowMs, false));
+    if(size_ == 0) {
+        return -1;
+    }
+    // 在第0层找下一个不空的槽，最远等到第0层转完一圈（要从上层分下来）
+    uint64_t next = cur_;
+    while(next & ROOT_MASK) {
+        WheelNode* head = Slot_(0, next & ROOT_MASK);
+        if(head->next != head) { break; }
+        next++;
+    }
+    uint64_t nextMs = next * TICK_MS;
+    return nextMs > nowMs ? static_cast<int>(nextMs - nowMs) : 0;
+}
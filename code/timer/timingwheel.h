@@ -0,0 +1,76 @@
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+#include <functional>
+#include <vector>
+#include <stdint.h>
+#include <time.h>       // clock_gettime
+#include <assert.h>
+
+/* 时间轮的节点，直接嵌在连接对象里，不需要为每个定时器单独分配内存 */
+struct WheelNode {
+    WheelNode* prev = nullptr;
+    WheelNode* next = nullptr;
+    uint64_t expire = 0;    // 到期的tick
+    void* owner = nullptr;  // 节点所属的对象，超时回调里用
+
+    bool Linked() const { return prev != nullptr; }
+};
+
+/**
+ * 分层时间轮，代替HeapTimer
+ * 第0层256个槽，每槽一个tick；往上三层每层64个槽，每槽是下一层转一圈的时间
+ * 转到下一层的起点时把上一层对应槽里的节点重新分配到下面（cascade）
+ * 添加、删除都是O(1)的链表操作；延长超时只改expire，不移动节点，节点所在的槽到时间时发现还没到期再重新放进去
+ * 超时回调整个时间轮只有一个，节点通过owner找到自己的连接
+ * 不是线程安全的，只能在一个线程里使用
+*/
+class TimingWheel {
+public:
+    typedef std::function<void(WheelNode*)> TimeoutHandler;
+
+    explicit TimingWheel(const TimeoutHandler& handler);
+
+    ~TimingWheel();
+
+    void Add(WheelNode* node, int timeoutMs);       // 已经在时间轮里的节点会重新放置
+
+    void Adjust(WheelNode* node, int timeoutMs);
+
+    void Cancel(WheelNode* node);
+
+    void Tick();    // 处理所有到期的节点
+
+    int GetNextTick();  // 处理到期的节点，返回距离下一次需要处理的毫秒数，没有定时器时返回-1
+
+    size_t Size() const { return size_; }
+
+    static uint64_t NowMs();    // 粗粒度的单调时钟（CLOCK_MONOTONIC_COARSE）
+
+    static const int TICK_MS = 10;      // 一个tick的毫秒数
+
+private:
+    static const int ROOT_BITS = 8;
+    static const int LEVEL_BITS = 6;
+    static const int LEVELS = 4;
+    static const uint64_t ROOT_SIZE = 1 << ROOT_BITS;
+    static const uint64_t LEVEL_SIZE = 1 << LEVEL_BITS;
+    static const uint64_t ROOT_MASK = ROOT_SIZE - 1;
+    static const uint64_t LEVEL_MASK = LEVEL_SIZE - 1;
+    static const uint64_t MAX_DELTA = 1ULL << (ROOT_BITS + (LEVELS - 1) * LEVEL_BITS);
+
+    WheelNode* Slot_(int level, uint64_t idx);
+    void Insert_(WheelNode* node);
+    static void Link_(WheelNode* head, WheelNode* node);
+    static void Unlink_(WheelNode* node);
+    void Cascade_(int level);
+    void Advance_(uint64_t now);
+    static uint64_t ToTick_(uint64_t ms, bool roundUp);
+
+    TimeoutHandler handler_;
+    uint64_t cur_;      // 下一个要处理的tick，比它小的都已经处理过了
+    size_t size_;
+    std::vector<WheelNode> slots_;  // 每个槽是一个带头结点的双向循环链表
+};
+
+#endif //TIMING_WHEEL_H
@@ -0,0 +1,262 @@
+#include "mysql/mysql.h"
+#include "mysql/mysqld_error.h"
+#include "fakesql.h"
+#include <sys/socket.h>
+#include <unistd.h>
+#include <string.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <atomic>
+using namespace std;
+
+namespace {
+
+mutex mtx;      // 保护users
+multimap<string, string> users;     // 和没有唯一键的表一样，同一个用户名可以有好几行
+atomic<bool> down(false);
+atomic<bool> uniqueKey(false);
+atomic<int> openCnt(0);
+atomic<int> connectCnt(0);
+atomic<int> executeCnt(0);
+
+const char SELECT_PREFIX[] = "SELECT password FROM user WHERE username = ?";
+const char INSERT_PREFIX[] = "INSERT INTO user(username, password)";
+
+string Param(const MYSQL_BIND& bind) {
+    return string(static_cast<const char*>(bind.buffer), *bind.length);
+}
+
+}
+
+struct st_mysql {
+    int sv[2];      // sv[0]给调用方等待，*_start往sv[1]写一个字节表示"结果到了"
+};
+
+struct st_mysql_res {
+    vector<string> rows;
+    size_t cur;
+    char* row[1];
+};
+
+struct st_mysql_stmt {
+    MYSQL* sql;
+    enum { UNKNOWN, SELECT, INSERT } kind;
+    MYSQL_BIND* params;
+    MYSQL_BIND* result;
+    vector<string> rows;
+    size_t cur;
+    string error;
+    unsigned int errnum;
+};
+
+// *_start：让socket可读，返回要等的事件
+static int Arm(MYSQL* sql) {
+    char c = 1;
+    if(write(sql->sv[1], &c, 1) != 1) { return 0; }
+    return MYSQL_WAIT_READ;
+}
+
+// *_cont：socket可读了才算结果到了
+static bool Ready(MYSQL* sql, int ready) {
+    char c;
+    return (ready & MYSQL_WAIT_READ) && read(sql->sv[0], &c, 1) == 1;
+}
+
+extern "C" {
+
+int mysql_library_init(int, char**, char**) { return 0; }
+
+void mysql_library_end(void) {}
+
+void mysql_thread_end(void) {}
+
+MYSQL* mysql_init(MYSQL*) {
+    MYSQL* sql = new MYSQL;
+    sql->sv[0] = sql->sv[1] = -1;
+    return sql;
+}
+
+int mysql_options(MYSQL*, enum mysql_option, const void*) { return 0; }
+
+MYSQL* mysql_real_connect(MYSQL* sql, const char*, const char*, const char*, const char*,
+                          unsigned int, const char*, unsigned long) {
+    if(down || socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, sql->sv) < 0) {
+        return nullptr;
+    }
+    openCnt++;
+    connectCnt++;
+    return sql;
+}
+
+void mysql_close(MYSQL* sql) {
+    if(!sql) { return; }
+    if(sql->sv[0] >= 0) {
+        close(sql->sv[0]);
+        close(sql->sv[1]);
+        openCnt--;
+    }
+    delete sql;
+}
+
+int mysql_ping(MYSQL* sql) { return down || sql->sv[0] < 0; }
+
+my_socket mysql_get_socket(MYSQL* sql) { return sql->sv[0]; }
+
+// 只支持加载用户名的那一句
+int mysql_query(MYSQL*, const char* query) {
+    return strcmp(query, "SELECT username FROM user") != 0;
+}
+
+MYSQL_RES* mysql_store_result(MYSQL*) {
+    MYSQL_RES* res = new MYSQL_RES;
+    res->cur = 0;
+    lock_guard<mutex> locker(mtx);
+    for(auto it = users.begin(); it != users.end(); it = users.upper_bound(it->first)) {
+        res->rows.push_back(it->first);
+    }
+    return res;
+}
+
+MYSQL_ROW mysql_fetch_row(MYSQL_RES* res) {
+    if(res->cur >= res->rows.size()) { return nullptr; }
+    res->row[0] = const_cast<char*>(res->rows[res->cur++].c_str());
+    return res->row;
+}
+
+void mysql_free_result(MYSQL_RES* res) { delete res; }
+
+MYSQL_STMT* mysql_stmt_init(MYSQL* sql) {
+    MYSQL_STMT* stmt = new MYSQL_STMT;
+    stmt->sql = sql;
+    stmt->kind = MYSQL_STMT::UNKNOWN;
+    stmt->params = stmt->result = nullptr;
+    stmt->cur = 0;
+    stmt->errnum = 0;
+    return stmt;
+}
+
+int mysql_stmt_prepare(MYSQL_STMT* stmt, const char* query, unsigned long length) {
+    string sql(query, length);
+    if(sql.compare(0, sizeof(SELECT_PREFIX) - 1, SELECT_PREFIX) == 0) {
+        stmt->kind = MYSQL_STMT::SELECT;
+    } else if(sql.compare(0, sizeof(INSERT_PREFIX) - 1, INSERT_PREFIX) == 0) {
+        stmt->kind = MYSQL_STMT::INSERT;
+    } else {
+        stmt->error = "unsupported statement";
+        stmt->errnum = 1;
+        return 1;
+    }
+    return 0;
+}
+
+my_bool mysql_stmt_bind_param(MYSQL_STMT* stmt, MYSQL_BIND* bind) {
+    stmt->params = bind;
+    return 0;
+}
+
+my_bool mysql_stmt_bind_result(MYSQL_STMT* stmt, MYSQL_BIND* bind) {
+    stmt->result = bind;
+    return 0;
+}
+
+int mysql_stmt_execute(MYSQL_STMT* stmt) {
+    executeCnt++;
+    stmt->rows.clear();
+    stmt->cur = 0;
+    stmt->errnum = 0;
+    if(stmt->sql->sv[0] < 0 || !stmt->params) {
+        stmt->error = "not connected";
+        stmt->errnum = 1;
+        return 1;
+    }
+    lock_guard<mutex> locker(mtx);
+    string name = Param(stmt->params[0]);
+    if(stmt->kind == MYSQL_STMT::SELECT) {
+        // LIMIT 1
+        auto it = users.find(name);
+        if(it != users.end()) { stmt->rows.push_back(it->second); }
+    } else if(uniqueKey && users.count(name)) {
+        stmt->error = "Duplicate entry '" + name + "' for key 'username'";
+        stmt->errnum = ER_DUP_ENTRY;
+        return 1;
+    } else {
+        users.emplace(name, Param(stmt->params[1]));
+    }
+    return 0;
+}
+
+int mysql_stmt_execute_start(int*, MYSQL_STMT* stmt) { return Arm(stmt->sql); }
+
+int mysql_stmt_execute_cont(int* ret, MYSQL_STMT* stmt, int ready) {
+    if(!Ready(stmt->sql, ready)) { return MYSQL_WAIT_READ; }
+    *ret = mysql_stmt_execute(stmt);
+    return 0;
+}
+
+// 结果执行时已经在本地了
+int mysql_stmt_store_result(MYSQL_STMT*) { return 0; }
+
+int mysql_stmt_store_result_start(int*, MYSQL_STMT* stmt) { return Arm(stmt->sql); }
+
+int mysql_stmt_store_result_cont(int* ret, MYSQL_STMT* stmt, int ready) {
+    if(!Ready(stmt->sql, ready)) { return MYSQL_WAIT_READ; }
+    *ret = 0;
+    return 0;
+}
+
+int mysql_stmt_fetch(MYSQL_STMT* stmt) {
+    if(stmt->cur >= stmt->rows.size()) { return MYSQL_NO_DATA; }
+    const string& value = stmt->rows[stmt->cur++];
+    MYSQL_BIND* bind = stmt->result;
+    *bind->length = value.size();
+    memcpy(bind->buffer, value.data(), min<size_t>(value.size(), bind->buffer_length));
+    return value.size() > bind->buffer_length ? MYSQL_DATA_TRUNCATED : 0;
+}
+
+my_bool mysql_stmt_free_result(MYSQL_STMT* stmt) {
+    stmt->rows.clear();
+    stmt->cur = 0;
+    return 0;
+}
+
+my_bool mysql_stmt_close(MYSQL_STMT* stmt) {
+    delete stmt;
+    return 0;
+}
+
+const char* mysql_stmt_error(MYSQL_STMT* stmt) { return stmt->error.c_str(); }
+
+unsigned int mysql_stmt_errno(MYSQL_STMT* stmt) { return stmt->errnum; }
+
+}
+
+void FakeSqlReset() {
+    lock_guard<mutex> locker(mtx);
+    users.clear();
+    users.emplace("admin", "123");
+    uniqueKey = false;
+    connectCnt = 0;
+    executeCnt = 0;
+}
+
+void FakeSqlSetDown(bool isDown) { down = isDown; }
+
+void FakeSqlSetUnique(bool isUnique) { uniqueKey = isUnique; }
+
+void FakeSqlAddUser(const char* name, const char* pwd) {
+    lock_guard<mutex> locker(mtx);
+    users.emplace(name, pwd);
+}
+
+int FakeSqlUserRows(const char* name) {
+    lock_guard<mutex> locker(mtx);
+    return users.count(name);
+}
+
+int FakeSqlOpenCount() { return openCnt; }
+
+int FakeSqlConnectCount() { return connectCnt; }
+
+int FakeSqlExecuteCount() { return executeCnt; }
@@ -0,0 +1,15 @@
+#ifndef FAKESQL_H
+#define FAKESQL_H
+
+/* 假客户端库的测试控制接口 */
+
+void FakeSqlReset();                // 清空user表和计数，只留admin/123
+void FakeSqlSetDown(bool down);     // 数据库挂了：新连接和ping都失败
+void FakeSqlSetUnique(bool unique); // username有唯一键：插入重复的用户名报ER_DUP_ENTRY，否则和没有键的表一样多一行
+void FakeSqlAddUser(const char* name, const char* pwd);     // 不经过服务器直接往user表里插一行
+int FakeSqlUserRows(const char* name);  // user表里这个用户名有几行
+int FakeSqlOpenCount();             // 当前打开的连接数
+int FakeSqlConnectCount();          // 累计建过的连接数
+int FakeSqlExecuteCount();          // 累计执行的语句数
+
+#endif //FAKESQL_H
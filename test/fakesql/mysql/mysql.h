@@ -0,0 +1,77 @@
+#ifndef FAKESQL_MYSQL_H
+#define FAKESQL_MYSQL_H
+
+/**
+ * 测试用的假MariaDB Connector/C，只有服务器用到的那部分接口，user表放在内存里，不需要数据库
+ * 非阻塞接口和真的一样要等socket：*_start往连接的socketpair里写一个字节就返回MYSQL_WAIT_READ，
+ * 调用方等到socket可读再调*_cont才真正执行，SqlVerify的状态机、poller注册这条路径都能走到
+ * 用法：-I test/fakesql 放在最前面，链接test/fakesql/fakesql.cpp代替-lmariadb；测试控制接口在fakesql.h
+*/
+#include <stddef.h>
+
+typedef char my_bool;
+typedef int my_socket;
+typedef struct st_mysql MYSQL;
+typedef struct st_mysql_res MYSQL_RES;
+typedef struct st_mysql_stmt MYSQL_STMT;
+typedef char** MYSQL_ROW;
+
+enum enum_field_types { MYSQL_TYPE_STRING = 254 };
+enum mysql_option { MYSQL_OPT_NONBLOCK = 6000 };
+
+typedef struct st_mysql_bind {
+    unsigned long* length;
+    my_bool* is_null;
+    void* buffer;
+    my_bool* error;
+    unsigned long buffer_length;
+    enum enum_field_types buffer_type;
+} MYSQL_BIND;
+
+// MariaDB的非阻塞接口要等的事件，有它说明客户端库支持非阻塞查询
+#define MYSQL_WAIT_READ 1
+#define MYSQL_WAIT_WRITE 2
+#define MYSQL_WAIT_EXCEPT 4
+#define MYSQL_WAIT_TIMEOUT 8
+
+#define MYSQL_NO_DATA 100
+#define MYSQL_DATA_TRUNCATED 101
+
+extern "C" {
+
+int mysql_library_init(int argc, char** argv, char** groups);
+void mysql_library_end(void);
+void mysql_thread_end(void);
+
+MYSQL* mysql_init(MYSQL* mysql);
+int mysql_options(MYSQL* mysql, enum mysql_option option, const void* arg);
+MYSQL* mysql_real_connect(MYSQL* mysql, const char* host, const char* user, const char* passwd,
+                          const char* db, unsigned int port, const char* unixSocket, unsigned long flags);
+void mysql_close(MYSQL* mysql);
+int mysql_ping(MYSQL* mysql);
+my_socket mysql_get_socket(MYSQL* mysql);
+
+int mysql_query(MYSQL* mysql, const char* query);
+MYSQL_RES* mysql_store_result(MYSQL* mysql);
+MYSQL_ROW mysql_fetch_row(MYSQL_RES* res);
+void mysql_free_result(MYSQL_RES* res);
+
+MYSQL_STMT* mysql_stmt_init(MYSQL* mysql);
+int mysql_stmt_prepare(MYSQL_STMT* stmt, const char* query, unsigned long length);
+my_bool mysql_stmt_bind_param(MYSQL_STMT* stmt, MYSQL_BIND* bind);
+my_bool mysql_stmt_bind_result(MYSQL_STMT* stmt, MYSQL_BIND* bind);
+int mysql_stmt_execute(MYSQL_STMT* stmt);
+int mysql_stmt_execute_start(int* ret, MYSQL_STMT* stmt);
+int mysql_stmt_execute_cont(int* ret, MYSQL_STMT* stmt, int ready);
+int mysql_stmt_store_result(MYSQL_STMT* stmt);
+int mysql_stmt_store_result_start(int* ret, MYSQL_STMT* stmt);
+int mysql_stmt_store_result_cont(int* ret, MYSQL_STMT* stmt, int ready);
+int mysql_stmt_fetch(MYSQL_STMT* stmt);
+my_bool mysql_stmt_free_result(MYSQL_STMT* stmt);
+my_bool mysql_stmt_close(MYSQL_STMT* stmt);
+const char* mysql_stmt_error(MYSQL_STMT* stmt);
+unsigned int mysql_stmt_errno(MYSQL_STMT* stmt);
+
+}
+
+#endif //FAKESQL_MYSQL_H
@@ -0,0 +1,7 @@
+#ifndef FAKESQL_MYSQLD_ERROR_H
+#define FAKESQL_MYSQLD_ERROR_H
+
+/* 服务器的错误码，只有用到的 */
+#define ER_DUP_ENTRY 1062
+
+#endif //FAKESQL_MYSQLD_ERROR_H
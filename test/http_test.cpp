@@ -0,0 +1,440 @@
+/**
+ * HTTP连接的回归测试：用socketpair代替客户端，直接驱动HttpConn的read/process/write，
+ * 检查对端收到的响应；不需要起服务器，也不需要数据库
+ * 用法：cd test && make && ./http_test
+*/
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "../code/http/httpconn.h"
+
+using namespace std;
+
+static int failed = 0;
+
+#define CHECK(cond) do { \
+    if(!(cond)) { printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failed++; } \
+} while(0)
+
+// 一个测试用的连接：fds[0]给HttpConn，fds[1]是客户端
+struct Peer {
+    int fds[2];
+    HttpConn conn;
+
+    Peer() {
+        int ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds);
+        assert(ret == 0);
+        (void)ret;
+        sockaddr_in addr = {};
+        conn.init(fds[0], addr);
+    }
+
+    ~Peer() {
+        conn.Close();
+        close(fds[1]);
+    }
+
+    void Send(const string& data) {
+        ssize_t ret = ::write(fds[1], data.data(), data.size());
+        assert(ret == static_cast<ssize_t>(data.size()));
+        (void)ret;
+    }
+
+    // 和SubReactor一样：读一次，能处理的都处理完写出去；返回连接是否还保持
+    bool Serve() {
+        int err = 0;
+        if(conn.read(&err) <= 0 && err != EAGAIN) { return false; }
+        while(conn.process()) {
+            while(conn.ToWriteBytes() > 0) {
+                if(conn.write(&err) <= 0 && err != EAGAIN) { return false; }
+            }
+            if(!conn.IsKeepAlive()) { return false; }
+        }
+        return true;
+    }
+
+    string Recv() {
+        string out;
+        char buf[65536];
+        ssize_t len;
+        while((len = ::read(fds[1], buf, sizeof(buf))) > 0) {
+            out.append(buf, len);
+        }
+        return out;
+    }
+};
+
+static int Count(const string& s, const string& sub) {
+    int n = 0;
+    for(size_t pos = s.find(sub); pos != string::npos; pos = s.find(sub, pos + sub.size())) { n++; }
+    return n;
+}
+
+static void WriteFile(const string& path, const string& content) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    assert(fd >= 0);
+    ssize_t ret = ::write(fd, content.data(), content.size());
+    assert(ret == static_cast<ssize_t>(content.size()));
+    (void)ret;
+    close(fd);
+}
+
+// HTTP/1.1没有Connection头默认保持连接，流水线的3个请求都要有响应
+static void TestPipelineDefaultKeepAlive() {
+    printf("pipeline without Connection header\n");
+    Peer p;
+    string req = "GET /index.html HTTP/1.1\r\nHost: x\r\n\r\n";
+    p.Send(req + req + req);
+    CHECK(p.Serve());
+    string resp = p.Recv();
+    CHECK(Count(resp, "HTTP/1.1 200 OK") == 3);
+    CHECK(Count(resp, "Connection: keep-alive") == 3);
+}
+
+static void TestConnectionHeader() {
+    printf("Connection: close / HTTP/1.0\n");
+    {
+        Peer p;
+        p.Send("GET /index.html HTTP/1.1\r\nConnection: close\r\n\r\nGET /index.html HTTP/1.1\r\n\r\n");
+        CHECK(!p.Serve());
+        CHECK(Count(p.Recv(), "HTTP/1.1 200 OK") == 1);
+    }
+    {
+        Peer p;
+        p.Send("GET /index.html HTTP/1.0\r\n\r\n");
+        CHECK(!p.Serve());
+        CHECK(Count(p.Recv(), "HTTP/1.1 200 OK") == 1);
+    }
+    {
+        Peer p;
+        p.Send("GET /index.html HTTP/1.0\r\nConnection: Keep-Alive\r\n\r\n");
+        CHECK(p.Serve());
+        CHECK(Count(p.Recv(), "Connection: keep-alive") == 1);
+    }
+}
+
+// 有压缩版本时区间请求按原文件算：416报原文件的大小，206发原文件的内容
+static void TestRangeWithCompressedVariant() {
+    printf("Range + Accept-Encoding: gzip\n");
+    {
+        Peer p;
+        p.Send("GET /index.html HTTP/1.1\r\nAccept-Encoding: gzip\r\nRange: bytes=99999-\r\n\r\n");
+        CHECK(p.Serve());
+        string resp = p.Recv();
+        CHECK(Count(resp, "HTTP/1.1 416 ") == 1);
+        CHECK(Count(resp, "Content-Range: bytes */1000\r\n") == 1);
+        CHECK(Count(resp, "Content-Encoding") == 0);
+    }
+    {
+        Peer p;
+        p.Send("GET /index.html HTTP/1.1\r\nAccept-Encoding: gzip\r\nRange: bytes=990-\r\n\r\n");
+        CHECK(p.Serve());
+        string resp = p.Recv();
+        CHECK(Count(resp, "HTTP/1.1 206 ") == 1);
+        CHECK(Count(resp, "Content-Range: bytes 990-999/1000\r\n") == 1);
+        CHECK(Count(resp, "Content-Encoding") == 0);
+        CHECK(resp.size() >= 10 && resp.compare(resp.size() - 10, 10, string(10, 'i')) == 0);
+    }
+    {
+        // 没有Range时照常发压缩文件
+        Peer p;
+        p.Send("GET /index.html HTTP/1.1\r\nAccept-Encoding: gzip\r\n\r\n");
+        CHECK(p.Serve());
+        CHECK(Count(p.Recv(), "Content-Encoding: gzip") == 1);
+    }
+}
+
+// 空文件是空的200；打不开文件时首行和验证器还没写，改成错误页
+static void TestEmptyAndUnopenable() {
+    printf("empty file / open failure\n");
+    {
+        Peer p;
+        p.Send("GET /empty.html HTTP/1.1\r\n\r\n");
+        CHECK(p.Serve());
+        string resp = p.Recv();
+        CHECK(Count(resp, "HTTP/1.1 200 OK") == 1);
+        CHECK(Count(resp, "Content-length: 0\r\n\r\n") == 1);
+        CHECK(resp.size() >= 4 && resp.compare(resp.size() - 4, 4, "\r\n\r\n") == 0);
+    }
+    {
+        // fd用完了，open失败：500，不能带ETag/Last-Modified
+        Peer p;
+        p.Send("GET /index.html HTTP/1.1\r\n\r\n");
+        struct rlimit old, lim;
+        getrlimit(RLIMIT_NOFILE, &old);
+        int next = dup(p.fds[1]);
+        close(next);
+        lim = old;
+        lim.rlim_cur = next;
+        setrlimit(RLIMIT_NOFILE, &lim);
+        bool alive = p.Serve();
+        setrlimit(RLIMIT_NOFILE, &old);
+        CHECK(alive);
+        string resp = p.Recv();
+        CHECK(Count(resp, "HTTP/1.1 500 ") == 1);
+        CHECK(Count(resp, "ETag") == 0);
+        CHECK(Count(resp, "Last-Modified") == 0);
+    }
+}
+
+// 按n个字节一段切开，模拟一个请求分好几次读到
+static vector<string> Split(const string& data, size_t n) {
+    vector<string> pieces;
+    for(size_t pos = 0; pos < data.size(); pos += n) { pieces.push_back(data.substr(pos, n)); }
+    return pieces;
+}
+
+// 一段段喂给parser，解析出结果（不是NO_REQUEST）就停；fed是喂了几段
+static HttpRequest::HTTP_CODE Feed(HttpRequest& request, const vector<string>& pieces, size_t* fed) {
+    Buffer buff;
+    HttpRequest::HTTP_CODE ret = HttpRequest::NO_REQUEST;
+    for(*fed = 0; *fed < pieces.size() && ret == HttpRequest::NO_REQUEST; (*fed)++) {
+        buff.Append(pieces[*fed]);
+        ret = request.parse(buff);
+    }
+    return ret;
+}
+
+static HttpRequest::HTTP_CODE Parse(HttpRequest& request, const string& data) {
+    size_t fed;
+    return Feed(request, { data }, &fed);
+}
+
+// 请求体分帧：Content-Length分几次读到、chunked的扩展和trailer、TE和CL同时出现、块大小溢出
+static void TestBodyFraming() {
+    printf("request body framing\n");
+    {
+        HttpRequest request;
+        string body(1000, 'b');
+        vector<string> pieces = Split("POST /index.html HTTP/1.1\r\nContent-Length: 1000\r\n\r\n" + body, 7);
+        size_t fed;
+        CHECK(Feed(request, pieces, &fed) == HttpRequest::GET_REQUEST);
+        CHECK(fed == pieces.size());    // 最后一段到了才算完
+        CHECK(request.body() == body);
+        CHECK(request.BodyLen() == body.size());
+    }
+    {
+        HttpRequest request;
+        vector<string> pieces = Split("POST /index.html HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                                      "5;name=val\r\nhello\r\n6 ; x\r\n world\r\n0\r\nX-Check: yes\r\n\r\n", 3);
+        size_t fed;
+        CHECK(Feed(request, pieces, &fed) == HttpRequest::GET_REQUEST);
+        CHECK(fed == pieces.size());
+        CHECK(request.body() == "hello world");
+        CHECK(request.GetHeader("X-Check") == "yes");
+    }
+    {
+        HttpRequest request;
+        CHECK(Parse(request, "POST /index.html HTTP/1.1\r\nTransfer-Encoding: chunked\r\n"
+                             "Content-Length: 5\r\n\r\n5\r\nhello\r\n0\r\n\r\n") == HttpRequest::BAD_REQUEST);
+    }
+    {
+        HttpRequest request;
+        CHECK(Parse(request, "POST /index.html HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                             "fffffffffffffffffffff\r\n") == HttpRequest::TOO_LARGE_REQUEST);
+    }
+}
+
+// 记下交给sink的请求体，按需要让Write/Finish失败
+struct RecordingHandler: public BodyHandler {
+    string data;
+    int sinks = 0;
+    bool finished = false;
+    bool failWrite = false;
+    bool failFinish = false;
+
+    struct Sink: public BodySink {
+        RecordingHandler* handler;
+        explicit Sink(RecordingHandler* h): handler(h) {}
+        bool Write(const char* data, size_t len) override {
+            handler->data.append(data, len);
+            return !handler->failWrite;
+        }
+        bool Finish() override {
+            handler->finished = true;
+            return !handler->failFinish;
+        }
+    };
+
+    BodySink* NewSink(const HttpRequest& request) override {
+        (void)request;
+        sinks++;
+        return new Sink(this);
+    }
+};
+
+static void TestBodySink() {
+    printf("large bodies go to the BodySink\n");
+    BodyHandler* oldHandler = HttpRequest::bodyHandler;
+    const size_t big = HttpRequest::MAX_BUFFERED_BODY + 1000;
+    string body;
+    for(size_t i = 0; i < big; i++) { body += static_cast<char>('a' + i % 26); }
+    const string clReq = "POST /index.html HTTP/1.1\r\nContent-Length: " + to_string(big) + "\r\n\r\n" + body;
+    {
+        // Content-Length事先知道，一开始就交给sink
+        RecordingHandler handler;
+        HttpRequest::bodyHandler = &handler;
+        HttpRequest request;
+        size_t fed;
+        CHECK(Feed(request, Split(clReq, 4096), &fed) == HttpRequest::GET_REQUEST);
+        CHECK(handler.sinks == 1);
+        CHECK(handler.data == body);
+        CHECK(handler.finished);
+        CHECK(request.body().empty());
+        CHECK(request.BodyLen() == big);
+    }
+    {
+        // chunked攒过MAX_BUFFERED_BODY才交给sink，已经攒下的先交过去
+        RecordingHandler handler;
+        HttpRequest::bodyHandler = &handler;
+        HttpRequest request;
+        string req = "POST /index.html HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n";
+        const size_t chunk = 30000;
+        for(size_t pos = 0; pos < big; pos += chunk) {
+            string part = body.substr(pos, chunk);
+            char size[16];
+            snprintf(size, sizeof(size), "%zx\r\n", part.size());
+            req += size + part + "\r\n";
+        }
+        req += "0\r\n\r\n";
+        size_t fed;
+        CHECK(Feed(request, Split(req, 5000), &fed) == HttpRequest::GET_REQUEST);
+        CHECK(handler.sinks == 1);
+        CHECK(handler.data == body);
+        CHECK(handler.finished);
+        CHECK(request.body().empty());
+        CHECK(request.BodyLen() == big);
+    }
+    {
+        // 小的请求体照常放进body_
+        RecordingHandler handler;
+        HttpRequest::bodyHandler = &handler;
+        HttpRequest request;
+        CHECK(Parse(request, "POST /index.html HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello") == HttpRequest::GET_REQUEST);
+        CHECK(handler.sinks == 0);
+        CHECK(request.body() == "hello");
+    }
+    {
+        RecordingHandler handler;
+        handler.failWrite = true;
+        HttpRequest::bodyHandler = &handler;
+        HttpRequest request;
+        CHECK(Parse(request, clReq) == HttpRequest::BAD_REQUEST);
+        CHECK(!handler.finished);
+    }
+    {
+        RecordingHandler handler;
+        handler.failFinish = true;
+        HttpRequest::bodyHandler = &handler;
+        HttpRequest request;
+        CHECK(Parse(request, clReq) == HttpRequest::BAD_REQUEST);
+        CHECK(handler.finished);
+    }
+    HttpRequest::bodyHandler = oldHandler;
+}
+
+// 413之后先关写端，把对端还在发的请求体读掉，对端关闭或者读够上限才关闭
+static void TestLingerAfter413() {
+    printf("lingering close after 413\n");
+    size_t maxBody = HttpRequest::maxBodySize;
+    HttpRequest::maxBodySize = 100;
+    const string req = "POST /login HTTP/1.1\r\nContent-Length: 100000\r\n\r\n" + string(1000, 'x');
+    {
+        Peer p;
+        p.Send(req);
+        CHECK(!p.Serve());
+        CHECK(p.conn.StartLinger());
+        CHECK(p.conn.IsLingering());
+        // 写端关了，客户端读到响应之后是EOF
+        CHECK(Count(p.Recv(), "HTTP/1.1 413 ") == 1);
+        int err = 0;
+        p.Send(string(5000, 'x'));
+        CHECK(p.conn.Linger(&err));
+        shutdown(p.fds[1], SHUT_WR);
+        CHECK(!p.conn.Linger(&err));
+    }
+    {
+        Peer p;
+        p.Send(req);
+        CHECK(!p.Serve());
+        CHECK(p.conn.StartLinger());
+        CHECK(p.conn.Linger(HttpConn::MAX_LINGER_BYTES - 1));
+        CHECK(!p.conn.Linger(1));
+    }
+    {
+        // 正常的响应不用延迟关闭
+        Peer p;
+        p.Send("GET /index.html HTTP/1.1\r\nConnection: close\r\n\r\n");
+        CHECK(!p.Serve());
+        CHECK(!p.conn.StartLinger());
+    }
+    HttpRequest::maxBodySize = maxBody;
+}
+
+// 请求首行、请求头超过MAX_LINE，请求头超过MAX_HEADERS个：都是400，不再读这个连接
+static void TestRequestLimits() {
+    printf("line / header count limits\n");
+    string longLine = "GET /" + string(9000, 'a') + " HTTP/1.1\r\n\r\n";
+    string longHeader = "GET /index.html HTTP/1.1\r\nX-Long: " + string(9000, 'a') + "\r\n\r\n";
+    string headers;
+    for(int i = 0; i < 100; i++) { headers += "X-H" + to_string(i) + ": v\r\n"; }
+    string maxHeaders = "GET /index.html HTTP/1.1\r\n" + headers + "\r\n";
+    string tooMany = "GET /index.html HTTP/1.1\r\n" + headers + "X-H100: v\r\n\r\n";
+    {
+        HttpRequest request;
+        CHECK(Parse(request, maxHeaders) == HttpRequest::GET_REQUEST);
+        CHECK(request.HeaderCount() == 100);
+    }
+    {
+        // 行还没收完就已经超过了，不等'\n'
+        HttpRequest request;
+        CHECK(Parse(request, longLine.substr(0, 8200)) == HttpRequest::BAD_REQUEST);
+    }
+    for(const string& req: { longLine, longHeader, tooMany }) {
+        HttpRequest request;
+        CHECK(Parse(request, req) == HttpRequest::BAD_REQUEST);
+        Peer p;
+        p.Send(req);
+        CHECK(!p.Serve());
+        string resp = p.Recv();
+        CHECK(Count(resp, "HTTP/1.1 400 Bad Request") == 1);
+    }
+}
+
+int main() {
+    // 测试用的资源目录
+    char dir[] = "/tmp/http_test_XXXXXX";
+    if(!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    string root = string(dir) + "/";
+    WriteFile(root + "index.html", string(1000, 'i'));
+    WriteFile(root + "index.html.gz", "gz");     // 比原文件新，会被当成压缩版本
+    WriteFile(root + "empty.html", "");
+    WriteFile(root + "400.html", "bad request");
+    WriteFile(root + "404.html", "not found");
+    HttpConn::srcDir = strdup(root.c_str());
+    HttpConn::isET = true;
+
+    TestPipelineDefaultKeepAlive();
+    TestConnectionHeader();
+    TestRangeWithCompressedVariant();
+    TestEmptyAndUnopenable();
+    TestBodyFraming();
+    TestBodySink();
+    TestLingerAfter413();
+    TestRequestLimits();
+
+    string cmd = "rm -rf " + root;
+    if(system(cmd.c_str()) != 0) { perror("rm"); }
+    printf(failed ? "%d check(s) failed\n" : "all passed\n", failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,198 @@
+/**
+ * SqlVerify和SqlConnPool的回归测试：链接fakesql（假的MariaDB客户端库，user表在内存里），
+ * 非阻塞查询和真的一样要等socket可读，这里用poll代替服务器的poller驱动状态机
+ * 用法：cd test && make && ./sql_test
+*/
+#include <poll.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../code/pool/sqlverify.h"
+#include "fakesql.h"
+
+using namespace std;
+
+static int failed = 0;
+
+#define CHECK(cond) do { \
+    if(!(cond)) { printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failed++; } \
+} while(0)
+
+static const int MIN_CONN = 2;
+static const int MAX_CONN = 4;
+
+// 和服务器一样：Start没出结果就按WaitEvents等Fd()，就绪后Continue；返回等了几次
+static int Drive(UserVerify* verify) {
+    int waits = 0;
+    bool done = verify->Start();
+    while(!done) {
+        waits++;
+        pollfd pfd = { verify->Fd(), static_cast<short>(verify->WaitEvents()), 0 };
+        if(pfd.fd < 0 || pfd.events == 0 || poll(&pfd, 1, 1000) != 1) { return -1; }
+        // POLLIN/POLLOUT/POLLERR/POLLHUP和对应的EPOLL*取值相同
+        done = verify->Continue(pfd.revents);
+    }
+    CHECK(verify->Done());
+    return waits;
+}
+
+static bool Verify(const string& name, const string& pwd, bool isLogin, int* waits = nullptr) {
+    SqlVerify verify(name, pwd, isLogin);
+    int n = Drive(&verify);
+    if(waits) { *waits = n; }
+    return verify.Result();
+}
+
+// 后台线程是异步补连接的，等它一会儿
+static bool WaitFor(int (SqlConnPool::*count)(), int want) {
+    for(int i = 0; i < 200; i++) {
+        if((SqlConnPool::Instance()->*count)() >= want) { return true; }
+        usleep(10 * 1000);
+    }
+    return false;
+}
+
+// 登录和注册都要等数据库的socket，不能在Start里就同步做完
+static void TestLoginRegister() {
+    printf("login / register through the non-blocking path\n");
+    int waits = 0;
+    int executed = FakeSqlExecuteCount();
+    CHECK(Verify("admin", "123", true, &waits));
+    CHECK(waits >= 2);      // 执行、取结果各等一次
+    CHECK(FakeSqlExecuteCount() == executed + 1);
+    CHECK(!Verify("admin", "456", true));
+    CHECK(!Verify("admin", "456", false));      // 用户名被用过了
+    CHECK(Verify("bob", "789", false, &waits));
+    CHECK(waits >= 1);
+    CHECK(Verify("bob", "789", true));
+    CHECK(!Verify("bob", "000", true));
+    // 验证完连接都还回去了
+    CHECK(SqlConnPool::Instance()->GetFreeConnCount() == SqlConnPool::Instance()->GetConnCount());
+}
+
+// 注册查完用户、还没插入的时候，别处插进来同名的用户
+static bool RegisterRacing(const string& name) {
+    SqlVerify verify(name, "222", false);
+    int executed = FakeSqlExecuteCount();
+    bool added = false;
+    bool done = verify.Start();
+    while(!done) {
+        if(!added && FakeSqlExecuteCount() > executed) {
+            FakeSqlAddUser(name.c_str(), "111");
+            added = true;
+        }
+        pollfd pfd = { verify.Fd(), static_cast<short>(verify.WaitEvents()), 0 };
+        if(poll(&pfd, 1, 1000) != 1) { break; }
+        done = verify.Continue(pfd.revents);
+    }
+    CHECK(added);
+    return verify.Result();
+}
+
+// 启动以后别处直接INSERT进user表的用户过滤器里没有：注册还是要先查，不能插入重复的行；
+// 有唯一键时插入撞上ER_DUP_ENTRY就是用户名被用过了，不是连接坏了
+static void TestRegisterExisting() {
+    printf("register a user added behind the server's back\n");
+    SqlConnPool* pool = SqlConnPool::Instance();
+    FakeSqlAddUser("carol", "111");
+    CHECK(!Verify("carol", "222", false));
+    CHECK(FakeSqlUserRows("carol") == 1);
+    CHECK(Verify("carol", "111", true));
+
+    FakeSqlSetUnique(true);
+    int conns = pool->GetConnCount();
+    int connected = FakeSqlConnectCount();
+    CHECK(!RegisterRacing("dave"));
+    CHECK(FakeSqlUserRows("dave") == 1);
+    CHECK(Verify("dave", "111", true));
+    // 连接照常还回去，没有关掉重连
+    CHECK(pool->GetConnCount() == conns);
+    CHECK(pool->GetFreeConnCount() == conns);
+    CHECK(FakeSqlConnectCount() == connected);
+    FakeSqlSetUnique(false);
+}
+
+// 没有空闲连接时不等，直接Unavailable（回503），后台线程按缺口加连接，不超过上限
+static void TestBusyPool() {
+    printf("busy pool answers unavailable, keeper grows it\n");
+    SqlConnPool* pool = SqlConnPool::Instance();
+    CHECK(pool->GetFreeConnCount() == MIN_CONN);
+    vector<MYSQL*> held;
+    for(int i = 0; i < MIN_CONN; i++) { held.push_back(pool->GetConn()); }
+    CHECK(held.back() != nullptr);
+
+    uint64_t busy = pool->GetBusyCount();
+    {
+        SqlVerify verify("admin", "123", true);
+        CHECK(verify.Start());      // 不阻塞，马上有结果
+        CHECK(verify.Unavailable());
+        CHECK(!verify.Result());
+    }
+    CHECK(pool->GetBusyCount() > busy);
+    // 缺口由后台线程补上，下一次就能借到
+    CHECK(WaitFor(&SqlConnPool::GetFreeConnCount, 1));
+    CHECK(Verify("admin", "123", true));
+
+    // 借光到上限以后不再加
+    while(static_cast<int>(held.size()) < MAX_CONN) {
+        MYSQL* sql = pool->GetConn();
+        if(!sql) {
+            WaitFor(&SqlConnPool::GetFreeConnCount, 1);
+            continue;
+        }
+        held.push_back(sql);
+    }
+    CHECK(!pool->GetConn());
+    usleep(100 * 1000);
+    CHECK(pool->GetConnCount() == MAX_CONN);
+    CHECK(FakeSqlOpenCount() == MAX_CONN);
+    for(MYSQL* sql: held) { pool->FreeConn(sql); }
+    CHECK(pool->GetFreeConnCount() == MAX_CONN);
+}
+
+// 开始验证，等数据库的时候就析构，像客户端断开那样
+static bool Abandon() {
+    SqlVerify verify("admin", "123", true);
+    return !verify.Start() && verify.Fd() >= 0 && (verify.WaitEvents() & EPOLLIN);
+}
+
+// 等数据库的时候客户端断开：连接上还有没读完的结果，关掉，少于最小连接数时后台线程补回来
+static void TestAbandon() {
+    printf("abandoned verify discards its connection\n");
+    SqlConnPool* pool = SqlConnPool::Instance();
+    // 多出最小连接数的，关掉就少一个
+    while(pool->GetConnCount() > MIN_CONN) {
+        int conns = pool->GetConnCount();
+        CHECK(Abandon());
+        CHECK(pool->GetConnCount() == conns - 1);
+        CHECK(FakeSqlOpenCount() == conns - 1);
+    }
+    // 少于最小连接数了，后台线程新建一个补上
+    int connected = FakeSqlConnectCount();
+    CHECK(Abandon());
+    CHECK(WaitFor(&SqlConnPool::GetConnCount, MIN_CONN));
+    CHECK(WaitFor(&SqlConnPool::GetFreeConnCount, MIN_CONN));
+    CHECK(FakeSqlConnectCount() == connected + 1);
+    CHECK(FakeSqlOpenCount() == MIN_CONN);
+    CHECK(Verify("admin", "123", true));
+}
+
+int main() {
+    FakeSqlReset();
+    SqlConnPool::Instance()->Init("localhost", 3306, "root", "root", "webserver", MIN_CONN, MAX_CONN);
+    UserCache::Instance()->Init(0, 0);      // 不缓存密码，每次都查数据库
+    UserCache::Instance()->LoadNames(SqlConnPool::Instance());
+
+    TestLoginRegister();
+    TestRegisterExisting();
+    TestBusyPool();
+    TestAbandon();
+
+    SqlConnPool::Instance()->ClosePool();
+    CHECK(FakeSqlOpenCount() == 0);
+    printf(failed ? "%d check(s) failed\n" : "all passed\n", failed);
+    return failed ? 1 : 0;
+}
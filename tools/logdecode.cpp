@@ -0,0 +1,305 @@
+/*
+ * 二进制日志解码工具，把LOG_BINARY模式写出来的日志还原成和文本日志一样的格式
+ *   ./logdecode [-s] 日志文件...
+ *   -s 在每行后面加上调用点的文件名和行号
+ */
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <ctype.h>
+
+#include "../code/log/binlog.h"
+
+using namespace std;
+
+struct Site {
+    int level;
+    int line;
+    string file;
+    string format;
+};
+
+struct Arg {
+    uint8_t type;
+    uint64_t num;   // 整数、指针，double按位存放
+    string str;
+};
+
+/* 按顺序读一条记录里的字段 */
+class Reader {
+public:
+    Reader(const char* data, size_t len): cur_(data), end_(data + len), ok_(true) {}
+
+    template<typename T>
+    T Get() {
+        T val = T();
+        if(static_cast<size_t>(end_ - cur_) < sizeof(T)) {
+            ok_ = false;
+            return val;
+        }
+        memcpy(&val, cur_, sizeof(T));
+        cur_ += sizeof(T);
+        return val;
+    }
+
+    string GetStr() {
+        uint16_t len = Get<uint16_t>();
+        if(static_cast<size_t>(end_ - cur_) < len) {
+            ok_ = false;
+            return string();
+        }
+        string str(cur_, len);
+        cur_ += len;
+        return str;
+    }
+
+    bool ok() const { return ok_; }
+
+private:
+    const char* cur_;
+    const char* end_;
+    bool ok_;
+};
+
+class Decoder {
+public:
+    explicit Decoder(bool showSite): showSite_(showSite), baseTsc_(0), baseNs_(0), firstTsc_(0), firstNs_(0), ticksPerSec_(1e9) {}
+
+    bool Decode(const string& data);
+
+private:
+    bool Record_(char type, Reader& r);
+    void Log_(Reader& r);
+    string Format_(const string& fmt, const vector<Arg>& args);
+    void Stamp_(uint64_t tsc, string& out);
+
+    bool showSite_;
+    unordered_map<uint32_t, Site> sites_;
+    uint64_t baseTsc_;      // 最近一次时间同步
+    uint64_t baseNs_;
+    uint64_t firstTsc_;     // 文件头里的时间，和最近一次同步一起算tsc的频率
+    uint64_t firstNs_;
+    double ticksPerSec_;
+};
+
+bool Decoder::Decode(const string& data) {
+    size_t off = 0;
+    while(off + 3 <= data.size()) {
+        char type = data[off];
+        uint16_t len;
+        memcpy(&len, data.data() + off + 1, sizeof(len));
+        if(len < 3 || off + len > data.size()) {
+            fprintf(stderr, "truncated record at offset %zu\n", off);
+            return false;
+        }
+        Reader r(data.data() + off + 3, len - 3);
+        if(!Record_(type, r)) {
+            fprintf(stderr, "bad record '%c' at offset %zu\n", type, off);
+            return false;
+        }
+        off += len;
+    }
+    return true;
+}
+
+bool Decoder::Record_(char type, Reader& r) {
+    switch(type) {
+    case binlog::REC_HEADER: {
+        char magic[sizeof(binlog::MAGIC)];
+        for(char& c: magic) { c = r.Get<char>(); }
+        if(memcmp(magic, binlog::MAGIC, sizeof(magic)) != 0) { return false; }
+        baseTsc_ = firstTsc_ = r.Get<uint64_t>();
+        baseNs_ = firstNs_ = r.Get<uint64_t>();
+        ticksPerSec_ = r.Get<uint64_t>();
+        sites_.clear();
+        break;
+    }
+    case binlog::REC_SITE: {
+        uint32_t id = r.Get<uint32_t>();
+        Site& site = sites_[id];
+        site.level = r.Get<uint8_t>();
+        site.line = r.Get<uint32_t>();
+        site.file = r.GetStr();
+        site.format = r.GetStr();
+        break;
+    }
+    case binlog::REC_SYNC:
+        baseTsc_ = r.Get<uint64_t>();
+        baseNs_ = r.Get<uint64_t>();
+        // 跨度超过1秒后用文件头和这次同步重新算频率，比init时10ms量出来的准
+        if(baseNs_ - firstNs_ > 1000000000ULL && baseTsc_ > firstTsc_) {
+            ticksPerSec_ = (baseTsc_ - firstTsc_) * 1e9 / (baseNs_ - firstNs_);
+        }
+        break;
+    case binlog::REC_LOG:
+        Log_(r);
+        break;
+    default:
+        return false;
+    }
+    return r.ok();
+}
+
+void Decoder::Stamp_(uint64_t tsc, string& out) {
+    // 记录的tsc可能比同步点早（同一批里先写日志后同步），按有符号算
+    double delta = static_cast<double>(static_cast<int64_t>(tsc - baseTsc_)) * 1e9 / ticksPerSec_;
+    int64_t ns = static_cast<int64_t>(baseNs_) + static_cast<int64_t>(delta);
+    time_t sec = ns / 1000000000;
+    struct tm t;
+    localtime_r(&sec, &t);
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%d-%02d-%02d %02d:%02d:%02d.%06ld ",
+            t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec,
+            static_cast<long>(ns % 1000000000 / 1000));
+    out += buf;
+}
+
+void Decoder::Log_(Reader& r) {
+    static const char* TITLE[] = { "[debug]: ", "[info] : ", "[warn] : ", "[error]: " };
+    uint32_t id = r.Get<uint32_t>();
+    uint64_t tsc = r.Get<uint64_t>();
+    int argc = r.Get<uint8_t>();
+    vector<Arg> args(argc);
+    for(Arg& arg: args) {
+        arg.type = r.Get<uint8_t>();
+        if(arg.type == binlog::ARG_STR) {
+            arg.str = r.GetStr();
+        } else {
+            arg.num = r.Get<uint64_t>();
+        }
+    }
+    if(!r.ok()) { return; }
+
+    string out;
+    Stamp_(tsc, out);
+    auto it = sites_.find(id);
+    if(it == sites_.end()) {
+        out += "[?]    : <unknown site " + to_string(id) + ">";
+    } else {
+        const Site& site = it->second;
+        out += TITLE[(site.level >= 0 && site.level <= 3) ? site.level : 1];
+        out += Format_(site.format, args);
+        if(showSite_) {
+            out += "  (" + site.file + ":" + to_string(site.line) + ")";
+        }
+    }
+    out += '\n';
+    fwrite(out.data(), 1, out.size(), stdout);
+}
+
+/* 按格式串逐个转换说明符处理，长度修饰符统一换成64位的 */
+string Decoder::Format_(const string& fmt, const vector<Arg>& args) {
+    string out;
+    size_t next = 0;
+    char buf[1024];
+    auto nextArg = [&]() -> const Arg* {
+        return next < args.size() ? &args[next++] : nullptr;
+    };
+    for(size_t i = 0; i < fmt.size(); i++) {
+        if(fmt[i] != '%') {
+            out += fmt[i];
+            continue;
+        }
+        if(i + 1 < fmt.size() && fmt[i + 1] == '%') {
+            out += '%';
+            i++;
+            continue;
+        }
+        // 标志、宽度、精度，'*'从参数里取
+        string spec = "%";
+        size_t j = i + 1;
+        while(j < fmt.size() && strchr("-+ #0", fmt[j])) { spec += fmt[j++]; }
+        for(int part = 0; part < 2; part++) {
+            if(part == 1) {
+                if(j >= fmt.size() || fmt[j] != '.') { break; }
+                spec += fmt[j++];
+            }
+            if(j < fmt.size() && fmt[j] == '*') {
+                const Arg* arg = nextArg();
+                spec += to_string(arg ? static_cast<int>(arg->num) : 0);
+                j++;
+            }
+            while(j < fmt.size() && isdigit(static_cast<unsigned char>(fmt[j]))) { spec += fmt[j++]; }
+        }
+        while(j < fmt.size() && strchr("hlLqjzt", fmt[j])) { j++; }
+        if(j >= fmt.size()) {
+            out += fmt.substr(i);
+            break;
+        }
+        char conv = fmt[j];
+        i = j;
+        const Arg* arg = nextArg();
+        if(!arg) {
+            out += "<?>";
+            continue;
+        }
+        if(strchr("di", conv)) {
+            spec += "lld";
+            snprintf(buf, sizeof(buf), spec.c_str(), static_cast<long long>(arg->num));
+        } else if(strchr("ouxX", conv)) {
+            spec += "ll";
+            spec += conv;
+            snprintf(buf, sizeof(buf), spec.c_str(), static_cast<unsigned long long>(arg->num));
+        } else if(conv == 'c') {
+            spec += conv;
+            snprintf(buf, sizeof(buf), spec.c_str(), static_cast<int>(arg->num));
+        } else if(strchr("eEfFgGaA", conv)) {
+            double val;
+            memcpy(&val, &arg->num, sizeof(val));
+            spec += conv;
+            snprintf(buf, sizeof(buf), spec.c_str(), val);
+        } else if(conv == 's') {
+            spec += 's';
+            snprintf(buf, sizeof(buf), spec.c_str(), arg->type == binlog::ARG_STR ? arg->str.c_str() : "<?>");
+        } else if(conv == 'p') {
+            spec += 'p';
+            snprintf(buf, sizeof(buf), spec.c_str(), reinterpret_cast<void*>(arg->num));
+        } else {
+            snprintf(buf, sizeof(buf), "<%%%c?>", conv);
+        }
+        out += buf;
+    }
+    return out;
+}
+
+static bool ReadFile(const char* path, string& data) {
+    FILE* fp = fopen(path, "rb");
+    if(!fp) { return false; }
+    char buf[65536];
+    size_t len;
+    while((len = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        data.append(buf, len);
+    }
+    fclose(fp);
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    bool showSite = false;
+    int first = 1;
+    if(argc > 1 && strcmp(argv[1], "-s") == 0) {
+        showSite = true;
+        first = 2;
+    }
+    if(first >= argc) {
+        fprintf(stderr, "usage: %s [-s] logfile...\n", argv[0]);
+        return 1;
+    }
+    int ret = 0;
+    for(int i = first; i < argc; i++) {
+        string data;
+        if(!ReadFile(argv[i], data)) {
+            fprintf(stderr, "can't read %s\n", argv[i]);
+            ret = 1;
+            continue;
+        }
+        // 每个文件自带文件头和调用点表，可以单独解码
+        Decoder decoder(showSite);
+        if(!decoder.Decode(data)) { ret = 1; }
+    }
+    return ret;
+}
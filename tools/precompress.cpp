@@ -0,0 +1,190 @@
+/*
+ * 静态资源预压缩工具，在文本类文件旁边生成.gz（和.br）压缩版本，服务器按Accept-Encoding挑着发
+ *   ./precompress [-f] 目录...
+ *   -f 不管压缩文件是不是比原文件新，全部重新生成
+ * 压缩后省不到10%的不保留；原文件改了以后重新跑一次，服务器不会用比原文件旧的压缩文件
+ */
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <ftw.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#ifdef HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+using namespace std;
+
+// 和HttpResponse::Compressible对应的后缀
+static const char* COMPRESSIBLE_SUFFIX[] = {
+    ".html", ".xml", ".xhtml", ".txt", ".rtf", ".css", ".js", ".json",
+    ".svg", ".ico", ".ttf", ".otf", ".eot",
+};
+
+static bool force = false;
+static size_t fileCnt = 0;
+static size_t inBytes = 0;
+static size_t outBytes[2] = { 0, 0 };
+
+static bool Compressible(const char* path) {
+    const char* dot = strrchr(path, '.');
+    if(!dot || strchr(dot, '/')) { return false; }
+    for(const char* suffix: COMPRESSIBLE_SUFFIX) {
+        if(strcmp(dot, suffix) == 0) { return true; }
+    }
+    return false;
+}
+
+static bool ReadFile(const char* path, string* data) {
+    FILE* fp = fopen(path, "rb");
+    if(!fp) { return false; }
+    char buf[65536];
+    size_t len;
+    while((len = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        data->append(buf, len);
+    }
+    bool ok = !ferror(fp);
+    fclose(fp);
+    return ok;
+}
+
+static bool Gzip(const string& in, string* out, bool) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    // windowBits加16输出gzip格式
+    if(deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    out->resize(deflateBound(&zs, in.size()));
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    zs.avail_in = in.size();
+    zs.next_out = reinterpret_cast<Bytef*>(&(*out)[0]);
+    zs.avail_out = out->size();
+    int ret = deflate(&zs, Z_FINISH);
+    out->resize(zs.total_out);
+    deflateEnd(&zs);
+    return ret == Z_STREAM_END;
+}
+
+#ifdef HAVE_BROTLI
+static bool Brotli(const string& in, string* out, bool isFont) {
+    size_t len = BrotliEncoderMaxCompressedSize(in.size());
+    out->resize(len);
+    if(!BrotliEncoderCompress(BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW,
+                              isFont ? BROTLI_MODE_FONT : BROTLI_MODE_TEXT,
+                              in.size(), reinterpret_cast<const uint8_t*>(in.data()),
+                              &len, reinterpret_cast<uint8_t*>(&(*out)[0]))) {
+        return false;
+    }
+    out->resize(len);
+    return true;
+}
+#endif
+
+// 压缩文件比原文件新就不用重新生成
+static bool UpToDate(const string& path, const struct stat& orig) {
+    struct stat st;
+    if(stat(path.c_str(), &st) < 0) { return false; }
+    return st.st_mtim.tv_sec > orig.st_mtim.tv_sec ||
+           (st.st_mtim.tv_sec == orig.st_mtim.tv_sec && st.st_mtim.tv_nsec >= orig.st_mtim.tv_nsec);
+}
+
+// 先写临时文件再rename，正在运行的服务器不会读到写了一半的文件；权限和原文件一样
+static bool WriteFile(const string& path, const string& data, mode_t mode) {
+    string tmp = path + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, mode & 0777);
+    if(fd < 0) { return false; }
+    fchmod(fd, mode & 0777);
+    size_t off = 0;
+    while(off < data.size()) {
+        ssize_t len = write(fd, data.data() + off, data.size() - off);
+        if(len <= 0) { break; }
+        off += len;
+    }
+    bool ok = off == data.size() && close(fd) == 0;
+    if(!ok || rename(tmp.c_str(), path.c_str()) < 0) {
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+// 压缩一种格式，省得不够多就删掉旧的压缩文件，返回写出去的大小
+static size_t Variant(const char* path, const struct stat& st, const string& data,
+                      const char* suffix, bool (*compress)(const string&, string*, bool)) {
+    string out;
+    string vpath = string(path) + suffix;
+    const char* name = strrchr(path, '.');
+    bool isFont = strcmp(name, ".ttf") == 0 || strcmp(name, ".otf") == 0 || strcmp(name, ".eot") == 0;
+    if(!compress(data, &out, isFont) || out.size() > data.size() / 10 * 9) {
+        unlink(vpath.c_str());
+        printf("  %-50s %s skipped\n", path, suffix);
+        return data.size();
+    }
+    if(!WriteFile(vpath, out, st.st_mode)) {
+        fprintf(stderr, "write %s error: %s\n", vpath.c_str(), strerror(errno));
+        return data.size();
+    }
+    printf("  %-50s %s %zu -> %zu\n", path, suffix, data.size(), out.size());
+    return out.size();
+}
+
+static int Visit(const char* path, const struct stat* st, int type, struct FTW*) {
+    if(type != FTW_F || !S_ISREG(st->st_mode) || !Compressible(path)) {
+        return 0;
+    }
+    string gzPath = string(path) + ".gz";
+    string brPath = string(path) + ".br";
+#ifdef HAVE_BROTLI
+    bool upToDate = UpToDate(gzPath, *st) && UpToDate(brPath, *st);
+#else
+    bool upToDate = UpToDate(gzPath, *st);
+#endif
+    if(!force && upToDate) {
+        return 0;
+    }
+    string data;
+    if(!ReadFile(path, &data)) {
+        fprintf(stderr, "read %s error: %s\n", path, strerror(errno));
+        return 0;
+    }
+    fileCnt++;
+    inBytes += data.size();
+    outBytes[0] += Variant(path, *st, data, ".gz", Gzip);
+#ifdef HAVE_BROTLI
+    outBytes[1] += Variant(path, *st, data, ".br", Brotli);
+#endif
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    int opt;
+    while((opt = getopt(argc, argv, "f")) != -1) {
+        if(opt == 'f') {
+            force = true;
+        } else {
+            fprintf(stderr, "usage: %s [-f] dir...\n", argv[0]);
+            return 1;
+        }
+    }
+    if(optind >= argc) {
+        fprintf(stderr, "usage: %s [-f] dir...\n", argv[0]);
+        return 1;
+    }
+    for(int i = optind; i < argc; i++) {
+        if(nftw(argv[i], Visit, 16, FTW_PHYS) < 0) {
+            fprintf(stderr, "walk %s error: %s\n", argv[i], strerror(errno));
+            return 1;
+        }
+    }
+    printf("%zu files, %zu bytes, gzip %zu bytes", fileCnt, inBytes, outBytes[0]);
+#ifdef HAVE_BROTLI
+    printf(", br %zu bytes", outBytes[1]);
+#endif
+    printf("\n");
+    return 0;
+}